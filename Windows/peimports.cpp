@@ -0,0 +1,198 @@
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QtEndian>
+#include <cstring>
+#include "peimports.h"
+
+// Values from the PE/COFF specification
+enum PeConstants {
+    PeOptionalMagic32 = 0x10b,
+    PeOptionalMagic64 = 0x20b,
+    PeDirectoryImport = 1,
+    PeDirectoryDelayImport = 13,
+    PeSectionHeaderSize = 40,
+    PeImportDescriptorSize = 20,
+    PeDelayDescriptorSize = 32,
+    // The descriptor count is not stored, this protect against broken files
+    PeMaxDescriptors = 4096
+};
+
+struct PeSection
+{
+    quint32 virtualAddress;
+    quint32 virtualSize;
+    quint32 rawOffset;
+    quint32 rawSize;
+};
+
+class PeReader
+{
+public:
+    PeReader(const uchar* data, qint64 size)
+        : m_data(data), m_size(size)
+    {
+    }
+    bool    inBounds(quint64 offset, quint64 size) const
+    {
+        return offset <= quint64(m_size) && size <= quint64(m_size) - offset;
+    }
+    quint16 half(quint64 offset) const
+    {
+        return qFromLittleEndian<quint16>(m_data + offset);
+    }
+    quint32 word(quint64 offset) const
+    {
+        return qFromLittleEndian<quint32>(m_data + offset);
+    }
+    quint64 xword(quint64 offset) const
+    {
+        return qFromLittleEndian<quint64>(m_data + offset);
+    }
+    QByteArray  string(quint64 offset) const
+    {
+        if (offset >= quint64(m_size))
+            return QByteArray();
+        const char* start = reinterpret_cast<const char*>(m_data + offset);
+        return QByteArray(start, qstrnlen(start, m_size - offset));
+    }
+private:
+    const uchar*    m_data;
+    qint64          m_size;
+};
+
+static qint64  rvaToOffset(const QList<PeSection>& sections, quint64 rva)
+{
+    for (const PeSection& section : sections)
+    {
+        const quint32 size = qMax(section.virtualSize, section.rawSize);
+        if (rva >= section.virtualAddress && rva < quint64(section.virtualAddress) + size)
+        {
+            const quint64 delta = rva - section.virtualAddress;
+            // Uninitialized data, nothing to read in the file
+            if (delta >= section.rawSize)
+                return -1;
+            return section.rawOffset + delta;
+        }
+    }
+    return -1;
+}
+
+PeInfo      readPeImports(const QString& path)
+{
+    PeInfo info;
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly) || file.size() < 64)
+        return info;
+    const uchar* data = file.map(0, file.size());
+    if (data == nullptr)
+        return info;
+    PeReader reader(data, file.size());
+    if (memcmp(data, "MZ", 2) != 0)
+        return info;
+    const quint32 peOffset = reader.word(0x3C);
+    if (!reader.inBounds(peOffset, 24) || memcmp(data + peOffset, "PE\0\0", 4) != 0)
+        return info;
+    // COFF header follow the signature
+    const quint64 coff = peOffset + 4;
+    info.machine = reader.half(coff);
+    const quint16 sectionCount = reader.half(coff + 2);
+    const quint16 optionalSize = reader.half(coff + 16);
+    const quint64 optional = coff + 20;
+    if (!reader.inBounds(optional, optionalSize) || optionalSize < 2)
+        return info;
+    const quint16 magic = reader.half(optional);
+    if (magic != PeOptionalMagic32 && magic != PeOptionalMagic64)
+        return info;
+    info.is64 = magic == PeOptionalMagic64;
+    // Offsets in the optional header depend on PE32/PE32+
+    const quint64 dirCountOffset = info.is64 ? 108 : 92;
+    if (optionalSize < dirCountOffset + 4)
+        return info;
+    const quint64 imageBase = info.is64 ? reader.xword(optional + 24) : reader.word(optional + 28);
+    const quint32 dirCount = reader.word(optional + dirCountOffset);
+    const quint64 directories = optional + dirCountOffset + 4;
+    auto directoryRva = [&](quint32 index) -> quint32 {
+        if (index >= dirCount || directories + (index + 1) * 8 > optional + optionalSize)
+            return 0;
+        return reader.word(directories + index * 8);
+    };
+
+    const quint64 sectionTable = optional + optionalSize;
+    if (!reader.inBounds(sectionTable, quint64(sectionCount) * PeSectionHeaderSize))
+        return info;
+    QList<PeSection> sections;
+    for (quint16 i = 0; i < sectionCount; i++)
+    {
+        const quint64 header = sectionTable + quint64(i) * PeSectionHeaderSize;
+        sections.append({reader.word(header + 12), reader.word(header + 8), reader.word(header + 20), reader.word(header + 16)});
+    }
+    info.valid = true;
+
+    auto dllName = [&](quint64 rva) {
+        const qint64 offset = rvaToOffset(sections, rva);
+        return offset < 0 ? QString() : QString::fromLatin1(reader.string(offset));
+    };
+    const qint64 imports = rvaToOffset(sections, directoryRva(PeDirectoryImport));
+    if (directoryRva(PeDirectoryImport) != 0 && imports >= 0)
+    {
+        for (quint64 entry = imports; reader.inBounds(entry, PeImportDescriptorSize)
+             && entry < imports + quint64(PeMaxDescriptors) * PeImportDescriptorSize; entry += PeImportDescriptorSize)
+        {
+            const quint32 nameRva = reader.word(entry + 12);
+            if (nameRva == 0)
+                break;
+            const QString name = dllName(nameRva);
+            if (!name.isEmpty())
+                info.imports.append(name);
+        }
+    }
+    const qint64 delayImports = rvaToOffset(sections, directoryRva(PeDirectoryDelayImport));
+    if (directoryRva(PeDirectoryDelayImport) != 0 && delayImports >= 0)
+    {
+        for (quint64 entry = delayImports; reader.inBounds(entry, PeDelayDescriptorSize)
+             && entry < delayImports + quint64(PeMaxDescriptors) * PeDelayDescriptorSize; entry += PeDelayDescriptorSize)
+        {
+            const quint32 attributes = reader.word(entry);
+            quint64 nameAddress = reader.word(entry + 4);
+            if (nameAddress == 0)
+                break;
+            // Old linkers store virtual addresses instead of RVA, bit 0 tell which one is used
+            if ((attributes & 1) == 0 && nameAddress >= imageBase)
+                nameAddress -= imageBase;
+            const QString name = dllName(nameAddress);
+            if (!name.isEmpty())
+                info.delayImports.append(name);
+        }
+    }
+    return info;
+}
+
+PeClosure   peImportClosure(const QStringList& roots, const QStringList& appDirDlls)
+{
+    PeClosure closure;
+    QHash<QString, QString> dllByName;
+    for (const QString& path : appDirDlls)
+        dllByName[QFileInfo(path).fileName().toLower()] = path;
+    QStringList queue = roots;
+    while (!queue.isEmpty())
+    {
+        const QString path = queue.takeFirst();
+        if (closure.files.contains(path))
+            continue;
+        closure.files.insert(path);
+        PeInfo pe = readPeImports(path);
+        if (!pe.valid)
+        {
+            closure.unreadable = path;
+            return closure;
+        }
+        for (const QString& dll : pe.imports + pe.delayImports)
+        {
+            if (dllByName.contains(dll.toLower()))
+                queue << dllByName.value(dll.toLower());
+        }
+    }
+    closure.valid = true;
+    return closure;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <QSet>
+#include <QString>
+#include <QStringList>
+
+/*
+ * This only read the import and delay import tables of a PE/COFF file (exe or dll)
+ * It does not use any Windows API so it works on any host
+ */
+struct PeInfo
+{
+    bool        valid = false;
+    bool        is64 = false;
+    quint16     machine = 0;
+    QStringList imports;
+    QStringList delayImports;
+};
+
+struct PeClosure
+{
+    bool            valid = false;
+    QString         unreadable; // The first file whose imports could not be read
+    QSet<QString>   files;
+};
+
+PeInfo      readPeImports(const QString& path);
+// The roots and every dll of appDirDlls they need, directly or not. Only these dlls are followed,
+// the loader search the application directory first and compare the names case insensitively
+PeClosure   peImportClosure(const QStringList& roots, const QStringList& appDirDlls);
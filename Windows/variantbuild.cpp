@@ -0,0 +1,154 @@
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QDirIterator>
+#include <QDateTime>
+#include <QMap>
+#include <QSet>
+#include <QRegularExpression>
+
+#include "variantbuild.h"
+#include <sourcetree.h>
+#include <print.h>
+#include <trace.h>
+
+static const QStringList definesUsers = {"*.cpp", "*.cxx", "*.cc", "*.c", "*.h", "*.hpp", "*.hxx", "*.rc"};
+
+QList<VariantBuild> planVariantBuilds(const QList<QPair<QString, bool>>& variants, bool reuse)
+{
+    QList<VariantBuild> plan;
+    QMap<QString, int> compiledArch;
+    for (const auto& variant : variants)
+    {
+        VariantBuild build;
+        build.arch = variant.first;
+        build.standalone = variant.second;
+        if (reuse && compiledArch.contains(build.arch))
+            build.reuseFrom = compiledArch.value(build.arch);
+        else
+            compiledArch[build.arch] = plan.size();
+        plan.append(build);
+    }
+    return plan;
+}
+
+bool    copyBuildDirectory(const QString& source, const QString& destination)
+{
+    TraceSpan trace("copyBuildDirectory");
+    QDir sourceDir(source);
+    QDirIterator it(source, QDir::Files | QDir::Hidden | QDir::NoDotAndDotDot, QDirIterator::Subdirectories);
+    while (it.hasNext())
+    {
+        const QString file = it.next();
+        const QString target = destination + "/" + sourceDir.relativeFilePath(file);
+        QDir().mkpath(QFileInfo(target).absolutePath());
+        QFile::remove(target);
+        if (!QFile::copy(file, target))
+            return false;
+        QFile copied(target);
+        if (!copied.open(QIODevice::ReadWrite) || !copied.setFileTime(it.fileInfo().lastModified(), QFileDevice::FileModificationTime))
+            return false;
+    }
+    return true;
+}
+
+// Windows paths in Makefiles can use both separators and any case
+static QString  normalizedPath(const QString& path)
+{
+    QString toret = QDir::cleanPath(QDir::fromNativeSeparators(path));
+#ifdef Q_OS_WIN
+    toret = toret.toLower();
+#endif
+    return toret;
+}
+
+QStringList filesUsingDefines(const QString& sourcePath, const QStringList& defines)
+{
+    TraceSpan trace("filesUsingDefines");
+    QStringList patterns;
+    for (const QString& define : defines)
+        patterns << QRegularExpression::escape(define);
+    const QRegularExpression defineExp("\\b(" + patterns.join("|") + ")\\b");
+    QStringList toret;
+    for (const QString& file : sourceSnapshot(sourcePath).files)
+    {
+        if (!QDir::match(definesUsers, QFileInfo(file).fileName()))
+            continue;
+        QFile source(sourcePath + "/" + file);
+        if (source.open(QIODevice::ReadOnly) && defineExp.match(QString::fromUtf8(source.readAll())).hasMatch())
+            toret << QFileInfo(source).absoluteFilePath();
+    }
+    return toret;
+}
+
+QStringList staleMakeTargets(const QString& buildDir, const QStringList& changedFiles)
+{
+    TraceSpan trace("staleMakeTargets");
+    // target: dependencies, a drive letter colon is followed by a separator and not a blank
+    const QRegularExpression ruleExp("^([^\\s#][^=]*?)\\s*:(?:\\s+(.*))?$");
+    QList<QPair<QString, QStringList>> rules;
+    QDirIterator it(buildDir, QStringList() << "Makefile*", QDir::Files, QDirIterator::Subdirectories);
+    while (it.hasNext())
+    {
+        QFile makefile(it.next());
+        if (!makefile.open(QIODevice::ReadOnly | QIODevice::Text))
+            continue;
+        const QDir makefileDir = QFileInfo(makefile).absoluteDir();
+        const QString content = QString::fromLocal8Bit(makefile.readAll()).replace("\\\n", " ");
+        for (const QString& line : content.split('\n'))
+        {
+            if (line.startsWith('\t'))
+                continue;
+            auto match = ruleExp.match(line);
+            if (!match.hasMatch())
+                continue;
+            QStringList dependencies;
+            for (const QString& dependency : match.captured(2).split(QRegularExpression("\\s+"), Qt::SkipEmptyParts))
+            {
+                if (!dependency.startsWith("$("))
+                    dependencies << normalizedPath(makefileDir.absoluteFilePath(QString(dependency).remove('"')));
+            }
+            for (const QString& target : match.captured(1).split(QRegularExpression("\\s+"), Qt::SkipEmptyParts))
+                rules.append({normalizedPath(makefileDir.absoluteFilePath(QString(target).remove('"'))), dependencies});
+        }
+    }
+    // moc_x.cpp depends on x.h and moc_x.obj on moc_x.cpp, go until nothing new is stale
+    QSet<QString> stale;
+    for (const QString& file : changedFiles)
+        stale.insert(normalizedPath(file));
+    QStringList toret;
+    const QString buildRoot = normalizedPath(QFileInfo(buildDir).absoluteFilePath()) + "/";
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        for (const auto& rule : rules)
+        {
+            if (stale.contains(rule.first))
+                continue;
+            for (const QString& dependency : rule.second)
+            {
+                if (!stale.contains(dependency))
+                    continue;
+                stale.insert(rule.first);
+                // Only what the build wrote can be removed, never a source
+                if (rule.first.startsWith(buildRoot))
+                    toret << rule.first;
+                changed = true;
+                break;
+            }
+        }
+    }
+    return toret;
+}
+
+int     removeStaleMakeTargets(const QString& buildDir, const QStringList& changedFiles)
+{
+    int removed = 0;
+    for (const QString& target : staleMakeTargets(buildDir, changedFiles))
+    {
+        if (QFileInfo(target).isFile() && QFile::remove(target))
+            removed++;
+    }
+    return removed;
+}
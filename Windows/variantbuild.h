@@ -0,0 +1,30 @@
+#pragma once
+
+#include <QList>
+#include <QPair>
+#include <QString>
+#include <QStringList>
+
+/*
+ * The installer and standalone variants of a Windows build only differ by the SQPROJECT defines.
+ * The first variant of an arch is compiled, the next one starts from a copy of its build directory
+ * where only the make targets depending on a file using the defines are removed.
+ * None of this needs Windows, the build steps take a Runner that can be a dummy one.
+ */
+struct VariantBuild
+{
+    QString arch;
+    bool    standalone = false;
+    int     reuseFrom = -1; // index of the build whose directory is copied, -1 to compile everything
+};
+
+// The variants in build order as (arch, standalone)
+QList<VariantBuild> planVariantBuilds(const QList<QPair<QString, bool>>& variants, bool reuse);
+// Copy a build directory keeping the modification times, make would rebuild everything otherwise
+bool                copyBuildDirectory(const QString& source, const QString& destination);
+// The project sources (and .rc files) mentioning one of the defines, as absolute paths
+QStringList         filesUsingDefines(const QString& sourcePath, const QStringList& defines);
+// The files of buildDir that the qmake generated Makefiles build from one of these files, directly or not
+QStringList         staleMakeTargets(const QString& buildDir, const QStringList& changedFiles);
+// Remove the stale targets, the next make only rebuilds them and relinks
+int                 removeStaleMakeTargets(const QString& buildDir, const QStringList& changedFiles);
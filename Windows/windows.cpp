@@ -1,4 +1,4 @@
-#include "github.h"
+#include <QElapsedTimer>
 #include <QFile>
 #include <QDir>
 #include <QRegularExpression>
@@ -11,7 +11,19 @@
 #include <basestuff.h>
 #include <runner.h>
 #include <QTemporaryDir>
+#include <QDirIterator>
+#include <QStandardPaths>
+#include <QSet>
 #include <compile_defines.h>
+#include "peimports.h"
+#include "variantbuild.h"
+#include <ziparchive.h>
+#include <sevenziparchive.h>
+#include <trace.h>
+#include <artifacts.h>
+#include <cache.h>
+#include <buildsystem.h>
+#include <reproducible.h>
 
 enum WindowsArch {
     X86,
@@ -57,7 +69,6 @@ struct MSVCVersion
 
 struct WindowsStuff
 {
-    QString             sevenZipPath;
     QString             deployBasePath;
     QString             buildBasePath;
     QString             deployPath;
@@ -77,6 +88,7 @@ struct ReleaseFiles
     QString standaloneZip;
     QString standalone7Zip;
     QString innoSetup;
+    QString innoSetupLayout;
 };
 
 static QMap<WindowsArch, ReleaseFiles> releaseFiles;
@@ -141,6 +153,15 @@ struct s_ValidWindowsBuilds {
 
 struct s_ValidWindowsBuilds validWindowsBuilds;
 
+// The (arch, standalone) pairs planVariantBuilds works on
+static QList<QPair<QString, bool>> variantsOf(const QList<WindowsBuild>& builds)
+{
+    QList<QPair<QString, bool>> variants;
+    for (const WindowsBuild& build : builds)
+        variants.append({build.archString, build.standalone});
+    return variants;
+}
+
 static QString findFile(QString path, QRegularExpression exp)
 {
     QDir dir(path);
@@ -216,56 +237,75 @@ static void checkJom();
 static void findQtVersion();
 static QMap<WindowsArch, WindowsBuild *> pickQtVersion(const ProjectDefinition& project);
 static void checkMSVCVersion();
-static void buildProject(Runner& runner, const ProjectDefinition& project, WindowsBuild buildInfo);
-static void setMSVCEnv(Runner& runner, MSVCVersion& vers, WindowsArch arch);
-static void find7zip();
+static void buildProject(Runner& runner, const ProjectDefinition& project, const WindowsBuild& buildInfo, const WindowsBuild* reuseFrom = nullptr);
+static bool runEnvironmentScript(Runner& runner, const QString& startScript, const QStringList& args, QProcessEnvironment& env);
+static void setMSVCEnv(Runner& runner, const MSVCVersion& vers, WindowsArch arch);
 static void findInnoSetup();
 static void deployExtras(ProjectDefinition& project, const WindowsBuild& build);
 static void deployQt(Runner& runner, const ProjectDefinition& project, WindowsBuild& build);
 static void createRelease(const ProjectDefinition& proj, const WindowsBuild& build);
 static void generateInstaller(const ProjectDefinition& project, const WindowsBuild& build);
+static QString writeInnoSetupLayout(const ProjectDefinition& project, const WindowsBuild& build);
+static void reportReleaseFiles();
+static bool restoreReleaseFiles(const ProjectDefinition& project, const WindowsBuild& build, const QByteArray& cacheKey);
 static void buildLocalization(Runner& runner, const ProjectDefinition& project, WindowsBuild& buildInfo);
+static void pruneDeployment(const ProjectDefinition& project, const QString& deployPath, const QStringList& executables);
 
 
 extern PackagerOptions gOptions;
 
 void    buildWindows(ProjectDefinition& project)
 {
+    TraceSpan trace("buildWindows");
     Runner      runner(true);
 
     stuff.deployBasePath = gOptions.windowsDeployPath;
     stuff.buildBasePath = gOptions.windowsBuildPath;
 
     //runner.setEnv(QProcessEnvironment::systemEnvironment());
-    println("===== Building for Windows =====");
+    printSummary("===== Building for Windows =====");
     findQtVersion();
     checkMSVCVersion();
     auto pickedBuild = pickQtVersion(project);
 
-    find7zip();
     findInnoSetup();
 
     QList<WindowsBuild> builds;
+    builds.reserve(pickedBuild.size() * 2);
 
     QMapIterator<WindowsArch, WindowsBuild*> it(pickedBuild);
     println(QString("Found %1 usable build").arg(pickedBuild.size()));
     while (it.hasNext())
     {
         it.next();
-        WindowsBuild build = *it.value();
+        WindowsBuild build = std::move(*it.value());
         println("The following build with be used : " + build.toString());
         build.setStandalone(false);
         builds << build;
         build.setStandalone(true);
-        builds << build;
+        builds << std::move(build);
     }
-    for (WindowsBuild& build : builds)
+    qDeleteAll(pickedBuild);
+    // CMake builds can't reuse the other variant, the defines are on every compile command and Ninja rebuilds everything when one changes
+    const QList<VariantBuild> plan = planVariantBuilds(variantsOf(builds), project.buildSystem == BuildSystem::QMake);
+    QSet<int> compiled;
+    for (int i = 0; i < builds.size(); i++)
     {
+        WindowsBuild& build = builds[i];
         if (build.arch == ARM64)
             break;
         //println(build.toString());
+        LogJob job("windows-" + build.archString + (build.standalone ? "-standalone" : "-installer"));
+        printSummary("Building " + build.toString());
+        const QByteArray cacheKey = artifactCacheKey(project, "windows", build.toString());
+        if (restoreReleaseFiles(project, build, cacheKey))
+            continue;
+        const int firstArtifact = registeredArtifactCount();
         Runner runnerBuild(true);
-        buildProject(runnerBuild, project, build);
+        // A variant restored from the cache left no build directory to start from
+        const int reuseFrom = compiled.contains(plan[i].reuseFrom) ? plan[i].reuseFrom : -1;
+        buildProject(runnerBuild, project, build, reuseFrom >= 0 ? &builds[reuseFrom] : nullptr);
+        compiled.insert(i);
         deployExtras(project, build);
         deployQt(runnerBuild, project, build);
         if (project.translationDir.isEmpty() == false)
@@ -276,79 +316,82 @@ void    buildWindows(ProjectDefinition& project)
         } else {
             createRelease(project, build);
         }
+        storeCachedArtifacts(project, cacheKey, firstArtifact);
     }
-    println("Release files are the following");
-    for (auto plop : releaseFiles)
+    reportReleaseFiles();
+}
+
+// A hit replaces the whole build, the release files are taken from the cache entry
+static bool restoreReleaseFiles(const ProjectDefinition& project, const WindowsBuild& build, const QByteArray& cacheKey)
+{
+    QList<RegisteredArtifact> restored;
+    if (!restoreCachedArtifacts(project, cacheKey, &restored))
+        return false;
+    for (const RegisteredArtifact& artifact : restored)
     {
-        println("Standalone zip  :" + QDir::toNativeSeparators(plop.standaloneZip));
-        println("Standalone 7zip :" + QDir::toNativeSeparators(plop.standalone7Zip));
-        println("Inno Setup file :" + QDir::toNativeSeparators(plop.innoSetup));
+        if (artifact.kind == "standalone-zip")
+            releaseFiles[build.arch].standaloneZip = artifact.path;
+        if (artifact.kind == "standalone-7zip")
+            releaseFiles[build.arch].standalone7Zip = artifact.path;
+        if (artifact.kind == "innosetup")
+            releaseFiles[build.arch].innoSetup = artifact.path;
     }
-    if (isGithubAction())
+    return true;
+}
+
+static void reportReleaseFiles()
+{
+    printSummary("Release files are the following");
+    for (auto plop : releaseFiles)
     {
-        for (WindowsArch arch : releaseFiles.keys())
-        {
-            ReleaseFiles& plop = releaseFiles[arch];
-            QString nativeFilePath = QDir::toNativeSeparators(plop.standaloneZip);
-            addGithubOutput("sqpackager_win32_" + archToString[arch] + "_standalone_zip", nativeFilePath);
-            addGithubOutput("sqpackager_win32_" + archToString[arch] + "_standalone_zip_non_native_path", plop.standaloneZip);
-            if (plop.standalone7Zip.isEmpty() == false)
-            {
-                nativeFilePath = QDir::toNativeSeparators(plop.standalone7Zip);
-                addGithubOutput("sqpackager_win32_" + archToString[arch] + "_standalone_7zip", nativeFilePath);
-                addGithubOutput("sqpackager_win32_" + archToString[arch] + "_standalone_7zip_non_native_path", plop.standalone7Zip);
-            }
-            if (plop.innoSetup.isEmpty() == false)
-            {
-                nativeFilePath = QDir::toNativeSeparators(plop.innoSetup);
-                addGithubOutput("sqpackager_win32_" + archToString[arch] + "_innosetup", nativeFilePath);
-                addGithubOutput("sqpackager_win32_" + archToString[arch] + "_innosetup_non_native_path", plop.innoSetup);
-            }
-        }
+        printSummary("Standalone zip  :" + QDir::toNativeSeparators(plop.standaloneZip));
+        printSummary("Standalone 7zip :" + QDir::toNativeSeparators(plop.standalone7Zip));
+        printSummary("Inno Setup file :" + QDir::toNativeSeparators(plop.innoSetup));
+        if (plop.innoSetupLayout.isEmpty() == false)
+            printSummary("Inno Setup layout :" + QDir::toNativeSeparators(plop.innoSetupLayout));
     }
 }
 
 void    createRelease(const ProjectDefinition& proj, const WindowsBuild& build)
 {
-    //tar.exe -a -cf Test.zip Test
-    Runner runner(true);
-
+    TraceSpan trace("createRelease");
     println("Creating standalone release archives");
     QDir deployDir(build.deployBasePath);
     deployDir.cd("windows_deploy");
     QString zipFileName = build.releaseNameFull + ".zip";
     QString zip7FileName = build.releaseNameFull + ".7z";
     QString dirToCompress = build.releaseBaseName;
-    QFile::remove(build.deployBasePath + "/windows_deploy/" + zipFileName);
-    QFile::remove(build.deployBasePath + "/windows_deploy/" + zip7FileName);
-    printlnOk("Renaming deploy directory to " + dirToCompress, QFile::rename(build.deployFullPath, deployDir.absolutePath() + "/" + dirToCompress));
-    println("Creating .zip file");
-    bool ok = runner.run("tar.exe", deployDir.absolutePath(), QStringList() << "-a" << "-cf" << build.deployFullPath + "/../" +  zipFileName << dirToCompress);
-    if (!ok)
-    {
-        QFile::rename(deployDir.absolutePath() + "/" + dirToCompress, build.deployFullPath);
-        error_and_exit("Error trying to create the zip file");
-    }
-    releaseFiles[build.arch].standaloneZip = build.deployBasePath + "//windows_deploy/" + zipFileName;
-    if (stuff.sevenZipPath.isEmpty() == false)
-    {
-        println("Creating 7zip file");
-        ok = runner.run(stuff.sevenZipPath + "/7z.exe", deployDir.absolutePath(), QStringList() << "a" << "-t7z" << build.deployFullPath + "/../" + zip7FileName << dirToCompress);
-        println(runner.getStdout());
-        QFile::rename(deployDir.absolutePath() + "/" + dirToCompress, build.deployFullPath);
-        if (!ok)
-        {
-            println(runner.getStderr());
-            error_and_exit("Error trying to create the 7zip file");
-        }
-        releaseFiles[build.arch].standalone7Zip = build.deployBasePath + "/windows_deploy/" + zip7FileName;
-    } else {
-        QFile::rename(deployDir.absolutePath() + "/" + dirToCompress, build.deployFullPath);
-    }
+    QString zipPath = deployDir.absolutePath() + "/" + zipFileName;
+    QString zip7Path = deployDir.absolutePath() + "/" + zip7FileName;
+    QFile::remove(zipPath);
+    QFile::remove(zip7Path);
+    const QString target = "windows-" + build.archString;
+    const QString outputBase = "sqpackager_win32_" + archToString[build.arch];
+    QElapsedTimer timer;
+    timer.start();
+
+    // The files are read once, the 7z blocks are compressed in the background while the zip is written
+    println("Creating .zip and .7z files");
+    QString error;
+    SevenZipArchive sevenZip(zip7Path);
+    if (!sevenZip.open(&error))
+        error_and_exit("Error trying to create the 7zip file : " + error);
+    const ZipEntryHandler addToSevenZip = [&sevenZip](const QByteArray& name, const QByteArray& content, quint32 crc, const QDateTime& time) {
+        sevenZip.addFile(name, content, crc, time);
+    };
+    if (!writeZipArchive(zipPath, build.deployFullPath, dirToCompress, &error, gOptions.reproducible ? buildDateTime() : QDateTime(), addToSevenZip))
+        error_and_exit("Error trying to create the zip file : " + error);
+    releaseFiles[build.arch].standaloneZip = zipPath;
+    registerArtifact(target, "standalone-zip", zipPath, timer.elapsed(), outputBase + "_standalone_zip");
+    if (!sevenZip.close(&error))
+        error_and_exit("Error trying to create the 7zip file : " + error);
+    releaseFiles[build.arch].standalone7Zip = zip7Path;
+    registerArtifact(target, "standalone-7zip", zip7Path, timer.elapsed(), outputBase + "_standalone_7zip");
 }
 
 void    deployQt(Runner& runner, const ProjectDefinition& project, WindowsBuild& build)
 {
+    TraceSpan trace("deployQt");
     QStringList args;
     args << "--no-translations" << "--no-system-d3d-compiler" << "--release" << "--compiler-runtime";
     if (build.qt.version.majorVersion() == 5)
@@ -377,9 +420,6 @@ void    deployQt(Runner& runner, const ProjectDefinition& project, WindowsBuild&
     runner.runWithOut(build.qt.path + "/bin/windeployqt.exe", args << firstExe, build.deployFullPath);
 
     // Qt deploy is cute but this need to go
-    QFile::remove(build.deployFullPath + "/" + "opengl32sw.dll");
-    QFile::remove(build.deployFullPath + "/" + "libEGL.dll");
-    QFile::remove(build.deployFullPath + "/" + "libGLESV2.dll");
     QFile::remove(build.deployFullPath + "/" + "vc_redist.x64.exe");
     QFile::remove(build.deployFullPath + "/" + "vc_redist.x86.exe");
     /* windeployqt.exe is super stupid with QML
@@ -389,36 +429,125 @@ void    deployQt(Runner& runner, const ProjectDefinition& project, WindowsBuild&
     {
         QDir(build.deployFullPath + "/qmltooling").removeRecursively();
         if (project.qtModules.contains("pdf") == false)
-        {
-            QFile::remove(build.deployFullPath + "/" + "Qt6PdfQuick.dll");
-            QFile::remove(build.deployFullPath + "/" + "Qt6Pdf.dll");
             QDir(build.deployFullPath + "/QtQuick/Pdf").removeRecursively();
-        }
         if (project.qtModules.contains("3dcore") == false)
         {
-            QFile::remove(build.deployFullPath + "/" + "Qt63DAnimation.dll");
-            QFile::remove(build.deployFullPath + "/" + "Qt63DCore.dll");
-            QFile::remove(build.deployFullPath + "/" + "Qt63DExtras.dll");
-            QFile::remove(build.deployFullPath + "/" + "Qt63DInput.dll");
-            QFile::remove(build.deployFullPath + "/" + "Qt63DLogic.dll");
-            QFile::remove(build.deployFullPath + "/" + "Qt63DQuickScene2D.dll");
-            QFile::remove(build.deployFullPath + "/" + "Qt63DRender.dll");
             QDir(build.deployFullPath + "/QtQuick/Scene3D").removeRecursively();
             QDir(build.deployFullPath + "/geometryloaders").removeRecursively();
         }
-        if (project.qtModules.contains("sql") == false)
+    }
+    pruneDeployment(project, build.deployFullPath, build.executables);
+}
+
+/*
+ * Plugins are loaded at runtime so they don't appear in any import table
+ * The dlls in these directories are kept and used as roots of the closure
+ */
+static const QStringList alwaysKeptPluginDirs = {
+    "platforms", "styles", "imageformats", "iconengines", "generic", "platforminputcontexts", "platformthemes"
+};
+
+static const QMap<QString, QStringList> pluginDirsForModule = {
+    {"network", {"tls", "networkinformation", "bearer"}},
+    {"sql", {"sqldrivers"}},
+    {"multimedia", {"multimedia", "mediaservice", "audio", "playlistformats"}},
+    {"texttospeech", {"texttospeech"}},
+    {"printsupport", {"printsupport"}},
+    {"positioning", {"position"}},
+    {"quick", {"scenegraph"}}
+};
+
+// The plugin directories deployed for the project, sqproject.json can add some to the lists above
+static QStringList keptPluginDirs(const ProjectDefinition& project)
+{
+    QStringList dirs = alwaysKeptPluginDirs + project.windowsPluginDirs;
+    for (const QString& module : project.qtModules)
+        dirs << pluginDirsForModule.value(module) << project.windowsModulePluginDirs.value(module);
+    dirs.removeDuplicates();
+    return dirs;
+}
+
+static bool isKeptPlugin(const ProjectDefinition& project, const QStringList& keptPluginDirs, const QDir& deployDir, const QString& path)
+{
+    const QString relative = deployDir.relativeFilePath(path);
+    if (keptPluginDirs.contains(relative.section('/', 0, 0), Qt::CaseInsensitive))
+        return true;
+    // QML module plugins are loaded by the QML engine from the directory of their qmldir file
+    if (project.qmlProject)
+    {
+        QDir dir = QFileInfo(path).absoluteDir();
+        while (dir.absolutePath().length() > deployDir.absolutePath().length())
         {
-            QFile::remove(build.deployFullPath + "/" + "Qt6Sql.dll");
+            if (dir.exists("qmldir"))
+                return true;
+            dir.cdUp();
         }
-        if (project.qtModules.contains("multimedia") == false && project.qtModules.contains("texttospeech") == false)
+    }
+    return false;
+}
+
+/*
+ * windeployqt copy more than what the executables need, this compute the closure of the dlls
+ * from the PE import and delay import tables, starting from the executables and the allowed plugins
+ * Every dll outside of the closure is removed
+ */
+static void pruneDeployment(const ProjectDefinition& project, const QString& deployPath, const QStringList& executables)
+{
+    TraceSpan trace("pruneDeployment");
+    println("Removing the deployed dlls that are not needed");
+    QDir deployDir(deployPath);
+    const QStringList pluginDirs = keptPluginDirs(project);
+
+    QStringList appDirDlls;
+    QStringList allDlls;
+    QStringList roots;
+    for (const QString& exe : executables)
+        roots << deployDir.absoluteFilePath(exe);
+    QDirIterator it(deployDir.absolutePath(), QStringList() << "*.dll", QDir::Files, QDirIterator::Subdirectories);
+    while (it.hasNext())
+    {
+        const QString path = it.next();
+        allDlls << path;
+        if (it.fileInfo().absolutePath() == deployDir.absolutePath())
+            appDirDlls << path;
+        else if (isKeptPlugin(project, pluginDirs, deployDir, path))
+            roots << path;
+    }
+    const PeClosure peClosure = peImportClosure(roots, appDirDlls);
+    if (!peClosure.valid)
+    {
+        println("\tCould not read the imports of " + peClosure.unreadable + ", nothing will be removed");
+        return ;
+    }
+    const QSet<QString>& closure = peClosure.files;
+    qint64 savedBytes = 0;
+    int removed = 0;
+    for (const QString& path : allDlls)
+    {
+        if (closure.contains(path))
+            continue;
+        const qint64 size = QFileInfo(path).size();
+        if (QFile::remove(path))
         {
-            QFile::remove(build.deployFullPath + "/" + "Qt6Multimedia.dll");
+            savedBytes += size;
+            removed++;
+            println("\tRemoved " + deployDir.relativeFilePath(path));
         }
     }
+    // Remove the directories left empty, deepest first
+    QStringList dirs;
+    QDirIterator dirIt(deployDir.absolutePath(), QDir::Dirs | QDir::NoDotAndDotDot, QDirIterator::Subdirectories);
+    while (dirIt.hasNext())
+        dirs << dirIt.next();
+    std::sort(dirs.begin(), dirs.end(), [](const QString& a, const QString& b) { return a.length() > b.length(); });
+    for (const QString& dir : dirs)
+        deployDir.rmdir(dir);
+    println(QString("\tKept %1 dlls, removed %2 dlls, %3 MiB saved").arg(closure.size() - executables.size()).arg(removed).arg(savedBytes / (1024. * 1024.), 0, 'f', 1));
 }
 
 void    generateInstaller(const ProjectDefinition& project, const WindowsBuild& build)
 {
+    TraceSpan trace("generateInstaller");
 
     if (stuff.innosetupPath.isEmpty())
     {
@@ -426,6 +555,22 @@ void    generateInstaller(const ProjectDefinition& project, const WindowsBuild&
         return ;
     }
     println("Generating Inno Setup Installer");
+    QElapsedTimer timer;
+    timer.start();
+    QString issPath = writeInnoSetupLayout(project, build);
+    Runner runner;
+    runner.runWithOut(stuff.innosetupPath + "/ISCC.exe", QStringList() << "/O" + build.deployBasePath + "/windows_deploy/" << "/F" + build.releaseNameFull + "-setup" << issPath, build.deployFullPath);
+    releaseFiles[build.arch].innoSetup = build.deployBasePath + "/windows_deploy/" + build.releaseNameFull + "-setup.exe";
+    registerArtifact("windows-" + build.archString, "innosetup", releaseFiles[build.arch].innoSetup, timer.elapsed(),
+                     "sqpackager_win32_" + archToString[build.arch] + "_innosetup");
+}
+
+/*
+ * Write the Inno Setup script and its file list in the deploy directory
+ * ISCC can be run on this directory later, even on another host
+ */
+QString writeInnoSetupLayout(const ProjectDefinition& project, const WindowsBuild& build)
+{
     QMap<QString, QString>   map;
 
     map["APP_NAME"] = project.name;
@@ -438,6 +583,11 @@ void    generateInstaller(const ProjectDefinition& project, const WindowsBuild&
     } else {
         map["ARCH_SPECIFIC"] = "";
     }
+    if (gOptions.reproducible)
+    {
+        map["TOUCH_DATE"] = buildDateTime().toString("yyyy-MM-dd");
+        map["TOUCH_TIME"] = buildDateTime().toString("HH:mm");
+    }
     QDir deployDir(build.deployFullPath);
     println(deployDir.absolutePath());
     QFile fileList(build.deployFullPath + "/listforinnosetupwindows.txt");
@@ -474,9 +624,7 @@ void    generateInstaller(const ProjectDefinition& project, const WindowsBuild&
     }
     innoFile.write(innoFileStr.toLocal8Bit());
     innoFile.close();
-    Runner runner;
-    runner.runWithOut(stuff.innosetupPath + "/ISCC.exe", QStringList() << "/O" + build.deployBasePath + "/windows_deploy/" << "/F" + build.releaseNameFull + "-setup" << issPath, build.deployFullPath);
-    releaseFiles[build.arch].innoSetup = build.deployBasePath + "/windows_deploy/" + build.releaseNameFull + "-setup.exe";
+    return issPath;
 }
 
 /*
@@ -486,6 +634,7 @@ void    generateInstaller(const ProjectDefinition& project, const WindowsBuild&
 
 void    deployExtras(ProjectDefinition& project, const WindowsBuild& build)
 {
+    TraceSpan trace("deployExtras");
     println("Checking and deploying extra files (Readme, License)");
     QDir projectDir(project.basePath);
     QDir deployDir(build.deployFullPath);
@@ -507,11 +656,15 @@ void    deployExtras(ProjectDefinition& project, const WindowsBuild& build)
             QFileInfo sourceFi(project.projectBasePath + "/" + file.source);
             if (sourceFi.isDir() == true)
             {
+#ifdef Q_OS_WIN
                 Runner run(true);
                 //Power shell Copy-Item -Path C:\MyFolder -Destination \\Server\MyFolder -recurse -Force
                 //robocopy C:\example D:\example /E
                 run.runWithOut("robocopy", QStringList() << sourceFi.absoluteFilePath() << build.deployFullPath + "\\" + file.destination << "/E");
                 ok = run.exitCode() == 1;
+#else
+                ok = copyRecursively(sourceFi.absoluteFilePath(), fullDest);
+#endif
             } else {
                 ok = QFile::copy(projectDir.absolutePath() + "/" + file.source, fullDest);
             }
@@ -523,7 +676,12 @@ void    deployExtras(ProjectDefinition& project, const WindowsBuild& build)
         if (file.type == Remote)
         {
             Runner run(true);
-            run.runWithOut("curl.exe", QStringList() << "-LJ" << "-o" << fullDest << "--url" << file.source);
+#ifdef Q_OS_WIN
+            const QString curl = "curl.exe";
+#else
+            const QString curl = "curl";
+#endif
+            run.runWithOut(curl, QStringList() << "-LJ" << "-o" << fullDest << "--url" << file.source);
             if (QFileInfo::exists(fullDest) == false)
             {
                 error_and_exit("Error getting the remote file " + file.name + "from " + file.source);
@@ -534,12 +692,22 @@ void    deployExtras(ProjectDefinition& project, const WindowsBuild& build)
 
 void    buildLocalization(Runner& runner, const ProjectDefinition& project, WindowsBuild& buildInfo)
 {
+    TraceSpan trace("buildLocalization");
     QDir deployDir(buildInfo.deployFullPath);
     println("Building Localization files");
     deployDir.mkdir("i18n");
-    runner.run("lrelease", QStringList() << project.proFile);
-    println("Deploying Localization files");
     QDir translationDir(project.basePath + "/" + project.translationDir);
+    // Without a .pro file lrelease is given the translation sources
+    if (project.buildSystem == BuildSystem::CMake)
+    {
+        QStringList tsFiles;
+        for (const QFileInfo& file : translationDir.entryInfoList(QStringList() << "*.ts", QDir::Files))
+            tsFiles << file.absoluteFilePath();
+        runner.run("lrelease", tsFiles);
+    } else {
+        runner.run("lrelease", QStringList() << project.proFile);
+    }
+    println("Deploying Localization files");
     for (auto file : translationDir.entryInfoList())
     {
         if (file.suffix() == "qm")
@@ -550,14 +718,8 @@ void    buildLocalization(Runner& runner, const ProjectDefinition& project, Wind
     }
 }
 
-void    buildProject(Runner& runner, const ProjectDefinition& project, WindowsBuild buildInfo)
+static void prepareBuildDirectories(const WindowsBuild& buildInfo)
 {
-    runner.addPath(buildInfo.qt.path + "/bin");
-    checkJom();
-    setMSVCEnv(runner, buildInfo.msvc, buildInfo.arch);
-    runner.run("cl.exe");
-    println(runner.getStderr());
-
     QDir projDir(buildInfo.buildBasePath);
     QDir buildDir(buildInfo.buildFullPath);
     println("Preparing build and deploy directory");
@@ -589,6 +751,71 @@ void    buildProject(Runner& runner, const ProjectDefinition& project, WindowsBu
     {
         error_and_exit("Failed to prepare deploy path");
     }
+}
+
+static QStringList sqprojectDefines(const WindowsBuild& buildInfo)
+{
+    if (buildInfo.standalone)
+        return QStringList() << "SQPROJECT_WIN32_STANDALONE" << CompileDefines::standalone;
+    return QStringList() << CompileDefines::windows_install << CompileDefines::installed;
+}
+
+static QStringList sqprojectQMakeDefines(const WindowsBuild& buildInfo)
+{
+    QStringList sqprojectOptions;
+    for (const QString& define : sqprojectDefines(buildInfo))
+        sqprojectOptions << "DEFINES+=" + define + " 1";
+    return sqprojectOptions;
+}
+
+// cl and link write a hash of the content instead of the time in the objects and the PE header
+static QStringList reproducibleQMakeFlags(bool msvc)
+{
+    if (!gOptions.reproducible)
+        return QStringList();
+    if (msvc)
+        return QStringList() << "QMAKE_CFLAGS+=/Brepro" << "QMAKE_CXXFLAGS+=/Brepro" << "QMAKE_LFLAGS+=/Brepro";
+    return QStringList() << "QMAKE_LFLAGS+=-Wl,--no-insert-timestamp";
+}
+
+static QStringList reproducibleCMakeFlags(bool msvc)
+{
+    if (!gOptions.reproducible)
+        return QStringList();
+    if (msvc)
+        return QStringList() << "-DCMAKE_C_FLAGS_INIT=/Brepro" << "-DCMAKE_CXX_FLAGS_INIT=/Brepro" << "-DCMAKE_EXE_LINKER_FLAGS_INIT=/Brepro";
+    return QStringList() << "-DCMAKE_EXE_LINKER_FLAGS_INIT=-Wl,--no-insert-timestamp";
+}
+
+// The other variant of the arch was compiled, start from its build directory
+static void copyVariantBuild(const WindowsBuild& from, const WindowsBuild& buildInfo)
+{
+    println("Reusing the " + from.buildPath + " build for " + buildInfo.buildPath);
+    if (!copyBuildDirectory(from.buildFullPath, buildInfo.buildFullPath))
+        error_and_exit("Could not copy the " + from.buildFullPath + " build directory");
+}
+
+// Once qmake wrote the Makefiles with this variant defines, make must only rebuild what use the defines
+static void removeVariantTargets(const ProjectDefinition& project, const WindowsBuild& from, const WindowsBuild& buildInfo)
+{
+    static QMap<QString, QStringList> defineUsers;
+    if (!defineUsers.contains(project.projectBasePath))
+        defineUsers[project.projectBasePath] = filesUsingDefines(project.projectBasePath, sqprojectDefines(from) + sqprojectDefines(buildInfo));
+    const QStringList files = defineUsers.value(project.projectBasePath);
+    const int removed = removeStaleMakeTargets(buildInfo.buildFullPath, files);
+    println(QString("%1 file(s) use the SQPROJECT defines, %2 build file(s) depending on them removed").arg(files.size()).arg(removed));
+}
+
+void    buildProject(Runner& runner, const ProjectDefinition& project, const WindowsBuild& buildInfo, const WindowsBuild* reuseFrom)
+{
+    TraceSpan trace("buildProject");
+    runner.addPath(buildInfo.qt.path + "/bin");
+    checkJom();
+    setMSVCEnv(runner, buildInfo.msvc, buildInfo.arch);
+    runner.run("cl.exe");
+    println(runner.getStderr());
+
+    prepareBuildDirectories(buildInfo);
     QString deployPath = buildInfo.deployFullPath;
     stuff.deployPath = deployPath;
     QString buildPath = buildInfo.buildFullPath;
@@ -596,47 +823,58 @@ void    buildProject(Runner& runner, const ProjectDefinition& project, WindowsBu
     //set QMAKE_MSC_VER=1910 I think this is needed for Qt 5.9 or 5.11-12?
 
     println("Building project in " + buildPath);
-    QStringList qmakeOptions;
-    qmakeOptions << project.proFile << "-spec" << "win32-msvc" << "CONFIG+=release no_batch";
-    if (project.qmlProject)
-    {
-        qmakeOptions << "CONFIG+=qtquickcompiler";
-    }
-    QStringList sqprojectOptions;
-    if (buildInfo.standalone)
+    if (project.buildSystem == BuildSystem::CMake)
     {
-        sqprojectOptions << "DEFINES+=SQPROJECT_WIN32_STANDALONE 1";
-        sqprojectOptions << "DEFINES+=" + CompileDefines::standalone + " 1";
+        // The Qt online installer puts CMake and Ninja in its Tools directory, Visual Studio ones are in its environment
+        for (const QString& toolDir : {"C:/Qt/Tools/Ninja", "C:/Qt/Tools/CMake_64/bin"})
+        {
+            if (QFileInfo::exists(toolDir))
+                runner.addPath(toolDir);
+        }
+        cmakeBuild(runner, project, "cmake", buildPath, sqprojectDefines(buildInfo), buildInfo.qt.path, reproducibleCMakeFlags(true));
+        println("Deploying files in " + deployPath);
+        runner.runWithOut("cmake", QStringList() << "--install" << buildPath << "--prefix" << deployPath, buildPath);
     } else {
-        sqprojectOptions << "DEFINES+=" + CompileDefines::windows_install + " 1";
-        sqprojectOptions << "DEFINES+=" + CompileDefines::installed + " 1";
-    }
-    if (!sqprojectOptions.isEmpty())
-        qmakeOptions.append(sqprojectOptions);
-    // QMake for arm64 is a .bat that call x64 exe
-    QString qmakeExe = "/bin/qmake.exe";
-    if (buildInfo.arch == ARM64)
-        qmakeExe = "/bin/qmake.bat";
-    ok = runner.run(buildInfo.qt.path + qmakeExe, buildPath, qmakeOptions);
-    if (!ok)
-    {
+        QStringList qmakeOptions;
+        qmakeOptions << project.proFile << "-spec" << "win32-msvc" << "CONFIG+=release no_batch";
+        if (project.qmlProject)
+        {
+            qmakeOptions << "CONFIG+=qtquickcompiler";
+        }
+        qmakeOptions.append(sqprojectQMakeDefines(buildInfo));
+        qmakeOptions.append(reproducibleQMakeFlags(true));
+        if (reuseFrom != nullptr)
+            copyVariantBuild(*reuseFrom, buildInfo);
+        // QMake for arm64 is a .bat that call x64 exe
+        QString qmakeExe = "/bin/qmake.exe";
+        if (buildInfo.arch == ARM64)
+            qmakeExe = "/bin/qmake.bat";
+        bool ok = runner.run(buildInfo.qt.path + qmakeExe, buildPath, qmakeOptions);
+        if (!ok)
+        {
+            println(runner.getStdout());
+            println(runner.getStderr());
+            error_and_exit("QMake failed to run");
+        }
         println(runner.getStdout());
-        println(runner.getStderr());
-        error_and_exit("QMake failed to run");
-    }
-    println(runner.getStdout());
-    // Jom allow to use all cpu core/thread count
-    QString nmake = stuff.findJom ? stuff.jomExe : "nmake";
-    ok = runner.runWithOut(nmake, QStringList(), buildPath);
-    if (!ok)
-    {
-        error_and_exit("NMake run failed");
+        if (reuseFrom != nullptr)
+            removeVariantTargets(project, *reuseFrom, buildInfo);
+        // Jom allow to use all cpu core/thread count
+        QString nmake = stuff.findJom ? stuff.jomExe : "nmake";
+        QStringList nmakeArgs;
+        if (stuff.findJom)
+            nmakeArgs << "/J" << QString::number(gOptions.jobs);
+        ok = runner.runWithOut(nmake, nmakeArgs, buildPath);
+        if (!ok)
+        {
+            error_and_exit("NMake run failed");
+        }
+        println("Deploying files in " + deployPath);
+        QProcessEnvironment env = runner.env();
+        env.insert("INSTALL_ROOT", deployPath);
+        runner.setEnv(env);
+        runner.runWithOut("nmake", QStringList() << "install", buildPath);
     }
-    println("Deploying files in " + deployPath);
-    QProcessEnvironment env = runner.env();
-    env.insert("INSTALL_ROOT", deployPath);
-    runner.setEnv(env);
-    runner.runWithOut("nmake", QStringList() << "install", buildPath);
 
     /*
      * It's very likely that the .pro file does not set stuff for the target
@@ -646,7 +884,8 @@ void    buildProject(Runner& runner, const ProjectDefinition& project, WindowsBu
     {
         println("Deploy Path is empty. no install set in the project file. Copying executable manually");
         QDir deployDir(deployPath);
-        QDir buildDir(buildPath + "/release/");
+        // CMake builds put the executables at the root of the build directory
+        QDir buildDir(project.buildSystem == BuildSystem::CMake ? buildPath : buildPath + "/release/");
         deployDir.mkpath(deployPath);
         for (const QFileInfo& fi : buildDir.entryInfoList())
         {
@@ -914,30 +1153,6 @@ void    checkMSVCVersion()
     }
 }
 
-void    find7zip()
-{
-    QProcessEnvironment env = QProcessEnvironment::systemEnvironment();
-    QString path = env.value("PATH");
-    print("Trying to find Optionnal 7zip binaries");
-    for (const QString& p : path.split(":"))
-    {
-        if (p.contains("7-Zip"))
-        {
-            stuff.sevenZipPath = p;
-            break;
-        }
-    }
-    if (stuff.sevenZipPath.isEmpty())
-    {
-        if (QFileInfo::exists("C:/Program Files/7-Zip"))
-            stuff.sevenZipPath = "C:/Program Files/7-Zip";
-    }
-    if (stuff.sevenZipPath.isEmpty())
-        printlnYes("", false);
-    else
-        printlnYes("", true);
-}
-
 void    findInnoSetup()
 {
     QProcessEnvironment env = QProcessEnvironment::systemEnvironment();
@@ -966,7 +1181,32 @@ void    findInnoSetup()
 // 2019 14.2
 // 2022 14.3
 
-void setMSVCEnv(Runner& runner, MSVCVersion& vers, WindowsArch arch)
+/*
+ * startvcvargs.bat calls the script then dumps the environment with set, the lines after
+ * the echoed set command are parsed as they come instead of once the whole dump is captured
+ */
+static bool runEnvironmentScript(Runner& runner, const QString& startScript, const QStringList& args, QProcessEnvironment& env)
+{
+    bool inSet = false;
+    runner.setLineHandler([&inSet, &env](QProcess::ProcessChannel channel, const QByteArray& line) {
+        if (channel != QProcess::StandardOutput)
+            return ;
+        if (!inSet)
+        {
+            inSet = line.contains("&& SET");
+            return ;
+        }
+        // Values can contain = too, only the first one ends the name
+        const int equal = line.indexOf('=');
+        if (equal > 0)
+            env.insert(QString::fromLocal8Bit(line.left(equal)), QString::fromLocal8Bit(line.mid(equal + 1)));
+    });
+    bool ok = runner.run(startScript, args);
+    runner.setLineHandler(nullptr);
+    return ok;
+}
+
+void setMSVCEnv(Runner& runner, const MSVCVersion& vers, WindowsArch arch)
 {
     println("----\n"
             "Setting up MSVC environnement");
@@ -984,28 +1224,10 @@ void setMSVCEnv(Runner& runner, MSVCVersion& vers, WindowsArch arch)
     }
     QString startvcarg = tempDir.filePath("startvcargs.bat");
     QFile::copy(":/Windows/startvcvargs.bat", startvcarg);
-    bool ok = runner.run(startvcarg,
-                         QStringList() << vers.vsPath + "Common7/Tools/VsDevCmd.bat" << "/clean_env");
-    QTextStream out(runner.getStdout());
-    while (!out.atEnd())
-    {
-        QString plop = out.readLine();
-        //println(plop);
-        if (plop.contains("&& SET"))
-            break;
-    }
     QProcessEnvironment env = runner.env();
     env.clear();
-    while (!out.atEnd())
-    {
-        QString line = out.readLine();
-        //println(line);
-        if (line.contains("="))
-        {
-            QStringList plop = line.split('=');
-            env.insert(plop.at(0), plop.mid(1).join(":"));
-        }
-    }
+    bool ok = runEnvironmentScript(runner, startvcarg,
+                                   QStringList() << vers.vsPath + "Common7/Tools/VsDevCmd.bat" << "/clean_env", env);
     //print(env.toStringList().join("\n"));
     runner.setEnv(env);
     //printlnOk("Path are the same", firstPath == env.value("PATH"));
@@ -1033,35 +1255,276 @@ void setMSVCEnv(Runner& runner, MSVCVersion& vers, WindowsArch arch)
         if (msV == vers.visualStudioVersion)
             toolVersion = dirName;
     }
-    ok = runner.run(startvcarg, QStringList() << vers.vsPath + "/VC/Auxiliary/Build/vcvarsall.bat "
-                    << "-vcvars_ver=" + toolVersion << vsArchName.value(arch));
+    env = runner.env();
+    ok = runEnvironmentScript(runner, startvcarg, QStringList() << vers.vsPath + "/VC/Auxiliary/Build/vcvarsall.bat "
+                              << "-vcvars_ver=" + toolVersion << vsArchName.value(arch), env);
     if (!ok)
     {
         error_and_exit("Could not run the MSCV env script");
     }
-    QTextStream out2(runner.getStdout());
-    //QTextStream out(runner.getStdout());
-    //println(runner.getStderr());
-    while (!out2.atEnd())
+    //println(env.value("PATH"));
+    //exit(1);
+    runner.setEnv(env);
+}
+
+/*
+ * Cross building from Linux with a mingw-w64 toolchain and a Qt built for it
+ * windeployqt can't run there, the Qt and toolchain dlls are picked from the PE import closure
+ */
+
+static const QMap<QString, WindowsArch> mingwCpuArch =
+{
+    {"x86_64", X64},
+    {"i686", X86},
+    {"aarch64", ARM64}
+};
+
+static QString findCrossQMake(const ProjectDefinition& project, const QString& triplet)
+{
+    if (gOptions.windowsCrossQt.isEmpty() == false)
     {
-        QString plop = out2.readLine();
-        //println(plop);
-        if (plop.contains("&& SET"))
-            break;
+        for (const QString& name : {"qmake6", "qmake"})
+        {
+            const QString qmake = gOptions.windowsCrossQt + "/bin/" + name;
+            if (QFileInfo::exists(qmake))
+                return qmake;
+        }
+        error_and_exit("Could not find qmake in " + gOptions.windowsCrossQt + "/bin");
     }
-    env = runner.env();
-    //print(env.toStringList().join("\n"));
-    while (!out2.atEnd())
+    // Distributions package a prefixed qmake, like Fedora mingw64-qt6-qtbase
+    QString qmake = QStandardPaths::findExecutable(triplet + (project.qtMajorVersion == QtMajorVersion::Qt5 ? "-qmake-qt5" : "-qmake-qt6"));
+    if (qmake.isEmpty())
+        error_and_exit("Could not find a Qt built for " + triplet + ", use --windows-cross-qt <path> to give its location");
+    return qmake;
+}
+
+/*
+ * The dlls a mingw executable need are in the Qt bin dir, the mingw sysroot or next to the gcc runtime
+ */
+static QMap<QString, QString> mingwDllIndex(const QString& triplet, const QMap<QString, QString>& qtPaths)
+{
+    QStringList dirs;
+    dirs << qtPaths.value("QT_INSTALL_BINS") << qtPaths.value("QT_INSTALL_LIBS");
+    dirs << "/usr/" + triplet + "/bin" << "/usr/" + triplet + "/lib" << "/usr/" + triplet + "/sys-root/mingw/bin";
+    for (const QString& runtimeDll : {"libstdc++-6.dll", "libgcc_s_seh-1.dll", "libgcc_s_dw2-1.dll", "libwinpthread-1.dll"})
     {
-        QString line = out2.readLine();
-        //println(line);
-        if (line.contains("="))
+        Runner run;
+        run.setOutputLimit(0);
+        // gcc print the name unchanged when it does not know the file
+        if (run.run(triplet + "-gcc", QStringList() << "-print-file-name=" + runtimeDll))
         {
-            QStringList plop = line.split('=');
-            env.insert(plop.at(0), plop.mid(1).join(":"));
+            QFileInfo fi(QString::fromLocal8Bit(run.getStdout()).trimmed());
+            if (fi.isAbsolute() && fi.exists())
+                dirs << fi.absolutePath();
         }
     }
-    //println(env.value("PATH"));
-    //exit(1);
-    runner.setEnv(env);
+    // The first directory providing a dll wins, Windows loader is case insensitive
+    QMap<QString, QString> toret;
+    for (const QString& dir : dirs)
+    {
+        for (const QFileInfo& fi : QDir(dir).entryInfoList(QStringList() << "*.dll", QDir::Files))
+        {
+            if (!toret.contains(fi.fileName().toLower()))
+                toret[fi.fileName().toLower()] = fi.absoluteFilePath();
+        }
+    }
+    return toret;
+}
+
+// Qt 6 installs a qt-cmake wrapper setting its toolchain file, distributions package a prefixed cmake like mingw64-cmake
+static QString findCrossCMake(const QString& triplet, const QMap<QString, QString>& qtPaths)
+{
+    for (const QString& dir : {qtPaths.value("QT_INSTALL_BINS"), qtPaths.value("QT_HOST_BINS")})
+    {
+        if (dir.isEmpty() == false && QFileInfo::exists(dir + "/qt-cmake"))
+            return dir + "/qt-cmake";
+    }
+    const QString cmake = QStandardPaths::findExecutable(triplet + "-cmake");
+    if (cmake.isEmpty())
+        error_and_exit("Could not find qt-cmake or " + triplet + "-cmake to configure the CMake project");
+    return cmake;
+}
+
+static void buildCrossProject(Runner& runner, const ProjectDefinition& project, WindowsBuild& buildInfo, const QString& qmake, const QString& cmake,
+                              const WindowsBuild* reuseFrom)
+{
+    TraceSpan trace("buildCrossProject");
+    prepareBuildDirectories(buildInfo);
+    const QString buildPath = buildInfo.buildFullPath;
+    const QString deployPath = buildInfo.deployFullPath;
+    println("Building project in " + buildPath);
+    if (project.buildSystem == BuildSystem::CMake)
+    {
+        cmakeBuild(runner, project, cmake, buildPath, sqprojectDefines(buildInfo), buildInfo.qt.path, reproducibleCMakeFlags(false));
+        println("Deploying files in " + deployPath);
+        runner.runWithOut("cmake", QStringList() << "--install" << buildPath << "--prefix" << deployPath, buildPath);
+    } else {
+        QStringList qmakeOptions;
+        qmakeOptions << project.proFile << "CONFIG+=release";
+        if (project.qmlProject)
+            qmakeOptions << "CONFIG+=qtquickcompiler";
+        qmakeOptions << sqprojectQMakeDefines(buildInfo) << reproducibleQMakeFlags(false);
+        if (reuseFrom != nullptr)
+            copyVariantBuild(*reuseFrom, buildInfo);
+        if (!runner.run(qmake, buildPath, qmakeOptions))
+        {
+            println(runner.getStdout());
+            println(runner.getStderr());
+            error_and_exit("QMake failed to run");
+        }
+        if (reuseFrom != nullptr)
+            removeVariantTargets(project, *reuseFrom, buildInfo);
+        if (!runner.runWithOut("make", QStringList() << "-j" + QString::number(gOptions.jobs), buildPath))
+            error_and_exit("Make run failed");
+        println("Deploying files in " + deployPath);
+        runner.runWithOut("make", QStringList() << "install" << "INSTALL_ROOT=" + deployPath, buildPath);
+    }
+    if (!QFileInfo::exists(deployPath))
+    {
+        println("Deploy Path is empty. no install set in the project file. Copying executable manually");
+        QDir().mkpath(deployPath);
+        for (const QString& dir : {buildPath + "/release", buildPath})
+        {
+            for (const QFileInfo& fi : QDir(dir).entryInfoList(QStringList() << "*.exe", QDir::Files))
+            {
+                println("Found <" + fi.fileName() + "> to copy in the deploy directory");
+                QFile::copy(fi.absoluteFilePath(), deployPath + "/" + fi.fileName());
+            }
+        }
+    }
+    for (const QFileInfo& fi : QDir(deployPath).entryInfoList(QStringList() << "*.exe", QDir::Files))
+        buildInfo.executables << fi.fileName();
+    if (buildInfo.executables.isEmpty())
+        error_and_exit("No executable found in " + deployPath);
+}
+
+static void deployCrossQt(const ProjectDefinition& project, const WindowsBuild& build, const QMap<QString, QString>& qtPaths, const QMap<QString, QString>& dllIndex)
+{
+    TraceSpan trace("deployCrossQt");
+    println("Deploying Qt from the import closure");
+    const QString deployPath = build.deployFullPath;
+    const QString qtPlugins = qtPaths.value("QT_INSTALL_PLUGINS");
+    for (const QString& pluginDir : keptPluginDirs(project))
+    {
+        const QStringList dlls = QDir(qtPlugins + "/" + pluginDir).entryList(QStringList() << "*.dll", QDir::Files);
+        for (const QString& dll : dlls)
+        {
+            // Skip debug builds of the plugins and the platforms that are not for a desktop application
+            if (dll.endsWith("d.dll") && dlls.contains(dll.chopped(5) + ".dll"))
+                continue;
+            if (pluginDir == "platforms" && dll != "qwindows.dll")
+                continue;
+            QDir().mkpath(deployPath + "/" + pluginDir);
+            QFile::copy(qtPlugins + "/" + pluginDir + "/" + dll, deployPath + "/" + pluginDir + "/" + dll);
+        }
+    }
+    if (project.qmlProject)
+    {
+        // Qt 6 look for QML modules in <appdir>/qml, Qt 5 in the application directory
+        const QString qmlDest = deployPath + (build.qt.version.majorVersion() >= 6 ? "/qml/" : "/");
+        for (const QString& importPath : qmlImportPaths(project, qtPaths))
+            copyRecursively(importPath, qmlDest + QDir(qtPaths.value("QT_INSTALL_QML")).relativeFilePath(importPath));
+    }
+
+    QStringList queue;
+    for (const QString& exe : build.executables)
+        queue << deployPath + "/" + exe;
+    QDirIterator it(deployPath, QStringList() << "*.dll", QDir::Files, QDirIterator::Subdirectories);
+    while (it.hasNext())
+        queue << it.next();
+    QSet<QString> visited;
+    QSet<QString> systemDlls;
+    while (!queue.isEmpty())
+    {
+        const QString path = queue.takeFirst();
+        if (visited.contains(path))
+            continue;
+        visited.insert(path);
+        PeInfo pe = readPeImports(path);
+        if (!pe.valid)
+            error_and_exit("Could not read the imports of " + path);
+        for (const QString& dll : pe.imports + pe.delayImports)
+        {
+            const QString source = dllIndex.value(dll.toLower());
+            if (source.isEmpty())
+            {
+                // Not provided by the toolchain or Qt, expected from Windows
+                systemDlls.insert(dll.toLower());
+                continue;
+            }
+            const QString dest = deployPath + "/" + QFileInfo(source).fileName();
+            if (QFileInfo::exists(dest))
+                continue;
+            QFile::copy(source, dest);
+            queue << dest;
+        }
+    }
+    QStringList systemList = systemDlls.values();
+    systemList.sort();
+    println(QString("\t%1 files deployed, expected from the system : %2").arg(visited.size()).arg(systemList.join(" ")));
+}
+
+void    buildWindowsCross(ProjectDefinition& project)
+{
+    TraceSpan trace("buildWindowsCross");
+    printSummary("===== Cross building for Windows =====");
+    stuff.deployBasePath = gOptions.windowsDeployPath;
+    stuff.buildBasePath = gOptions.windowsBuildPath;
+    const QString triplet = gOptions.windowsCrossToolchain.isEmpty() ? "x86_64-w64-mingw32" : gOptions.windowsCrossToolchain;
+    const QString cpu = triplet.section('-', 0, 0);
+    if (!mingwCpuArch.contains(cpu))
+        error_and_exit("Unsupported cross toolchain " + triplet + ", the cpu must be x86_64, i686 or aarch64");
+    if (QStandardPaths::findExecutable(triplet + "-g++").isEmpty())
+        error_and_exit("Could not find the " + triplet + "-g++ cross compiler");
+    const WindowsArch arch = mingwCpuArch.value(cpu);
+    const QString qmake = findCrossQMake(project, triplet);
+    const QMap<QString, QString> qtPaths = queryQMake(qmake);
+    println("Using " + qmake + " - Qt " + qtPaths.value("QT_VERSION") + " located at " + qtPaths.value("QT_INSTALL_PREFIX"));
+    const QMap<QString, QString> dllIndex = mingwDllIndex(triplet, qtPaths);
+    const QString cmake = project.buildSystem == BuildSystem::CMake ? findCrossCMake(triplet, qtPaths) : QString();
+
+    QList<WindowsBuild> builds;
+    WindowsBuild crossBuild(project, arch, false);
+    crossBuild.qt.version = QVersionNumber::fromString(qtPaths.value("QT_VERSION"));
+    crossBuild.qt.path = qtPaths.value("QT_INSTALL_PREFIX");
+    crossBuild.qt.arch = arch;
+    builds << crossBuild;
+    crossBuild.setStandalone(true);
+    builds << std::move(crossBuild);
+    const QList<VariantBuild> plan = planVariantBuilds(variantsOf(builds), project.buildSystem == BuildSystem::QMake);
+    QSet<int> compiled;
+    for (int i = 0; i < builds.size(); i++)
+    {
+        WindowsBuild& build = builds[i];
+        LogJob job("windows-cross-" + build.archString + (build.standalone ? "-standalone" : "-installer"));
+        printSummary("Cross building for " + build.archString + (build.standalone ? " Standalone" : " Install"));
+        // Only the standalone build registers files, the installer layout is always generated
+        const QByteArray cacheKey = artifactCacheKey(project, "windows-cross", build.toString() + " " + triplet + " "
+                                                     + toolIdentity(triplet + "-g++", QStringList() << "-dumpfullversion"));
+        if (restoreReleaseFiles(project, build, cacheKey))
+            continue;
+        const int firstArtifact = registeredArtifactCount();
+        Runner runnerBuild(true);
+        runnerBuild.setEnv(QProcessEnvironment::systemEnvironment());
+        // lrelease and the other host tools
+        if (qtPaths.value("QT_HOST_BINS").isEmpty() == false)
+            runnerBuild.addPath(qtPaths.value("QT_HOST_BINS"));
+        const int reuseFrom = compiled.contains(plan[i].reuseFrom) ? plan[i].reuseFrom : -1;
+        buildCrossProject(runnerBuild, project, build, qmake, cmake, reuseFrom >= 0 ? &builds[reuseFrom] : nullptr);
+        compiled.insert(i);
+        deployExtras(project, build);
+        deployCrossQt(project, build, qtPaths, dllIndex);
+        if (project.translationDir.isEmpty() == false)
+            buildLocalization(runnerBuild, project, build);
+        if (build.standalone == false)
+        {
+            println("Generating Inno Setup layout, run ISCC on it from Windows to get the installer");
+            writeInnoSetupLayout(project, build);
+            releaseFiles[build.arch].innoSetupLayout = build.deployFullPath;
+        } else {
+            createRelease(project, build);
+        }
+        storeCachedArtifacts(project, cacheKey, firstArtifact);
+    }
+    reportReleaseFiles();
 }
@@ -0,0 +1,153 @@
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSysInfo>
+#include <QStandardPaths>
+#include <QProcessEnvironment>
+#include <QElapsedTimer>
+#include <projectdefinition.h>
+#include <sqpackager.h>
+#include <basestuff.h>
+#include <compile_defines.h>
+#include <print.h>
+#include <runner.h>
+#include <trace.h>
+#include <artifacts.h>
+#include <linuxdeploy.h>
+#include <reproducible.h>
+#include <squashfsimage.h>
+
+extern PackagerOptions gOptions;
+
+static QString appImageArch()
+{
+    const QString arch = QSysInfo::currentCpuArchitecture();
+    if (arch == "arm64")
+        return "aarch64";
+    if (arch == "i386")
+        return "i686";
+    return "x86_64";
+}
+
+/*
+ * The runtime is the small ELF executable put in front of the squashfs image
+ * that mount it and start AppRun
+ */
+static QString findAppImageRuntime()
+{
+    if (!gOptions.appImageRuntime.isEmpty())
+        return gOptions.appImageRuntime;
+    QString envRuntime = QProcessEnvironment::systemEnvironment().value("APPIMAGE_RUNTIME");
+    if (!envRuntime.isEmpty())
+        return envRuntime;
+    QString cached = QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation) + "/sqpackager/runtime-" + appImageArch();
+    if (QFileInfo::exists(cached))
+        return cached;
+    return QString();
+}
+
+bool    checkAppImage(const ProjectDefinition& project)
+{
+    println("Checking if the project can be build to an AppImage");
+    bool toret = true;
+    if (findAppImageRuntime().isEmpty())
+    {
+        println("Can't find an AppImage runtime, use --appimage-runtime or put the type2 runtime in "
+                + QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation) + "/sqpackager/runtime-" + appImageArch());
+        toret = false;
+    }
+    if (project.desktopFile.isEmpty())
+    {
+        println("An AppImage need a .desktop file");
+        toret = false;
+    }
+    return toret;
+}
+
+// The Icon key of the .desktop file must match the icon file at the root of the AppDir
+static QString desktopIconName(const QString& desktopFilePath)
+{
+    QFile desktopFile(desktopFilePath);
+    if (!desktopFile.open(QIODevice::ReadOnly | QIODevice::Text))
+        error_and_exit("Can't open the .desktop file " + desktopFilePath + " : " + desktopFile.errorString());
+    while (!desktopFile.atEnd())
+    {
+        QString line = desktopFile.readLine().trimmed();
+        if (line.startsWith("Icon="))
+            return line.mid(5);
+    }
+    return QString();
+}
+
+/*
+ * The AppDir is populated by the generated unix installer, like for the debian package,
+ * then Qt is deployed in usr/ like for the standalone release. The AppDir is packed into
+ * a squashfs image written in-process right after the AppImage runtime
+ */
+void    buildAppImage(const ProjectDefinition& project)
+{
+    TraceSpan trace("buildAppImage");
+    printSummary("===== Building AppImage =====");
+    QElapsedTimer timer;
+    timer.start();
+    Runner run(true);
+    const QString buildDir = project.basePath + "/appimage_build";
+    const QString appDir = buildDir + "/" + project.unixNormalizedName + ".AppDir";
+    QDir(appDir).removeRecursively();
+    if (!QDir().mkpath(appDir))
+        error_and_exit("Could not create the AppDir " + appDir);
+
+    println("Populating the AppDir with the unix installer");
+    const QString qmake = findQMake(project);
+    bool ok = run.runWithOut("sh", QStringList() << "./sqpackager_unix_installer.sh" << "--build" << "--install"
+                             << "--qmake-cmd" << qmake << "--jobs" << QString::number(gOptions.jobs) << "--compile-prefix" << "/usr"
+                             << "--prefix" << appDir + "/usr" << "DEFINES+=" + CompileDefines::appimage_install, project.basePath);
+    if (!ok)
+        error_and_exit("Building and installing the project into the AppDir failed");
+
+    const QString binary = appDir + "/usr/bin/" + project.targetName;
+    if (!QFileInfo::exists(binary))
+        error_and_exit("The unix installer did not install " + project.targetName + " in " + appDir + "/usr/bin");
+    // AppRun puts usr/lib in LD_LIBRARY_PATH, a RUNPATH that could not be set is not a problem here
+    deployLinuxQt(project, queryQMake(qmake), binary, appDir + "/usr");
+
+    const QString desktopFile = project.basePath + "/" + project.desktopFile;
+    if (!QFile::copy(desktopFile, appDir + "/" + project.desktopFileNormalizedName))
+        error_and_exit("Could not copy the .desktop file " + desktopFile + " in the AppDir");
+    QString iconName = desktopIconName(desktopFile);
+    if (iconName.isEmpty())
+        error_and_exit("The .desktop file does not have an Icon entry");
+    QFileInfo iconFi(project.basePath + "/" + project.desktopIcon);
+    const QString iconFileName = iconName + "." + iconFi.suffix();
+    if (!QFile::copy(iconFi.absoluteFilePath(), appDir + "/" + iconFileName))
+        error_and_exit("Could not copy the icon " + iconFi.absoluteFilePath() + " in the AppDir");
+    QFile::link(iconFileName, appDir + "/.DirIcon");
+
+    QMap<QString, QString> mapping;
+    mapping["PROJECT_TARGET"] = project.targetName;
+    QFile appRun(appDir + "/AppRun");
+    if (!appRun.open(QIODevice::WriteOnly | QIODevice::Text))
+        error_and_exit("Could not create the AppRun file : " + appRun.errorString());
+    appRun.write(useTemplateFile(":/appimage/AppRun.tt", mapping).toLocal8Bit());
+    appRun.close();
+    appRun.setPermissions(appRun.permissions() | QFileDevice::ExeOwner | QFileDevice::ExeGroup | QFileDevice::ExeOther);
+
+    println("Creating the squashfs image");
+    const QString appImageFile = project.basePath + "/" + project.unixNormalizedName + "-" + project.version.simpleVersion + "-" + appImageArch() + ".AppImage";
+    QFile runtime(findAppImageRuntime());
+    QFile appImage(appImageFile);
+    if (!runtime.open(QIODevice::ReadOnly))
+        error_and_exit("Can't open the AppImage runtime " + runtime.fileName() + " : " + runtime.errorString());
+    if (!appImage.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        error_and_exit("Can't create " + appImage.fileName() + " : " + appImage.errorString());
+    const QByteArray runtimeData = runtime.readAll();
+    if (appImage.write(runtimeData) != runtimeData.size())
+        error_and_exit("Can't write " + appImage.fileName() + " : " + appImage.errorString());
+    QString error;
+    if (!writeSquashfsImage(appImage, appDir, &error, gOptions.reproducible ? buildDateTime() : QDateTime()))
+        error_and_exit("Could not create the AppImage squashfs image : " + error);
+    appImage.close();
+    appImage.setPermissions(appImage.permissions() | QFileDevice::ExeOwner | QFileDevice::ExeGroup | QFileDevice::ExeOther);
+    printSummary("AppImage created : " + appImageFile);
+    registerArtifact("appimage", "appimage", appImageFile, timer.elapsed(), "sqpackager_appimage");
+}
@@ -0,0 +1,173 @@
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMutex>
+#include <QtConcurrent>
+
+#include <artifacts.h>
+#include <projectdefinition.h>
+#include <basestuff.h>
+#include <github.h>
+#include <reproducible.h>
+#include <sqpackager.h>
+#include <print.h>
+#include <trace.h>
+
+extern PackagerOptions gOptions;
+
+struct ArtifactHashes
+{
+    QByteArray  sha256;
+    QByteArray  blake2b;
+    QString     error;
+};
+
+struct Artifact
+{
+    QString     target;
+    QString     kind;
+    QString     path;
+    qint64      size;
+    qint64      durationMs;
+    QString     githubOutput;
+    QFuture<ArtifactHashes> hashes;
+};
+
+static QMutex           artifactsMutex;
+static QList<Artifact>  artifacts;
+
+// Both hashes are fed from the same read so the file is only read once
+static ArtifactHashes  hashArtifact(const QString& path)
+{
+    TraceSpan trace("hash " + QFileInfo(path).fileName(), "hash");
+    ArtifactHashes toret;
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        toret.error = file.errorString();
+        return toret;
+    }
+    QCryptographicHash sha256(QCryptographicHash::Sha256);
+#if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
+    QCryptographicHash blake2b(QCryptographicHash::Blake2b_256);
+#endif
+    QByteArray buffer(4 * 1024 * 1024, Qt::Uninitialized);
+    qint64 read;
+    while ((read = file.read(buffer.data(), buffer.size())) > 0)
+    {
+        sha256.addData(buffer.constData(), read);
+#if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
+        blake2b.addData(buffer.constData(), read);
+#endif
+    }
+    if (read < 0)
+    {
+        toret.error = file.errorString();
+        return toret;
+    }
+    toret.sha256 = sha256.result().toHex();
+#if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
+    toret.blake2b = blake2b.result().toHex();
+#endif
+    return toret;
+}
+
+void    registerArtifact(const QString& target, const QString& kind, const QString& path, qint64 durationMs, const QString& githubOutput)
+{
+    QFileInfo fi(path);
+    if (!fi.isFile())
+    {
+        logMessage(LogLevel::Warning, QString("Warning : the %1 %2 file %3 was not produced\n").arg(target, kind, path));
+        return ;
+    }
+    Artifact artifact;
+    artifact.target = target;
+    artifact.kind = kind;
+    artifact.path = fi.absoluteFilePath();
+    artifact.size = fi.size();
+    artifact.durationMs = durationMs;
+    artifact.githubOutput = githubOutput;
+    artifact.hashes = QtConcurrent::run(hashArtifact, artifact.path);
+    QMutexLocker lock(&artifactsMutex);
+    artifacts.append(artifact);
+}
+
+int     registeredArtifactCount()
+{
+    QMutexLocker lock(&artifactsMutex);
+    return artifacts.size();
+}
+
+QList<RegisteredArtifact>   registeredArtifacts(int first)
+{
+    QMutexLocker lock(&artifactsMutex);
+    QList<RegisteredArtifact> toret;
+    for (int i = first; i < artifacts.size(); i++)
+    {
+        const Artifact& artifact = artifacts.at(i);
+        toret.append(RegisteredArtifact{artifact.target, artifact.kind, artifact.path, artifact.githubOutput,
+                                        artifact.size, artifact.hashes.result().sha256});
+    }
+    return toret;
+}
+
+QString artifactManifestPath(const ProjectDefinition& project)
+{
+    return project.basePath + "/sqpackager-artifacts.json";
+}
+
+void    writeArtifactManifest(const ProjectDefinition& project)
+{
+    TraceSpan trace("writeArtifactManifest");
+    QMutexLocker lock(&artifactsMutex);
+    if (artifacts.isEmpty())
+        return ;
+    QJsonArray  entries;
+    for (Artifact& artifact : artifacts)
+    {
+        const ArtifactHashes& hashes = artifact.hashes.result();
+        if (!hashes.error.isEmpty())
+            error_and_exit("Can't hash " + artifact.path + " : " + hashes.error);
+        QJsonObject entry;
+        entry["target"] = artifact.target;
+        entry["kind"] = artifact.kind;
+        entry["path"] = artifact.path;
+        entry["size"] = artifact.size;
+        entry["sha256"] = QString::fromLatin1(hashes.sha256);
+        if (hashes.blake2b.isEmpty() == false)
+            entry["blake2b-256"] = QString::fromLatin1(hashes.blake2b);
+        // The durations would make the manifest change on every run
+        if (!gOptions.reproducible)
+            entry["duration-ms"] = artifact.durationMs;
+        entries.append(entry);
+    }
+    QJsonObject manifest;
+    manifest["name"] = project.name;
+    manifest["version"] = project.version.simpleVersion;
+    manifest["date"] = buildDateTime().toUTC().toString(Qt::ISODate);
+    manifest["artifacts"] = entries;
+
+    QFile manifestFile(artifactManifestPath(project));
+    if (!manifestFile.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        error_and_exit("Can't open " + manifestFile.fileName() + " : " + manifestFile.errorString());
+    manifestFile.write(QJsonDocument(manifest).toJson());
+    manifestFile.close();
+    printSummary("Artifact manifest written : " + manifestFile.fileName());
+
+    if (isGithubAction())
+    {
+        addGithubOutput("sqpackager_artifacts", QDir::toNativeSeparators(manifestFile.fileName()));
+        for (const Artifact& artifact : artifacts)
+        {
+            if (artifact.githubOutput.isEmpty())
+                continue;
+            addGithubOutput(artifact.githubOutput, QDir::toNativeSeparators(artifact.path));
+            addGithubOutput(artifact.githubOutput + "_non_native_path", artifact.path);
+        }
+    }
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <QString>
+#include <QList>
+
+struct ProjectDefinition;
+
+struct RegisteredArtifact
+{
+    QString target;
+    QString kind;
+    QString path;
+    QString githubOutput;
+    qint64  size = 0;
+    // Hex, empty when the file could not be hashed
+    QByteArray  sha256;
+};
+
+/*
+ * Every file a target produces is registered here, its hashes are computed on the thread pool
+ * while the next steps run. The manifest and the GitHub outputs are written from this list.
+ */
+// githubOutput is the GITHUB_OUTPUT key, empty to not export the file
+void    registerArtifact(const QString& target, const QString& kind, const QString& path, qint64 durationMs,
+                         const QString& githubOutput = QString());
+int     registeredArtifactCount();
+// The artifacts registered from the index first, this waits for their hashes
+QList<RegisteredArtifact>   registeredArtifacts(int first = 0);
+QString artifactManifestPath(const ProjectDefinition& project);
+// Wait for the hashes and write <project base path>/sqpackager-artifacts.json
+void    writeArtifactManifest(const ProjectDefinition& project);
@@ -6,20 +6,49 @@
 #include <QTextStream>
 
 #include <QDateTime>
+#include <QThread>
+#include <QDirIterator>
+#include <QCryptographicHash>
+#include <QMutex>
+#include <QHash>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QStandardPaths>
 #include <basestuff.h>
 #include <runner.h>
 #include <print.h>
+#include <trace.h>
+#include <reproducible.h>
 
-static void    handleFiles(ProjectDefinition& def, QJsonObject& obj);
+#ifdef Q_OS_WIN
+#include <windows.h>
+#endif
+
+static thread_local int recoverableErrors = 0;
+
+RecoverableErrors::RecoverableErrors()
+{
+    recoverableErrors++;
+}
+
+RecoverableErrors::~RecoverableErrors()
+{
+    recoverableErrors--;
+}
 
 void    error_and_exit(QString error)
 {
-   fprintf(stderr, "%s\n", error.toLocal8Bit().constData());
+   if (recoverableErrors > 0)
+       throw ProjectError{error};
+   // Going through the logger keep the error after the queued messages and put it in the log files
+   logMessage(LogLevel::Error, error + "\n");
+   flushLog();
    exit(1);
 }
 
 ProjectDefinition    getProjectDescription(QString path)
 {
+    TraceSpan trace("getProjectDescription");
     QString jsonPath = "sqproject.json";
     QString basePath = QDir::currentPath();
     if (path.isEmpty() == false)
@@ -55,6 +84,24 @@ ProjectDefinition    getProjectDescription(QString path)
     def.proFile = basePath + "/" + def.name + ".pro";
     if (obj.contains("pro-file"))
         def.proFile = basePath + "/" + obj["pro-file"].toString();
+    def.cmakeFile = basePath + "/CMakeLists.txt";
+    if (obj.contains("cmake-file"))
+        def.cmakeFile = basePath + "/" + obj["cmake-file"].toString();
+    // Without a hint, a CMakeLists.txt and no .pro file means a CMake project
+    def.buildSystem = BuildSystem::QMake;
+    if (obj.contains("build-system"))
+    {
+        QString buildSystem = obj["build-system"].toString();
+        if (buildSystem == "cmake")
+            def.buildSystem = BuildSystem::CMake;
+        else if (buildSystem != "qmake")
+            error_and_exit("Can't make sense of the <build-system> field, accepted value are : qmake, cmake");
+    } else if (obj.contains("cmake-file")) {
+        def.buildSystem = BuildSystem::CMake;
+    } else if (!obj.contains("pro-file") && QFileInfo::exists(def.cmakeFile)
+               && !QFileInfo::exists(def.proFile) && !QFileInfo::exists(basePath + "/" + QString(def.name).remove(QChar(' ')) + ".pro")) {
+        def.buildSystem = BuildSystem::CMake;
+    }
     def.basePath = basePath;
     def.projectBasePath = basePath;
     if (obj.contains("project-base-path"))
@@ -94,10 +141,29 @@ ProjectDefinition    getProjectDescription(QString path)
             error_and_exit("Can't make sense of the <qt-major-version> field, accepted value are : qt5, 5, qt6, 6");
     }
 
+    if (obj.contains("qt-matrix"))
+    {
+        for (const QJsonValue& value : obj["qt-matrix"].toArray())
+            def.qtMatrix.append(value.toString());
+    }
     if (obj.contains("target-name"))
         def.targetName = obj["target-name"].toString();
     if (obj.contains("translations-dir"))
         def.translationDir = obj["translations-dir"].toString();
+    if (obj.contains("windows-plugin-dirs"))
+    {
+        for (const QJsonValue& value : obj["windows-plugin-dirs"].toArray())
+            def.windowsPluginDirs.append(value.toString());
+    }
+    if (obj.contains("windows-module-plugin-dirs"))
+    {
+        const QJsonObject modules = obj["windows-module-plugin-dirs"].toObject();
+        for (auto it = modules.begin(); it != modules.end(); ++it)
+        {
+            for (const QJsonValue& value : it.value().toArray())
+                def.windowsModulePluginDirs[it.key()].append(value.toString());
+        }
+    }
     if (obj.contains("files"))
         handleFiles(def, obj);
     def.qmlProject = false;
@@ -171,6 +237,7 @@ void    handleFiles(ProjectDefinition& def, QJsonObject& obj)
 
 void    extractInfosFromProFile(ProjectDefinition& def)
 {
+    TraceSpan trace("extractInfosFromProFile");
     const QRegularExpression qtDef("^QT\\s*\\+=");
     const QRegularExpression blankExp("\\s+");
     const QRegularExpression targetDef("TARGET\\s*=\\s*([a-zA-Z-]+)");
@@ -224,6 +291,7 @@ void    extractInfosFromProFile(ProjectDefinition& def)
 
 void    findVersion(ProjectDefinition& proj)
 {
+    TraceSpan trace("findVersion");
     println("Trying to find project version");
     if (proj.version.type == VersionType::Forced)
     {
@@ -235,12 +303,13 @@ void    findVersion(ProjectDefinition& proj)
     {
         println("Project version is determined by git or was not set");
         Runner run(true);
+        run.setOutputLimit(0);
         bool ok = run.run("git", proj.basePath, QStringList() << "status");
         if (!ok && proj.version.type == VersionType::Auto)
         {
             println("Git failed, falling back to using current date");
             proj.version.type = VersionType::Date;
-            proj.version.dateVersion = QDateTime::currentDateTime().toString("yyyy-MM-dd");
+            proj.version.dateVersion = buildDateTime().toString("yyyy-MM-dd");
             proj.version.simpleVersion = proj.version.dateVersion;
             return ;
         }
@@ -293,7 +362,7 @@ void    findVersion(ProjectDefinition& proj)
     if (proj.version.type == VersionType::Date)
     {
         println("Project version specified to use current date");
-        proj.version.dateVersion = QDateTime::currentDateTime().toString("yyyy-MM-dd");
+        proj.version.dateVersion = buildDateTime().toString("yyyy-MM-dd");
         println("Project version is " + proj.version.dateVersion);
         return ;
     }
@@ -309,6 +378,7 @@ const QString GPLV3 = "GNU GENERAL PUBLIC LICENSE\n" \
 
 void    findLicense(ProjectDefinition& project)
 {
+    TraceSpan trace("findLicense");
     if (project.licenseName.isEmpty() == false && project.licenseFile.isEmpty() == false)
     {
         return ;
@@ -364,6 +434,7 @@ void    findLicense(ProjectDefinition& project)
 
 void        findReadme(ProjectDefinition& project)
 {
+    TraceSpan trace("findReadme");
     if (!project.readmeFile.isEmpty())
         return;
     println("Searching for a Readme file");
@@ -375,10 +446,10 @@ void        findReadme(ProjectDefinition& project)
     }
 }
 
-QString    checkForFile(const QString path, const QRegularExpression searchPattern)
+QString    checkForFile(const QString& path, const QRegularExpression& searchPattern)
 {
     QDir dir(path);
-    for (auto entry : dir.entryList())
+    for (const QString& entry : dir.entryList())
     {
 
         QRegularExpressionMatch match = searchPattern.match(entry);
@@ -395,29 +466,101 @@ const QRegularExpression varEntry("%%([\\w_]+)%%");
 const QRegularExpression ifStartEntry("%%\\{IF ([\\w_]+)%%");
 const QRegularExpression ifEndEntry("%%}IF%%");
 
-QString    useTemplateFile(QString rcPath, QMap<QString, QString> mapping)
+/*
+ * A template is parsed once in lines where the variables are split from the text, generating
+ * the same file again (--watch, several projects) only appends the pieces. Files on disk are
+ * parsed again when they change, the resources never do.
+ */
+struct TemplateLine
+{
+    enum Kind { Text, IfStart, IfEnd };
+    Kind        kind = Text;
+    QString     ifKey;
+    QStringList pieces; // the text around the variables, one more than keys
+    QStringList keys;
+};
+
+struct CompiledTemplate
+{
+    QDateTime           modified;
+    qint64              size = -1;
+    QList<TemplateLine> lines;
+    int                 textSize = 0;
+};
+
+static QMutex                           compiledTemplatesMutex;
+static QHash<QString, CompiledTemplate> compiledTemplates;
+
+static CompiledTemplate compileTemplate(const QString& rcPath, const QFileInfo& info)
 {
     QFile   templateFile(rcPath);
     if (!templateFile.open(QIODevice::ReadOnly | QIODevice::Text))
     {
         error_and_exit("Can't open template file " + templateFile.fileName() + " : " + templateFile.errorString());
     }
-    QString toret;
-    bool    skipLine = false;
+    CompiledTemplate toret;
+    toret.modified = info.lastModified();
+    toret.size = info.size();
     while (!templateFile.atEnd())
     {
-        QString line = templateFile.readLine();
+        const QString line = templateFile.readLine();
+        TemplateLine compiled;
         auto ifStartMatch = ifStartEntry.match(line);
-        auto ifEndMatch = ifEndEntry.match(line);
-        if (ifEndMatch.hasMatch())
+        if (ifEndEntry.match(line).hasMatch())
+        {
+            compiled.kind = TemplateLine::IfEnd;
+        } else if (ifStartMatch.hasMatch()) {
+            compiled.kind = TemplateLine::IfStart;
+            compiled.ifKey = ifStartMatch.captured(1);
+        } else {
+            auto matchs = varEntry.globalMatch(line);
+            int indexStart = 0;
+            while (matchs.hasNext())
+            {
+                auto match = matchs.next();
+                // This take the part before the matching %%xx%%
+                compiled.pieces << line.mid(indexStart, match.capturedStart(0) - indexStart);
+                compiled.keys << match.captured(1);
+                indexStart = match.capturedEnd(0);
+            }
+            compiled.pieces << line.mid(indexStart);
+            for (const QString& piece : compiled.pieces)
+                toret.textSize += piece.size();
+        }
+        toret.lines.append(compiled);
+    }
+    return toret;
+}
+
+QString    useTemplateFile(const QString& rcPath, const QMap<QString, QString>& mapping)
+{
+    const QFileInfo info(rcPath);
+    CompiledTemplate compiled;
+    {
+        QMutexLocker lock(&compiledTemplatesMutex);
+        auto cached = compiledTemplates.constFind(rcPath);
+        if (cached != compiledTemplates.constEnd() && cached->size == info.size() && cached->modified == info.lastModified())
+            compiled = *cached;
+    }
+    if (compiled.size < 0)
+    {
+        compiled = compileTemplate(rcPath, info);
+        QMutexLocker lock(&compiledTemplatesMutex);
+        compiledTemplates.insert(rcPath, compiled);
+    }
+    QString toret;
+    toret.reserve(compiled.textSize);
+    bool    skipLine = false;
+    for (const TemplateLine& line : compiled.lines)
+    {
+        if (line.kind == TemplateLine::IfEnd)
         {
             skipLine = false;
             continue;
         }
-        if (ifStartMatch.hasMatch())
+        if (line.kind == TemplateLine::IfStart)
         {
-            const QString key = ifStartMatch.captured(1);
-            if (!mapping.contains(key))
+            if (!mapping.contains(line.ifKey))
             {
                 skipLine = true;
             } else {
@@ -426,31 +569,233 @@ QString    useTemplateFile(QString rcPath, QMap<QString, QString> mapping)
         }
         if (skipLine)
             continue;
-        auto matchs = varEntry.globalMatch(line);
-        if (matchs.hasNext())
+        toret.append(line.pieces.first());
+        for (int i = 0; i < line.keys.size(); i++)
         {
-            QString generatedLine;
-            unsigned int indexStart = 0;
-            while (matchs.hasNext())
+            auto value = mapping.constFind(line.keys.at(i));
+            if (value != mapping.constEnd())
             {
-                auto match = matchs.next();
-                // This take the part before the matching %%xx%%
-                generatedLine.append(line.mid(indexStart, match.capturedStart(0) - indexStart));
-                indexStart = match.capturedEnd(0);
-                const QString key = match.captured(1);
-                if (mapping.contains(key))
-                {
-                    generatedLine.append(mapping.value(key));
-                } else {
-                    println("Template warning: Found key in template file that does not have a value: " + key);
-                }
+                toret.append(value.value());
+            } else {
+                logMessage(LogLevel::Warning, "Template warning: Found key in template file that does not have a value: " + line.keys.at(i) + "\n");
             }
-            generatedLine.append(line.mid(indexStart));
-            toret.append(generatedLine);
-        } else {
-            toret.append(line);
+            toret.append(line.pieces.at(i + 1));
         }
     }
     return toret;
 }
 
+
+/*
+ * A compiler instance building Qt code can easily use more than a GiB,
+ * starting one job per core on a big builder with little memory only ends up swapping
+ */
+static const quint64 memoryPerJob = 1536ull * 1024 * 1024;
+
+static quint64  availableMemory()
+{
+#ifdef Q_OS_WIN
+    MEMORYSTATUSEX status;
+    status.dwLength = sizeof(status);
+    if (GlobalMemoryStatusEx(&status))
+        return status.ullAvailPhys;
+    return 0;
+#else
+    QFile meminfo("/proc/meminfo");
+    if (!meminfo.open(QIODevice::ReadOnly | QIODevice::Text))
+        return 0;
+    while (!meminfo.atEnd())
+    {
+        QByteArray line = meminfo.readLine();
+        // MemAvailable:   12345678 kB
+        if (line.startsWith("MemAvailable:"))
+            return line.mid(13).simplified().split(' ').at(0).toULongLong() * 1024;
+    }
+    return 0;
+#endif
+}
+
+int     defaultJobCount()
+{
+    quint64 jobs = QThread::idealThreadCount();
+    quint64 memory = availableMemory();
+    if (memory != 0)
+        jobs = qMin(jobs, qMax<quint64>(1, memory / memoryPerJob));
+    return qMax<int>(1, jobs);
+}
+
+/*
+ * Hash the content of a directory, the relative path of the files are part of the hash
+ * so renaming or moving a file change the result
+ */
+QByteArray  hashDirectory(const QString& path)
+{
+    QDir        baseDir(path);
+    QStringList files;
+    QDirIterator it(path, QDir::Files | QDir::Hidden | QDir::System | QDir::NoDotAndDotDot, QDirIterator::Subdirectories);
+    while (it.hasNext())
+        files.append(baseDir.relativeFilePath(it.next()));
+    files.sort();
+    QCryptographicHash hash(QCryptographicHash::Sha256);
+    for (const QString& file : files)
+    {
+        QFile   f(baseDir.filePath(file));
+        QFileInfo fi(f);
+        hash.addData(file.toUtf8());
+        hash.addData(QByteArray::number(fi.size()));
+        if (fi.isSymLink())
+        {
+            hash.addData(fi.symLinkTarget().toUtf8());
+            continue;
+        }
+        if (!f.open(QIODevice::ReadOnly))
+            error_and_exit("Can't open " + f.fileName() + " to hash it : " + f.errorString());
+        hash.addData(&f);
+    }
+    return hash.result().toHex();
+}
+
+QByteArray  hashFile(const QString& path)
+{
+    QFile f(path);
+    if (!f.open(QIODevice::ReadOnly))
+        error_and_exit("Can't open " + f.fileName() + " to hash it : " + f.errorString());
+    QCryptographicHash hash(QCryptographicHash::Sha256);
+    hash.addData(&f);
+    return hash.result().toHex();
+}
+
+bool    copyRecursively(const QString& source, const QString& destination)
+{
+    QFileInfo sourceFi(source);
+    if (!sourceFi.isDir())
+    {
+        QDir().mkpath(QFileInfo(destination).absolutePath());
+        QFile::remove(destination);
+        return QFile::copy(source, destination);
+    }
+    QDir sourceDir(source);
+    QDirIterator it(source, QDir::Files | QDir::Hidden | QDir::NoDotAndDotDot, QDirIterator::Subdirectories);
+    while (it.hasNext())
+    {
+        const QString file = it.next();
+        const QString target = destination + "/" + sourceDir.relativeFilePath(file);
+        QDir().mkpath(QFileInfo(target).absolutePath());
+        QFile::remove(target);
+        if (!QFile::copy(file, target))
+            return false;
+    }
+    return true;
+}
+
+QString findQMake(const ProjectDefinition& project)
+{
+    if (project.qtMajorVersion == QtMajorVersion::Qt6)
+        return "qmake6";
+    if (project.qtMajorVersion == QtMajorVersion::Qt5)
+        return "qmake";
+    println("No Qt major version provided, detecting qmake executable");
+    Runner testqmake;
+    if (testqmake.run("qmake6", QStringList() << "--version"))
+        return "qmake6";
+    println("\tqmake6 executable not found, falling back to qmake");
+    return "qmake";
+}
+
+/*
+ * qmake -query output only change when qmake itself change, it is kept in the user cache dir
+ * keyed by the resolved qmake path, its size and modification time (and QT_SELECT for qtchooser)
+ */
+QMap<QString, QString>  queryQMake(const QString& qmake, bool* ok)
+{
+    static QMutex   cacheMutex;
+    QMutexLocker    lock(&cacheMutex);
+    const QString cachePath = QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation) + "/sqpackager/qmake-query.json";
+    QString qmakePath = QDir::isAbsolutePath(qmake) ? qmake : QStandardPaths::findExecutable(qmake);
+    QFileInfo qmakeFi(qmakePath);
+    const QString key = qmakeFi.canonicalFilePath() + "|" + QString::fromLocal8Bit(qgetenv("QT_SELECT"));
+    const QString stamp = QString("%1 %2").arg(qmakeFi.size()).arg(qmakeFi.lastModified().toMSecsSinceEpoch());
+    QJsonObject cache;
+    QFile cacheFile(cachePath);
+    if (qmakeFi.exists() && cacheFile.open(QIODevice::ReadOnly))
+    {
+        cache = QJsonDocument::fromJson(cacheFile.readAll()).object();
+        cacheFile.close();
+        const QJsonObject entry = cache.value(key).toObject();
+        if (entry.value("stamp").toString() == stamp)
+        {
+            if (ok != nullptr)
+                *ok = true;
+            QMap<QString, QString> toret;
+            const QJsonObject values = entry.value("query").toObject();
+            for (auto it = values.constBegin(); it != values.constEnd(); ++it)
+                toret[it.key()] = it.value().toString();
+            return toret;
+        }
+    }
+    TraceSpan trace("queryQMake");
+    Runner run;
+    run.setOutputLimit(0);
+    if (ok != nullptr)
+        *ok = true;
+    if (!run.run(qmake, QStringList() << "-query"))
+    {
+        if (ok == nullptr)
+            error_and_exit("Could not run " + qmake + " -query");
+        *ok = false;
+        return QMap<QString, QString>();
+    }
+    QMap<QString, QString> toret;
+    QJsonObject values;
+    for (const QByteArray& line : run.getStdout().split('\n'))
+    {
+        int sep = line.indexOf(':');
+        if (sep > 0)
+        {
+            toret[line.left(sep)] = QString::fromLocal8Bit(line.mid(sep + 1)).trimmed();
+            values[QString::fromLocal8Bit(line.left(sep))] = toret[line.left(sep)];
+        }
+    }
+    if (qmakeFi.exists())
+    {
+        QJsonObject entry;
+        entry["stamp"] = stamp;
+        entry["query"] = values;
+        cache[key] = entry;
+        QDir().mkpath(QFileInfo(cachePath).absolutePath());
+        QSaveFile saveFile(cachePath);
+        if (saveFile.open(QIODevice::WriteOnly))
+        {
+            saveFile.write(QJsonDocument(cache).toJson(QJsonDocument::Compact));
+            saveFile.commit();
+        }
+    }
+    return toret;
+}
+
+/*
+ * qmlimportscanner is a host tool, for a cross compiled Qt the QT_HOST_* paths point to it
+ */
+QStringList qmlImportPaths(const ProjectDefinition& project, const QMap<QString, QString>& qtPaths)
+{
+    QStringList toret;
+    QString scanner;
+    for (const QString& dir : {"QT_HOST_LIBEXECS", "QT_INSTALL_LIBEXECS", "QT_HOST_BINS", "QT_INSTALL_BINS"})
+    {
+        scanner = qtPaths.value(dir) + "/qmlimportscanner";
+        if (!qtPaths.value(dir).isEmpty() && QFileInfo::exists(scanner))
+            break;
+    }
+    Runner run;
+    run.setOutputLimit(0);
+    bool ok = run.run(scanner, QStringList() << "-rootPath" << project.basePath + "/" + project.qmlDir << "-importPath" << qtPaths.value("QT_INSTALL_QML"));
+    if (!ok)
+        error_and_exit("Could not run qmlimportscanner to find the QML imports");
+    for (const QJsonValue& import : QJsonDocument::fromJson(run.getStdout()).array())
+    {
+        QString path = import.toObject().value("path").toString();
+        if (!path.isEmpty() && path.startsWith(qtPaths.value("QT_INSTALL_QML")) && !toret.contains(path))
+            toret.append(path);
+    }
+    return toret;
+}
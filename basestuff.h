@@ -5,17 +5,45 @@
 #include <sqpackager.h>
 #include <QRegularExpression>
 
+class QJsonObject;
+
+/*
+ * While a RecoverableErrors is alive, error_and_exit throws a ProjectError in this thread instead of exiting
+ * --watch uses it to report a broken project and keep watching
+ */
+struct ProjectError
+{
+    QString message;
+};
+
+class RecoverableErrors
+{
+public:
+    RecoverableErrors();
+    ~RecoverableErrors();
+};
+
 void                error_and_exit(QString error);
 ProjectDefinition   getProjectDescription(QString path = "");
+void                handleFiles(ProjectDefinition& def, QJsonObject& obj);
 void                extractInfosFromProFile(ProjectDefinition& def);
 void                findVersion(ProjectDefinition& proj);
 void                findLicense(ProjectDefinition& project);
 void                findReadme(ProjectDefinition& project);
-QString             useTemplateFile(QString rcPath, QMap<QString, QString> mapping);
+QString             useTemplateFile(const QString& rcPath, const QMap<QString, QString>& mapping);
 bool                generateLinuxDesktopRC(ProjectDefinition& proj);
 void                generateUnixInstallFile(const ProjectDefinition& project);
 void                generateManPage(const ProjectDefinition& project);
-QString             checkForFile(const QString path, const QRegularExpression searchPattern);
+QString             checkForFile(const QString& path, const QRegularExpression& searchPattern);
 QString             createArchive(const ProjectDefinition& project, QString version = QString());
+int                 defaultJobCount();
+QByteArray          hashDirectory(const QString& path);
+QByteArray          hashFile(const QString& path);
+bool                copyRecursively(const QString& source, const QString& destination);
+// qmake for Qt5, qmake6 for Qt6 and without a Qt major version when it is installed
+QString             findQMake(const ProjectDefinition& project);
+// Exit on failure unless ok is given
+QMap<QString, QString>  queryQMake(const QString& qmake, bool* ok = nullptr);
+QStringList         qmlImportPaths(const ProjectDefinition& project, const QMap<QString, QString>& qtPaths);
 
 #endif // BASESTUFF_H
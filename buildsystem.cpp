@@ -0,0 +1,307 @@
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QRegularExpression>
+#include <QTemporaryDir>
+
+#include <buildsystem.h>
+#include <basestuff.h>
+#include <runner.h>
+#include <print.h>
+#include <trace.h>
+
+extern PackagerOptions gOptions;
+
+// These are given to find_package but are not modules an application links with
+static const QStringList cmakeQtTools = {"linguisttools", "tools", "coretools", "guitools", "widgetstools", "qmltools"};
+
+static const QStringList findPackageKeywords = {"REQUIRED", "COMPONENTS", "OPTIONAL_COMPONENTS", "CONFIG", "NO_MODULE",
+                                                "QUIET", "EXACT", "MODULE", "GLOBAL", "NAMES", "NO_POLICY_SCOPE"};
+
+static QString  readCMakeFile(const QString& path)
+{
+    const QRegularExpression comment("#[^\n]*");
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+        return QString();
+    return QString::fromUtf8(file.readAll()).remove(comment);
+}
+
+// The top CMakeLists.txt first, then the add_subdirectory() ones in order
+static QStringList  cmakeListFiles(const QString& topFile)
+{
+    const QRegularExpression subdirectoryExp("\\badd_subdirectory\\s*\\(\\s*\"?([^\\s\")]+)", QRegularExpression::CaseInsensitiveOption);
+    QStringList files;
+    QStringList queue;
+    queue << QFileInfo(topFile).absoluteFilePath();
+    while (!queue.isEmpty())
+    {
+        const QString file = queue.takeFirst();
+        if (files.contains(file) || !QFileInfo::exists(file))
+            continue;
+        files << file;
+        auto matchs = subdirectoryExp.globalMatch(readCMakeFile(file));
+        while (matchs.hasNext())
+        {
+            const QString dir = matchs.next().captured(1);
+            if (!dir.contains("${"))
+                queue << QFileInfo(QFileInfo(file).absolutePath() + "/" + dir + "/CMakeLists.txt").absoluteFilePath();
+        }
+    }
+    return files;
+}
+
+static void     parseFindPackage(const QString& arguments, QStringList& modules, QList<int>& majorVersions)
+{
+    const QRegularExpression qtPackage("^Qt([56])?(\\w*)$");
+    const QStringList words = arguments.split(QRegularExpression("\\s+"), Qt::SkipEmptyParts);
+    if (words.isEmpty())
+        return ;
+    auto package = qtPackage.match(words.first());
+    if (!package.hasMatch() && words.first() != "QT" && !words.first().startsWith("Qt${"))
+        return ;
+    if (package.hasMatch() && !package.captured(1).isEmpty())
+        majorVersions << package.captured(1).toInt();
+    // find_package(Qt6Widgets) is the old per module form
+    if (package.hasMatch() && !package.captured(2).isEmpty())
+    {
+        modules << package.captured(2).toLower();
+        return ;
+    }
+    bool names = false;
+    for (const QString& word : words.mid(1))
+    {
+        if (findPackageKeywords.contains(word))
+        {
+            names = word == "NAMES";
+            continue;
+        }
+        // The NAMES list are the packages, not modules
+        if (names || word.contains(QRegularExpression("^[\\d.]+$")) || word.contains("${"))
+            continue;
+        const QString module = word.startsWith("Qt::") ? word.mid(4).toLower() : word.toLower();
+        if (!cmakeQtTools.contains(module))
+            modules << module;
+    }
+}
+
+/*
+ * The CMake file API needs a configured tree, this is only used when the executable target
+ * is created in a way the CMakeLists.txt parsing does not see (a variable, a custom function)
+ */
+static bool     readCMakeFileApi(const ProjectDefinition& def, QString& target, QStringList& modules)
+{
+    TraceSpan trace("readCMakeFileApi");
+    QTemporaryDir buildDir;
+    if (!buildDir.isValid())
+        return false;
+    const QString queryDir = buildDir.path() + "/.cmake/api/v1/query";
+    QDir().mkpath(queryDir);
+    QFile query(queryDir + "/codemodel-v2");
+    if (!query.open(QIODevice::WriteOnly))
+        return false;
+    query.close();
+    println("Configuring the project to query the CMake file API");
+    Runner run;
+    if (!run.start("cmake", buildDir.path(), QStringList() << "-S" << QFileInfo(def.cmakeFile).absolutePath()
+                   << "-B" << buildDir.path() << "-G" << "Ninja") || !run.waitForFinished())
+    {
+        println(run.getStderr());
+        return false;
+    }
+    const QDir replyDir(buildDir.path() + "/.cmake/api/v1/reply");
+    auto readJson = [&replyDir](const QString& name) {
+        QFile file(replyDir.absoluteFilePath(name));
+        file.open(QIODevice::ReadOnly);
+        return QJsonDocument::fromJson(file.readAll()).object();
+    };
+    const QStringList indexes = replyDir.entryList(QStringList() << "index-*.json", QDir::Files, QDir::Name);
+    if (indexes.isEmpty())
+        return false;
+    QString codemodelFile;
+    for (const QJsonValue& object : readJson(indexes.last()).value("objects").toArray())
+    {
+        if (object.toObject().value("kind").toString() == "codemodel")
+            codemodelFile = object.toObject().value("jsonFile").toString();
+    }
+    const QJsonArray configurations = readJson(codemodelFile).value("configurations").toArray();
+    if (configurations.isEmpty())
+        return false;
+    // The Qt libraries are in the link command of the executable
+    const QRegularExpression qtLibrary("Qt[56](\\w+?)(?:\\.so|\\.lib|\\.a|\\.dll|\\.framework|$)");
+    for (const QJsonValue& targetRef : configurations.first().toObject().value("targets").toArray())
+    {
+        const QJsonObject targetObj = readJson(targetRef.toObject().value("jsonFile").toString());
+        if (targetObj.value("type").toString() != "EXECUTABLE")
+            continue;
+        target = targetObj.value("nameOnDisk").toString().remove(QRegularExpression("\\.exe$"));
+        for (const QJsonValue& fragment : targetObj.value("link").toObject().value("commandFragments").toArray())
+        {
+            auto library = qtLibrary.match(QFileInfo(fragment.toObject().value("fragment").toString()).fileName());
+            if (library.hasMatch())
+                modules << library.captured(1).toLower();
+        }
+        return true;
+    }
+    return false;
+}
+
+void    extractInfosFromCMakeLists(ProjectDefinition& def)
+{
+    TraceSpan trace("extractInfosFromCMakeLists");
+    const QRegularExpression projectExp("\\bproject\\s*\\(\\s*\"?([\\w.+-]+)", QRegularExpression::CaseInsensitiveOption);
+    const QRegularExpression executableExp("\\b(?:qt[56]?_add_executable|add_executable)\\s*\\(([^)]*)\\)", QRegularExpression::CaseInsensitiveOption);
+    const QRegularExpression findPackageExp("\\bfind_package\\s*\\(([^)]*)\\)", QRegularExpression::CaseInsensitiveOption);
+    println(def.cmakeFile);
+    if (QFileInfo::exists(def.cmakeFile) == false)
+        error_and_exit("Could not find the CMakeLists.txt file for the project, you can specify it using the <cmake-file> field");
+    QString cmakeProjectName;
+    QString executable;
+    QList<int> majorVersions;
+    for (const QString& file : cmakeListFiles(def.cmakeFile))
+    {
+        const QString content = readCMakeFile(file);
+        auto projectMatch = projectExp.match(content);
+        if (projectMatch.hasMatch() && cmakeProjectName.isEmpty())
+            cmakeProjectName = projectMatch.captured(1);
+        auto packages = findPackageExp.globalMatch(content);
+        while (packages.hasNext())
+            parseFindPackage(packages.next().captured(1), def.qtModules, majorVersions);
+        auto executables = executableExp.globalMatch(content);
+        while (executables.hasNext() && executable.isEmpty())
+        {
+            const QStringList args = executables.next().captured(1).split(QRegularExpression("\\s+"), Qt::SkipEmptyParts);
+            if (args.isEmpty() || args.contains("IMPORTED") || args.contains("ALIAS"))
+                continue;
+            executable = args.first();
+            executable.remove('"');
+            executable.replace("${PROJECT_NAME}", cmakeProjectName).replace("${CMAKE_PROJECT_NAME}", cmakeProjectName);
+        }
+    }
+    def.qtModules.removeDuplicates();
+    if (executable.contains("${"))
+        executable.clear();
+    if (executable.isEmpty() && def.targetName.isEmpty())
+    {
+        QStringList apiModules;
+        if (readCMakeFileApi(def, executable, apiModules))
+            def.qtModules.append(apiModules);
+        def.qtModules.removeDuplicates();
+    }
+    println("Qt modules found in CMakeLists.txt : " + def.qtModules.join(" "));
+    if (def.targetName.isEmpty() && !executable.isEmpty())
+    {
+        def.targetName = executable;
+        println("Target found in CMakeLists.txt is : " + def.targetName);
+    }
+    if (def.targetName.isEmpty())
+        error_and_exit("Could not find the executable target in the CMake project, you can specify it using the <target-name> field");
+    majorVersions.removeDuplicates();
+    if (def.qtMajorVersion == QtMajorVersion::Auto && majorVersions.size() == 1)
+        def.qtMajorVersion = majorVersions.first() == 5 ? QtMajorVersion::Qt5 : QtMajorVersion::Qt6;
+}
+
+// The .pro file then the include() ones, scoped or not, the includes using other variables than PWD can't be followed
+static QStringList  proFiles(const QString& proFile)
+{
+    const QRegularExpression includeExp("^[^#\\n]*\\binclude\\s*\\(\\s*\"?([^\")]+?)\"?\\s*\\)", QRegularExpression::MultilineOption);
+    const QString proDir = QFileInfo(proFile).absolutePath();
+    QStringList files;
+    QStringList queue;
+    queue << QFileInfo(proFile).absoluteFilePath();
+    while (!queue.isEmpty())
+    {
+        const QString file = queue.takeFirst();
+        if (files.contains(file) || !QFileInfo::exists(file))
+            continue;
+        files << file;
+        QFile pro(file);
+        if (!pro.open(QIODevice::ReadOnly | QIODevice::Text))
+            continue;
+        const QString fileDir = QFileInfo(file).absolutePath();
+        auto matchs = includeExp.globalMatch(QString::fromUtf8(pro.readAll()));
+        while (matchs.hasNext())
+        {
+            QString include = matchs.next().captured(1).trimmed();
+            include.replace("$$_PRO_FILE_PWD_", proDir).replace("$${_PRO_FILE_PWD_}", proDir);
+            include.replace("$$PWD", fileDir).replace("$${PWD}", fileDir);
+            if (include.contains("$$"))
+                continue;
+            queue << QFileInfo(QDir(fileDir), include).absoluteFilePath();
+        }
+    }
+    return files;
+}
+
+QStringList projectBuildFiles(const ProjectDefinition& project)
+{
+    if (project.buildSystem == BuildSystem::CMake)
+        return cmakeListFiles(project.cmakeFile);
+    return proFiles(project.proFile);
+}
+
+QString cmakeSourceDir(const ProjectDefinition& project)
+{
+    const QString dir = QDir(project.basePath).relativeFilePath(QFileInfo(project.cmakeFile).absolutePath());
+    return dir.isEmpty() ? "." : dir;
+}
+
+void    setBuildSystemMapping(const ProjectDefinition& project, QMap<QString, QString>& mapping)
+{
+    if (project.buildSystem == BuildSystem::CMake)
+    {
+        mapping["CMAKE_PROJECT"] = "";
+        mapping["CMAKE_SOURCE_DIR"] = cmakeSourceDir(project);
+        mapping["CMAKE_DEFINES_FILE"] = cmakeDefinesFileName;
+    } else {
+        mapping["QMAKE_PROJECT"] = "";
+    }
+}
+
+QString cmakeDefinitions(const QStringList& defines)
+{
+    QStringList quoted;
+    for (QString define : defines)
+        quoted << "\"" + define.replace("\\", "\\\\").replace("\"", "\\\"") + "\"";
+    return "add_compile_definitions(" + quoted.join(" ") + ")\n";
+}
+
+QStringList cmakeConfigureArguments(const ProjectDefinition& project, const QString& buildDir, const QStringList& defines, const QString& qtPrefix)
+{
+    QFile definesFile(buildDir + "/" + cmakeDefinesFileName);
+    if (!definesFile.open(QIODevice::WriteOnly | QIODevice::Text))
+        error_and_exit("Could not create the " + definesFile.fileName() + " file : " + definesFile.errorString());
+    definesFile.write(cmakeDefinitions(defines).toUtf8());
+    definesFile.close();
+    QStringList args;
+    args << "-S" << QFileInfo(project.cmakeFile).absolutePath() << "-B" << buildDir << "-G" << "Ninja"
+         << "-DCMAKE_BUILD_TYPE=Release"
+         << "-DCMAKE_RUNTIME_OUTPUT_DIRECTORY=" + buildDir
+         << "-DCMAKE_PROJECT_INCLUDE=" + definesFile.fileName();
+    if (!qtPrefix.isEmpty())
+        args << "-DCMAKE_PREFIX_PATH=" + qtPrefix;
+    return args;
+}
+
+QStringList cmakeBuildArguments(const QString& buildDir, int jobs)
+{
+    return QStringList() << "--build" << buildDir << "--parallel" << QString::number(jobs);
+}
+
+void    cmakeBuild(Runner& runner, const ProjectDefinition& project, const QString& cmake, const QString& buildDir,
+                   const QStringList& defines, const QString& qtPrefix, const QStringList& extraArgs)
+{
+    TraceSpan trace("cmakeBuild");
+    // Configuring finds the compiler and Qt, it can take longer than the default timeout
+    if (!runner.start(cmake, buildDir, cmakeConfigureArguments(project, buildDir, defines, qtPrefix) << extraArgs) || !runner.waitForFinished())
+    {
+        println(runner.getStdout());
+        println(runner.getStderr());
+        error_and_exit("CMake failed to configure the project");
+    }
+    if (!runner.runWithOut(cmake, cmakeBuildArguments(buildDir, gOptions.jobs), buildDir))
+        error_and_exit("Building the project with Ninja failed");
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <QMap>
+#include <QString>
+#include <QStringList>
+#include <projectdefinition.h>
+
+class Runner;
+
+/*
+ * CMake projects are built with the Ninja generator
+ * The defines the backends give (NAME or NAME=value) go in a file included with CMAKE_PROJECT_INCLUDE,
+ * and the executables are put at the root of the build directory like qmake does on Unix
+ */
+const QString cmakeDefinesFileName = "sqpackager_defines.cmake";
+
+void        extractInfosFromCMakeLists(ProjectDefinition& def);
+// The files the build is described in: the .pro file and its include() files, or the CMakeLists.txt files
+QStringList projectBuildFiles(const ProjectDefinition& project);
+// Directory of the top CMakeLists.txt relative to the project base path, for the generated scripts
+QString     cmakeSourceDir(const ProjectDefinition& project);
+// The QMAKE_PROJECT or CMAKE_PROJECT template blocks and the CMake source and defines file names
+void        setBuildSystemMapping(const ProjectDefinition& project, QMap<QString, QString>& mapping);
+// The add_compile_definitions() call carrying these defines
+QString     cmakeDefinitions(const QStringList& defines);
+// Write the defines file in buildDir and give the arguments to configure the project there
+QStringList cmakeConfigureArguments(const ProjectDefinition& project, const QString& buildDir, const QStringList& defines,
+                                    const QString& qtPrefix = QString());
+QStringList cmakeBuildArguments(const QString& buildDir, int jobs);
+// Configure and build with the runner environment, exit on failure
+void        cmakeBuild(Runner& runner, const ProjectDefinition& project, const QString& cmake, const QString& buildDir,
+                       const QStringList& defines, const QString& qtPrefix, const QStringList& extraArgs = QStringList());
@@ -0,0 +1,306 @@
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QDateTime>
+#include <QDataStream>
+#include <QElapsedTimer>
+#include <QCryptographicHash>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSysInfo>
+#include <QMap>
+
+#include <cache.h>
+#include <projectdefinition.h>
+#include <sqpackager.h>
+#include <basestuff.h>
+#include <sourcetree.h>
+#include <runner.h>
+#include <print.h>
+#include <trace.h>
+
+extern PackagerOptions gOptions;
+
+// Bump this when the key or the entry layout change
+static const QByteArray cacheFormat = "sqpackager-cache-2";
+
+bool    artifactCacheEnabled()
+{
+    return gOptions.cacheDir.isEmpty() == false;
+}
+
+static QString  entryDirectory(const QByteArray& key)
+{
+    return gOptions.cacheDir + "/" + QString::fromLatin1(key.left(2)) + "/" + QString::fromLatin1(key);
+}
+
+QString toolIdentity(const QString& command, const QStringList& args)
+{
+    static QMap<QString, QString> identities;
+    const QString id = command + " " + args.join(" ");
+    if (identities.contains(id))
+        return identities.value(id);
+    Runner run;
+    run.setOutputLimit(0);
+    QString toret = "missing";
+    if (run.run(command, args))
+        toret = QString::fromLocal8Bit(run.getStdout()).section('\n', 0, 0).trimmed();
+    identities[id] = toret;
+    return toret;
+}
+
+// The absolute paths are left out, the same project checked out elsewhere give the same key
+static QByteArray  projectDefinitionHash(const ProjectDefinition& project)
+{
+    QByteArray data;
+    QDataStream stream(&data, QIODevice::WriteOnly);
+    stream << project.name << project.unixNormalizedName << project.shortDescription << project.description
+           << project.author << project.authorMail << project.qmlProject << project.qtModules << project.icon
+           << project.generatedIconSizes << project.org << project.flatpakFilesystemPermission
+           << project.flatpakFile << project.flatpakName << project.debianMaintainer << project.debianMaintainerMail
+           << project.debianPackageName << project.qmlDir << project.proFile << project.version.simpleVersion
+           << project.version.gitCommitId << project.readmeFile << project.licenseFile << project.licenseName
+           << static_cast<int>(project.qtMajorVersion) << project.desktopIcon << project.desktopFile
+           << project.desktopFileNormalizedName << project.categories << project.targetName << project.translationDir
+           << static_cast<int>(project.buildSystem) << QDir(project.basePath).relativeFilePath(project.cmakeFile);
+    for (const ReleaseFile& file : project.releaseFiles)
+        stream << static_cast<int>(file.type) << file.name << file.source << file.destination;
+    return QCryptographicHash::hash(data, QCryptographicHash::Sha256);
+}
+
+QByteArray  artifactCacheKey(const ProjectDefinition& project, const QString& target, const QString& toolchain)
+{
+    if (!artifactCacheEnabled())
+        return QByteArray();
+    TraceSpan trace("artifactCacheKey");
+    // Several targets can be built in the same run, the source tree does not change in between
+    static QMap<QString, QByteArray> sourceHashes;
+    if (!sourceHashes.contains(project.projectBasePath))
+        sourceHashes[project.projectBasePath] = sourceSnapshotHash(project.projectBasePath, sourceSnapshot(project.projectBasePath));
+
+    QCryptographicHash hash(QCryptographicHash::Sha256);
+    hash.addData(cacheFormat);
+    hash.addData(sourceHashes.value(project.projectBasePath));
+    hash.addData(projectDefinitionHash(project));
+    hash.addData(target.toUtf8() + '\0');
+    hash.addData(toolchain.toUtf8() + '\0');
+    hash.addData(QSysInfo::currentCpuArchitecture().toUtf8());
+    return hash.result().toHex();
+}
+
+static bool    runCurl(const QStringList& args)
+{
+    Runner run;
+#ifdef Q_OS_WIN
+    const QString curl = "curl.exe";
+#else
+    const QString curl = "curl";
+#endif
+    // The files can be big, the default QProcess timeout does not apply with start()
+    return run.start(curl, QString(), QStringList() << "-fsSL" << "--retry" << "2" << args) && run.waitForFinished();
+}
+
+// The index can come from a remote cache, its file names must stay in the entry directory
+static bool    isEntryFileName(const QString& file)
+{
+    return file.isEmpty() == false && !file.contains('/') && !file.contains('\\') && !file.contains("..")
+            && file != "index.json" && file != "index.json.part";
+}
+
+// The HTTP backend is a plain directory tree: GET and PUT of <url>/<key>/<file>
+static bool    fetchRemoteEntry(const QByteArray& key, const QString& entryDir)
+{
+    const QString url = gOptions.cacheUrl + "/" + QString::fromLatin1(key);
+    QDir().mkpath(entryDir);
+    const QString index = entryDir + "/index.json.part";
+    QFile indexFile(index);
+    if (!runCurl(QStringList() << "-o" << index << url + "/index.json") || !indexFile.open(QIODevice::ReadOnly))
+    {
+        QDir(entryDir).removeRecursively();
+        return false;
+    }
+    const QJsonArray entries = QJsonDocument::fromJson(indexFile.readAll()).object().value("artifacts").toArray();
+    indexFile.close();
+    for (const QJsonValue& entry : entries)
+    {
+        const QString file = entry.toObject().value("file").toString();
+        if (!isEntryFileName(file) || !runCurl(QStringList() << "-o" << entryDir + "/" + file << url + "/" + file))
+        {
+            println("Could not download " + file + " from the artifact cache");
+            QDir(entryDir).removeRecursively();
+            return false;
+        }
+    }
+    // The entry only exists locally once all its files are there
+    QFile::remove(entryDir + "/index.json");
+    return QFile::rename(index, entryDir + "/index.json");
+}
+
+static void     uploadRemoteEntry(const QByteArray& key, const QString& entryDir, const QStringList& files)
+{
+    const QString url = gOptions.cacheUrl + "/" + QString::fromLatin1(key);
+    // The index goes last so a partial upload is never seen as a hit
+    for (const QString& file : QStringList() << files << "index.json")
+    {
+        if (!runCurl(QStringList() << "-T" << entryDir + "/" + file << url + "/" + file))
+        {
+            logMessage(LogLevel::Warning, "Warning : could not upload " + file + " to the artifact cache " + gOptions.cacheUrl + "\n");
+            return ;
+        }
+    }
+    println("Artifacts uploaded to " + url);
+}
+
+// The files are only restored inside the project, empty when path leaves it
+static QString  artifactDestination(const ProjectDefinition& project, const QString& path)
+{
+    if (path.isEmpty() || QDir::isAbsolutePath(path))
+        return QString();
+    const QString base = QDir::cleanPath(QFileInfo(project.basePath).absoluteFilePath());
+    const QString destination = QDir::cleanPath(base + "/" + path);
+    if (!destination.startsWith(base + "/"))
+        return QString();
+    return destination;
+}
+
+// The size is checked first, it is enough to catch a truncated copy without reading the file
+static bool    entryFileMatches(const QString& file, const QJsonObject& entry)
+{
+    const QFileInfo fi(file);
+    const QString sha256 = entry.value("sha256").toString();
+    if (sha256.isEmpty() || !fi.isFile() || !fi.isReadable() || fi.size() != static_cast<qint64>(entry.value("size").toDouble(-1)))
+        return false;
+    return hashFile(file) == sha256.toLatin1();
+}
+
+static bool    dropCacheEntry(const QString& entryDir, const QString& reason)
+{
+    logMessage(LogLevel::Warning, "Warning : " + reason + ", the artifact cache entry is dropped\n");
+    QDir(entryDir).removeRecursively();
+    return false;
+}
+
+bool    restoreCachedArtifacts(const ProjectDefinition& project, const QByteArray& key, QList<RegisteredArtifact>* restored)
+{
+    if (key.isEmpty())
+        return false;
+    TraceSpan trace("restoreCachedArtifacts");
+    QElapsedTimer timer;
+    timer.start();
+    const QString entryDir = entryDirectory(key);
+    if (!QFileInfo::exists(entryDir + "/index.json"))
+    {
+        if (gOptions.cacheUrl.isEmpty() || !fetchRemoteEntry(key, entryDir))
+        {
+            println("Artifact cache miss for " + QString::fromLatin1(key.left(16)));
+            return false;
+        }
+    }
+    QFile indexFile(entryDir + "/index.json");
+    if (!indexFile.open(QIODevice::ReadOnly))
+        return false;
+    const QJsonArray entries = QJsonDocument::fromJson(indexFile.readAll()).object().value("artifacts").toArray();
+    if (entries.isEmpty())
+        return false;
+    indexFile.close();
+    // Everything is checked before the first file is touched
+    for (const QJsonValue& value : entries)
+    {
+        const QJsonObject entry = value.toObject();
+        const QString file = entry.value("file").toString();
+        if (!isEntryFileName(file) || artifactDestination(project, entry.value("path").toString()).isEmpty())
+            return dropCacheEntry(entryDir, "invalid file " + file + " in the artifact cache index");
+        if (!entryFileMatches(entryDir + "/" + file, entry))
+            return dropCacheEntry(entryDir, file + " does not match its size or sha256");
+    }
+    QList<RegisteredArtifact> artifacts;
+    for (const QJsonValue& value : entries)
+    {
+        const QJsonObject entry = value.toObject();
+        const QString destination = artifactDestination(project, entry.value("path").toString());
+        QDir().mkpath(QFileInfo(destination).absolutePath());
+        QFile::remove(destination);
+        if (!QFile::copy(entryDir + "/" + entry.value("file").toString(), destination))
+        {
+            println("Could not restore " + destination + " from the artifact cache, building it");
+            return false;
+        }
+        artifacts.append(RegisteredArtifact{entry.value("target").toString(), entry.value("kind").toString(),
+                                            destination, entry.value("github-output").toString()});
+    }
+    for (const RegisteredArtifact& artifact : artifacts)
+    {
+        registerArtifact(artifact.target, artifact.kind, artifact.path, timer.elapsed(), artifact.githubOutput);
+        printSummary("Restored from the artifact cache : " + artifact.path);
+    }
+    if (restored != nullptr)
+        *restored = artifacts;
+    return true;
+}
+
+void    storeCachedArtifacts(const ProjectDefinition& project, const QByteArray& key, int firstArtifact)
+{
+    if (key.isEmpty())
+        return ;
+    const QList<RegisteredArtifact> artifacts = registeredArtifacts(firstArtifact);
+    if (artifacts.isEmpty())
+        return ;
+    TraceSpan trace("storeCachedArtifacts");
+    const QString entryDir = entryDirectory(key);
+    QDir(entryDir).removeRecursively();
+    if (!QDir().mkpath(entryDir))
+    {
+        logMessage(LogLevel::Warning, "Warning : could not create the artifact cache entry " + entryDir + "\n");
+        return ;
+    }
+    QJsonArray  entries;
+    QStringList files;
+    QDir baseDir(project.basePath);
+    for (const RegisteredArtifact& artifact : artifacts)
+    {
+        if (artifact.sha256.isEmpty())
+        {
+            logMessage(LogLevel::Warning, "Warning : could not hash " + artifact.path + ", it is not stored in the artifact cache\n");
+            QDir(entryDir).removeRecursively();
+            return ;
+        }
+        const QString file = QString::number(files.size()) + "-" + QFileInfo(artifact.path).fileName();
+        if (!QFile::copy(artifact.path, entryDir + "/" + file))
+        {
+            logMessage(LogLevel::Warning, "Warning : could not copy " + artifact.path + " in the artifact cache\n");
+            QDir(entryDir).removeRecursively();
+            return ;
+        }
+        files.append(file);
+        // Relative to the project, it can be restored in another checkout. The files built outside
+        // of it (the debian packages) are restored in the dist directory
+        QString path = baseDir.relativeFilePath(artifact.path);
+        if (path.startsWith("../") || QDir::isAbsolutePath(path))
+            path = sourceDistDir + "/" + QFileInfo(artifact.path).fileName();
+        QJsonObject entry;
+        entry["target"] = artifact.target;
+        entry["kind"] = artifact.kind;
+        entry["file"] = file;
+        entry["path"] = path;
+        entry["size"] = artifact.size;
+        entry["sha256"] = QString::fromLatin1(artifact.sha256);
+        entry["github-output"] = artifact.githubOutput;
+        entries.append(entry);
+    }
+    QJsonObject index;
+    index["key"] = QString::fromLatin1(key);
+    index["created"] = QDateTime::currentDateTimeUtc().toString(Qt::ISODate);
+    index["artifacts"] = entries;
+    // index.json is what make the entry valid, it is written last
+    QSaveFile indexFile(entryDir + "/index.json");
+    if (!indexFile.open(QIODevice::WriteOnly) || indexFile.write(QJsonDocument(index).toJson()) < 0 || !indexFile.commit())
+    {
+        logMessage(LogLevel::Warning, "Warning : could not write the artifact cache index in " + entryDir + "\n");
+        return ;
+    }
+    println("Artifacts stored in the cache as " + QString::fromLatin1(key.left(16)));
+    if (gOptions.cacheUrl.isEmpty() == false)
+        uploadRemoteEntry(key, entryDir, files);
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <QString>
+#include <QStringList>
+#include <QByteArray>
+
+#include <artifacts.h>
+
+struct ProjectDefinition;
+
+/*
+ * Content addressed cache of the packages produced by a build
+ * The key covers the filtered source tree, the resolved project definition, the target and the toolchain,
+ * an entry is only written once the build succeeded so a hit can replace the whole build.
+ */
+bool        artifactCacheEnabled();
+// Empty when the cache is disabled
+QByteArray  artifactCacheKey(const ProjectDefinition& project, const QString& target, const QString& toolchain);
+// Copy the cached files back to where the build put them and register them, false on a miss
+bool        restoreCachedArtifacts(const ProjectDefinition& project, const QByteArray& key, QList<RegisteredArtifact>* restored = nullptr);
+// Store the artifacts registered since firstArtifact under this key
+void        storeCachedArtifacts(const ProjectDefinition& project, const QByteArray& key, int firstArtifact);
+// First line of the output of a tool, the result is kept for the run
+QString     toolIdentity(const QString& command, const QStringList& args);
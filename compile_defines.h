@@ -10,6 +10,7 @@ namespace CompileDefines
     const QString windows_install = "SQPROJECT_WINDOWS_INSTALL";
     const QString debian_install = "SQPROJECT_DEBIAN_INSTALL";
     const QString flatpak_install = "SQPROJECT_FLATPAK_INSTALL";
+    const QString appimage_install = "SQPROJECT_APPIMAGE_INSTALL";
     const QString unix_install_share_path = "SQPROJECT_UNIX_APP_SHARE";
 }
 
@@ -8,8 +8,13 @@
 #include <basestuff.h>
 #include <sqpackager.h>
 #include <compile_defines.h>
-#include <github.h>
-#include <QThread>
+#include <artifacts.h>
+#include <cache.h>
+#include <buildsystem.h>
+#include <QElapsedTimer>
+#include <QRegularExpression>
+#include <trace.h>
+#include <reproducible.h>
 
 
 const QMap<QString, QString> debianQt5ModulesName = {
@@ -45,15 +50,18 @@ const QStringList qt5ModulesInBase = {
     "concurrent"
 };
 
-static QString getDebianVersion(const ProjectDefinition& proj);
 static QStringList getModulesList(const ProjectDefinition& project);
 
 QString qmakeExecutable = "qmake";
-static void setQMakeVersion(const ProjectDefinition& project);
+static void generateDebianChangelog(const ProjectDefinition& proj);
+static void generateDebianSourceFormat(const ProjectDefinition& proj);
+
+extern PackagerOptions gOptions;
 
 
 void    prepareDebian(const ProjectDefinition& project)
 {
+    TraceSpan trace("prepareDebian");
     if (project.qtMajorVersion == QtMajorVersion::Auto|| project.qtMajorVersion == QtMajorVersion::Qt6)
         qmakeExecutable = "qmake6";
     QStringList projectDeps = getModulesList(project);
@@ -63,6 +71,8 @@ void    prepareDebian(const ProjectDefinition& project)
 
     println("Installing debian package creation tools");
     run.run("apt-get", QStringList() << aptGetInstallOptions << "build-essential" << "fakeroot" << "devscripts" << "debhelper");
+    if (project.buildSystem == BuildSystem::CMake)
+        run.run("apt-get", QStringList() << aptGetInstallOptions << "cmake" << "ninja-build");
     println("Installing qt base dev package");
     // lrelease is in a separate package, weird
     if (qmakeExecutable == "qmake6")
@@ -76,9 +86,8 @@ void    prepareDebian(const ProjectDefinition& project)
     }
 }
 
-void    generateDebianFiles(ProjectDefinition& proj)
+void    setDebianDefinition(ProjectDefinition& proj)
 {
-
     if (proj.debianMaintainer.isEmpty())
     {
         proj.debianMaintainer = proj.author;
@@ -88,15 +97,15 @@ void    generateDebianFiles(ProjectDefinition& proj)
         proj.debianMaintainerMail = proj.authorMail;
     }
     proj.debianPackageName = proj.name.toLower().replace(' ', '-');
-    QString lreleaseExecutable = "/usr/lib/qt5/bin/lrelease";
-    setQMakeVersion(proj);
-    if (qmakeExecutable == "qmake6")
-    {
-        lreleaseExecutable = "/usr/lib/qt6/bin/lrelease";
-    }
+    println("Trying to detect Qt major version installed via qmake (or qmake6)");
+    qmakeExecutable = findQMake(proj);
+}
 
-    QString debianVersion = getDebianVersion(proj);
-    debianVersion += "-1";
+void    generateDebianFiles(ProjectDefinition& proj)
+{
+    TraceSpan trace("generateDebianFiles");
+
+    setDebianDefinition(proj);
     QDir debDir(proj.basePath + "/debian");
     if (debDir.exists() == false)
     {
@@ -105,13 +114,40 @@ void    generateDebianFiles(ProjectDefinition& proj)
         debDir.mkpath("debian");
         debDir.cd("debian");
     }
- // Changelog
+    generateDebianChangelog(proj);
+    generateDebianSourceFormat(proj);
+    generateDebianRules(proj);
+    generateDebianControl(proj);
+    generateDebianCopyright(proj);
+}
+
+static void generateDebianChangelog(const ProjectDefinition& proj)
+{
+    QString debianVersion = getDebianVersion(proj);
+    debianVersion += "-1";
     println("Creating Changelog");
     Runner run(true);
     run.addEnv("DEBEMAIL", proj.debianMaintainerMail);
     run.addEnv("DEBFULLNAME", proj.debianMaintainer);
     run.runWithOut("dch", QStringList() << "--create" << "-v" << debianVersion << "--package" << proj.debianPackageName << "Initial release generated with SQPackager", proj.basePath);
     // Changelog dch --create -v 1.0-1 --package hithere
+    // dch always writes the current time, dpkg takes SOURCE_DATE_EPOCH from this date
+    if (gOptions.reproducible)
+    {
+        QFile changelog(proj.basePath + "/debian/changelog");
+        if (!changelog.open(QIODevice::ReadWrite | QIODevice::Text))
+            error_and_exit("Could not open debian/changelog " + changelog.errorString());
+        QString content = QString::fromUtf8(changelog.readAll());
+        content.replace(QRegularExpression("^( -- .*>  ).*$", QRegularExpression::MultilineOption),
+                        "\\1" + buildDateTime().toString(Qt::RFC2822Date));
+        changelog.resize(0);
+        changelog.seek(0);
+        changelog.write(content.toUtf8());
+    }
+}
+
+static void generateDebianSourceFormat(const ProjectDefinition& proj)
+{
     println("Creating compat file");
     QFile compatFile(proj.basePath + "/debian/compat");
     if (!compatFile.open(QIODevice::WriteOnly | QIODevice::Text))
@@ -121,7 +157,7 @@ void    generateDebianFiles(ProjectDefinition& proj)
     compatFile.write("10\n");
     compatFile.close();
     println("Creating source/format file");
-    debDir.mkpath("source");
+    QDir(proj.basePath + "/debian").mkpath("source");
     QFile formatFile(proj.basePath + "/debian/source/format");
     if (!formatFile.open(QIODevice::WriteOnly | QIODevice::Text))
     {
@@ -129,8 +165,15 @@ void    generateDebianFiles(ProjectDefinition& proj)
     }
     formatFile.write("3.0 (quilt)\n");
     formatFile.close();
+}
 
- // rules file
+void    generateDebianRules(const ProjectDefinition& proj)
+{
+    QString lreleaseExecutable = "/usr/lib/qt5/bin/lrelease";
+    if (qmakeExecutable == "qmake6")
+    {
+        lreleaseExecutable = "/usr/lib/qt6/bin/lrelease";
+    }
     println("Creating rules file");
     QFile ruleFile(proj.basePath + "/debian/rules");
     if (!ruleFile.open(QIODevice::WriteOnly | QIODevice::Text))
@@ -152,6 +195,14 @@ void    generateDebianFiles(ProjectDefinition& proj)
     //defines_option += "DEFINES+='" + CompileDefines::unix_install_prefix + "=\\\\\\\"/usr/\\\\\\\"' ";
     //defines_option += "DEFINES+='" + CompileDefines::unix_install_share_path + "=\\\\\\\"/usr/share/" + proj.unixNormalizedName + "\\\\\\\"' ";
     map["QMAKE_OPTIONS"] = defines_option +  " CONFIG+=\\'debug\\'";
+    map["TRANSLATION_SOURCES"] = map["PRO_FILE"];
+    setBuildSystemMapping(proj, map);
+    if (proj.buildSystem == BuildSystem::CMake)
+    {
+        // dh_strip keeps the debug symbols apart like CONFIG+=debug does for qmake
+        map["CMAKE_OPTIONS"] = defines_option + " -DCMAKE_BUILD_TYPE=RelWithDebInfo";
+        map["TRANSLATION_SOURCES"] = proj.translationDir + "/*.ts";
+    }
     if (proj.translationDir.isEmpty() == false)
     {
         map["HAS_TRANSLATIONS"] = "yes";
@@ -159,16 +210,17 @@ void    generateDebianFiles(ProjectDefinition& proj)
     QString rules = useTemplateFile(":/debian/rules_template.tt", map);
     ruleFile.write(rules.toLocal8Bit());
     ruleFile.close();
+}
 
- // Control
+void    generateDebianControl(const ProjectDefinition& proj)
+{
     println("Creating control file");
     QFile controlFile(proj.basePath + "/debian/control");
     if (!controlFile.open(QIODevice::WriteOnly | QIODevice::Text))
     {
         error_and_exit("Could not open debian/control" + controlFile.errorString());
     }
-    map.clear();
-
+    QMap<QString, QString> map;
  // control File
     map["SOURCE_NAME"] = proj.debianPackageName;
     map["PACKAGE_NAME"] = proj.debianPackageName;
@@ -176,6 +228,7 @@ void    generateDebianFiles(ProjectDefinition& proj)
     map["MAINTAINER_MAIL"] = proj.debianMaintainerMail;
     map["SHORT_DESCRIPTION"] = proj.shortDescription;
     map["QT_BASE_DEV"] = "qtbase5-dev";
+    map["BUILD_TOOLS"] = proj.buildSystem == BuildSystem::CMake ? "cmake, ninja-build, " : "";
     if (qmakeExecutable == "qmake6")
     {
         map["QT_BASE_DEV"] = "qt6-base-dev";
@@ -213,12 +266,16 @@ void    generateDebianFiles(ProjectDefinition& proj)
     QString control = useTemplateFile(":/debian/control_template.tt", map);
     controlFile.write(control.toLocal8Bit());
     controlFile.close();
+}
+
+void    generateDebianCopyright(const ProjectDefinition& proj)
+{
     QFile copyrightFile(proj.basePath + "/debian/copyright");
     if (!copyrightFile.open(QIODevice::WriteOnly | QIODevice::Text))
     {
         error_and_exit("Could not open debian/copyright" + copyrightFile.errorString());
     }
-    map.clear();
+    QMap<QString, QString> map;
     map["SOURCE_URL"] = "";
     map["PROJECT_NAME"] = proj.name;
     map["AUTHOR"] = proj.author;
@@ -226,7 +283,7 @@ void    generateDebianFiles(ProjectDefinition& proj)
     map["LICENSE_NAME"] = proj.licenseName;
     map["DEBIAN_AUTHOR"] = proj.debianMaintainer;
     map["DEBIAN_MAIL"] = proj.debianMaintainerMail;
-    map["CURRENT_YEAR"] = QString::number(QDateTime::currentDateTime().date().year());
+    map["CURRENT_YEAR"] = QString::number(buildDateTime().date().year());
     map["TARGET_NAME"] = proj.targetName;
 
     println("Creating copyright file");
@@ -280,6 +337,7 @@ bool    checkDebian(const ProjectDefinition& proj)
 
 void    buildDebian(const ProjectDefinition& project)
 {
+    TraceSpan trace("buildDebian");
     QString projectBasePath = project.basePath;
     QString subDir = "";
     if (project.projectBasePath != project.basePath)
@@ -290,9 +348,19 @@ void    buildDebian(const ProjectDefinition& project)
     }
     QString debianVersion = getDebianVersion(project);
     QString debianNormalizedName = project.debianPackageName + "_" + debianVersion;
+    const QString qmake = project.qtMajorVersion == QtMajorVersion::Qt5 ? "qmake" : "qmake6";
+    const QByteArray cacheKey = artifactCacheKey(project, "debian", toolIdentity("dpkg", QStringList() << "--print-architecture")
+                                                 + " " + toolIdentity("gcc", QStringList() << "--version")
+                                                 + " Qt " + toolIdentity(qmake, QStringList() << "-query" << "QT_VERSION"));
+    if (restoreCachedArtifacts(project, cacheKey))
+        return ;
+    const int firstArtifact = registeredArtifactCount();
     Runner  run(true);
+    QElapsedTimer timer;
+    timer.start();
     QString archive = createArchive(project);
     QFileInfo fiArchive(archive);
+    registerArtifact("debian", "orig-tarball", archive, timer.elapsed());
 
     //println("Copying project files into another directory");
     QString tmpSqpackager = "/tmp/sqpackager/";
@@ -305,26 +373,30 @@ void    buildDebian(const ProjectDefinition& project)
     //debuild --no-tgz-check -us -uc -b
     //run.runWithOut("ls", QStringList() << "-l" << tmpPath);
     println("Building the .deb package");
-    bool ok = run.runWithOut("debuild", QStringList() << "-us" << "-uc", tmpPath + "/" + subDir);
+    // debuild forward -j to dpkg-buildpackage that set parallel=N in DEB_BUILD_OPTIONS for dh
+    QElapsedTimer buildTimer;
+    buildTimer.start();
+    bool ok = run.runWithOut("debuild", QStringList() << "-us" << "-uc" << "-j" + QString::number(gOptions.jobs), tmpPath + "/" + subDir);
     if (!ok)
     {
         error_and_exit("Failed to build the debian package");
     }
-    if (isGithubAction())
+    // dpkg-buildpackage puts the packages next to the source directory
+    QDir packageDir(tmpPath + "/" + subDir);
+    packageDir.cdUp();
+    static const QRegularExpression debExp("^[^_]+_[^_]+_([^_]+)\\.deb$");
+    QStringList debs;
+    for (const QString& deb : packageDir.entryList(QStringList() << project.debianPackageName + "_*.deb", QDir::Files))
     {
-        QThread::sleep(1);
-        println("Inside GitHub Action environement, adding the debian package as output");
-        run.run("uname", QStringList() << "-m");
-        QString arch = run.getStdout().trimmed();
-        QString buildArch = "";
-        if (arch == "x86_64")
-            buildArch = "amd64";
-        println("Finding the package version");
-        //dpkg-parsechangelog -S version
-        run.run("dpkg-parsechangelog", QStringList() << "-l" << tmpPath + "/debian/changelog" << "-S" << "version");
-        QString packageVersion = run.getStdout().trimmed();
-        addGithubOutput("spackager_" + buildArch + "_deb", QString("/tmp/%1_%2_%3.deb").arg(project.debianPackageName, packageVersion, buildArch));
+        QString buildArch = debExp.match(deb).captured(1);
+        registerArtifact("debian", "deb", packageDir.filePath(deb), buildTimer.elapsed(), "spackager_" + buildArch + "_deb");
+        debs << packageDir.filePath(deb);
     }
+    if (debs.isEmpty())
+        logMessage(LogLevel::Warning, "Warning : no " + project.debianPackageName + " package found in " + packageDir.absolutePath() + "\n");
+    else
+        printSummary("Debian package created : " + debs.join(", "));
+    storeCachedArtifacts(project, cacheKey, firstArtifact);
 }
 
 // [epoch:]upstream_version[-debian_revision]
@@ -369,28 +441,6 @@ QString getDebianVersion(const ProjectDefinition& proj)
     return debVersion;
 }
 
-static void setQMakeVersion(const ProjectDefinition& project)
-{
-    println("Trying to detect Qt major version installed via qmake (or qmake6)");
-    if (project.qtMajorVersion == QtMajorVersion::Qt6)
-    {
-        qmakeExecutable = "qmake6";
-        return ;
-    }
-    if (project.qtMajorVersion == QtMajorVersion::Auto)
-    {
-        println("No Qt major version provided, detecting qmake executable");
-        Runner testqmake;
-        bool ok = testqmake.run("qmake6", QStringList() << "--version");
-        if (ok)
-        {
-            qmakeExecutable = "qmake6";
-        } else {
-            println("\tqmake6 executable not found, falling back to qmake");
-        }
-    }
-}
-
 QStringList getModulesList(const ProjectDefinition& project)
 {
     QStringList modulesDepend;
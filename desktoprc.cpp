@@ -3,8 +3,13 @@
 #include <desktoprc.h>
 #include <basestuff.h>
 #include <print.h>
-#include <runner.h>
+#include <imageinfo.h>
 #include <QFileInfo>
+#include <QDir>
+#include <QImageReader>
+#include <QAtomicInt>
+#include <QtConcurrent>
+#include <trace.h>
 
 const QStringList defaultCategories = {
     "AudioVideo",
@@ -26,6 +31,41 @@ const QList<int> hicolorIconSize = {
     8, 16, 22, 24, 32, 36, 42, 48, 64, 72, 96, 128, 192, 256, 512
 };
 
+// Sizes generated from the source icon, smaller ones are not worth it
+static const int minGeneratedIconSize = 16;
+static const QString generatedIconsDirName = "sqpackager_icons";
+static const QString generatedIconsStampName = "source.sha256";
+
+/*
+ * Return an empty string if the icon is usable for the hicolor theme
+ */
+static QString  iconError(const ProjectDefinition& proj, QSize& size)
+{
+    const QString iconFile = proj.desktopIcon.isEmpty() ? proj.icon : proj.desktopIcon;
+    QString error;
+    size = readImageSize(proj.basePath + "/" + iconFile, &error);
+    if (!size.isValid())
+        return "Could not read the size of the desktop icon file " + iconFile + " : " + error;
+    if (size.width() != size.height())
+        return "Icon must be square (the height and width must be equals)";
+    // Every hicolor size up to the icon size is generated, a SVG icon is installed as scalable
+    if (QFileInfo(iconFile).suffix().toLower() != "svg" && size.width() < minGeneratedIconSize)
+        return QString("Icon must be at least %1x%1, a 512x512 icon is recommended").arg(minGeneratedIconSize);
+    return QString();
+}
+
+static bool checkIcon(const ProjectDefinition& proj)
+{
+    QSize size;
+    QString error = iconError(proj, size);
+    if (!error.isEmpty())
+    {
+        println(error);
+        return false;
+    }
+    return true;
+}
+
 bool    checkDesktopRC(const ProjectDefinition& proj, bool bypass)
 {
     if (!bypass &&
@@ -39,13 +79,13 @@ bool    checkDesktopRC(const ProjectDefinition& proj, bool bypass)
             if (!proj.icon.isEmpty())
             {
                 println("The project description does not specify the icon file name for the desktop file <desktop-icon> field. Assusming <icon> is the desktop icon");
-                return true;
+                return checkIcon(proj);
             } else {
                 println("The project description does not specify any <icon> or <desktop-icon>. One of this field is needed even whith a provided .desktop file since it's need to be able to install the write file");
                 return false;
             }
         }
-        return true;
+        return checkIcon(proj);
     }
     println("Checking if the project description file fill the requierment to generate a valid .desktop file");
     bool toret = true;
@@ -69,11 +109,17 @@ bool    checkDesktopRC(const ProjectDefinition& proj, bool bypass)
             println("Using the <icon> entry as desktop icon, you can specify a <desktop-icon> if you want a specific other icon");
         }
     }
+    if (!proj.desktopIcon.isEmpty() || !proj.icon.isEmpty())
+    {
+        if (!checkIcon(proj))
+            toret = false;
+    }
     return toret;
 }
 
 void    setDesktopRC(ProjectDefinition& proj)
 {
+    TraceSpan trace("setDesktopRC");
     println("Setting up .desktop");
     if (!proj.desktopFile.isEmpty())
     {
@@ -82,6 +128,7 @@ void    setDesktopRC(ProjectDefinition& proj)
         QFileInfo fi(proj.basePath + "/" + proj.desktopIcon);
         proj.desktopIconNormalizedName = proj.org + "." + proj.unixNormalizedName + "." + fi.suffix();
         setIconSize(proj);
+        generateHicolorIcons(proj);
         return ;
     }
     if (proj.desktopIcon.isEmpty())
@@ -89,6 +136,7 @@ void    setDesktopRC(ProjectDefinition& proj)
     QFileInfo fi(proj.basePath + "/" + proj.desktopIcon);
     proj.desktopIconNormalizedName = proj.org + "." + proj.unixNormalizedName + "." + fi.suffix();
     setIconSize(proj);
+    generateHicolorIcons(proj);
     QString file = checkForFile(proj.basePath, QRegularExpression(".+\\.desktop$"));
     //println("Desktop file is : " + file);
     if (!file.isEmpty())
@@ -133,28 +181,109 @@ bool    generateLinuxDesktopRC(ProjectDefinition& proj)
 
 void    setIconSize(ProjectDefinition& proj)
 {
-    Runner run;
-    bool ok = run.run("identify", QStringList() << proj.basePath + "/" + proj.desktopIcon);
-    if (!ok)
-        error_and_exit("Could not run identify on the desktop icon file. Do you have imagemagicks installed?");
-    QStringList plop;
-    for (QByteArray p : run.getStdout().split(' '))
+    QString error = iconError(proj, proj.iconSize);
+    if (!error.isEmpty())
+        error_and_exit("\t" + error);
+}
+
+static QImage  readLargestImage(const QString& path)
+{
+    // ICO files can contains several images, take the biggest one
+    QImageReader reader(path);
+    QImage toret;
+    const int count = qMax(reader.imageCount(), 1);
+    for (int i = 0; i < count; i++)
+    {
+        if (i != 0 && !reader.jumpToImage(i))
+            break;
+        QImage image = reader.read();
+        if (image.width() * image.height() > toret.width() * toret.height())
+            toret = image;
+    }
+    return toret;
+}
+
+void    generateHicolorIcons(ProjectDefinition& proj)
+{
+    TraceSpan trace("generateHicolorIcons");
+    println("Generating hicolor icons");
+    const QString iconFile = proj.basePath + "/" + proj.desktopIcon;
+    proj.generatedIconSizes.clear();
+    proj.generatedIconsDir.clear();
+    if (QFileInfo(iconFile).suffix().toLower() == "svg")
     {
-        plop.append(QString::fromLocal8Bit(p));
+        println("\tThe icon is a SVG file, it will be installed as a scalable icon");
+        return ;
     }
-    proj.iconSize = QSize(plop[2].split("x")[0].toInt(), plop[2].split("x")[1].toInt());
-    if (proj.iconSize.width() != proj.iconSize.height())
+    for (int size : hicolorIconSize)
     {
-        error_and_exit("\tIcon must be square (the height and width must be equals");
+        if (size >= minGeneratedIconSize && size <= proj.iconSize.width())
+            proj.generatedIconSizes.append(size);
     }
-    if (hicolorIconSize.contains(proj.iconSize.width()) == false)
+    if (proj.iconSize.width() < hicolorIconSize.last())
+        println(QString("\tThe icon is only %1x%1, bigger sizes will not be generated").arg(proj.iconSize.width()));
+    proj.generatedIconsDir = generatedIconsDirName;
+    const QString outputDir = proj.basePath + "/" + generatedIconsDirName;
+    const QString iconName = generatedIconName(proj);
+
+    // The stamp is the hash of the source icon with the generated sizes and name, on warm builds only the source is read
+    QStringList sizesStr;
+    for (int size : proj.generatedIconSizes)
+        sizesStr.append(QString::number(size));
+    const QByteArray stamp = hashFile(iconFile) + " " + sizesStr.join(",").toLatin1() + " " + iconName.toUtf8();
+    QFile stampFile(outputDir + "/" + generatedIconsStampName);
+    if (stampFile.open(QIODevice::ReadOnly) && stampFile.readAll() == stamp)
     {
-        QString sizeStr;
-        for (int size : hicolorIconSize)
+        bool complete = true;
+        for (int size : proj.generatedIconSizes)
+            complete = complete && QFileInfo::exists(QString("%1/%2x%2/apps/%3").arg(outputDir).arg(size).arg(iconName));
+        if (complete)
         {
-            sizeStr += QString("%1x%1 ").arg(size);
+            println("\tHicolor icons are up to date in " + generatedIconsDirName);
+            return ;
         }
-        error_and_exit("\tDefault hicolor theme only support these size :" + sizeStr);
     }
+    stampFile.close();
+
+    QDir(outputDir).removeRecursively();
+    QImage source = readLargestImage(iconFile);
+    if (source.isNull())
+        error_and_exit("Could not load the icon file " + iconFile);
+    // Premultiplied alpha avoid dark fringes when averaging transparent pixels
+    source = source.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+    QAtomicInt failed(0);
+    QtConcurrent::blockingMap(proj.generatedIconSizes, [&](int size) {
+        const QString sizeDir = QString("%1/%2x%2/apps").arg(outputDir).arg(size);
+        QImage icon = source.width() == size ? source : source.scaled(size, size, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+        if (!QDir().mkpath(sizeDir) || !icon.save(sizeDir + "/" + iconName, "PNG"))
+            failed.storeRelease(size);
+    });
+    if (failed.loadAcquire() != 0)
+        error_and_exit(QString("Could not write the %1x%1 icon in %2").arg(failed.loadAcquire()).arg(outputDir));
+    if (!stampFile.open(QIODevice::WriteOnly))
+        error_and_exit("Could not write the icon cache stamp : " + stampFile.errorString());
+    stampFile.write(stamp);
+    stampFile.close();
+    println(QString("\tGenerated %1 hicolor icon sizes in %2").arg(proj.generatedIconSizes.size()).arg(generatedIconsDirName));
+}
+
+QString generatedIconName(const ProjectDefinition& proj)
+{
+    return QFileInfo(proj.desktopIconNormalizedName).completeBaseName() + ".png";
+}
 
+void    setIconMapping(const ProjectDefinition& proj, QMap<QString, QString>& mapping)
+{
+    if (!proj.generatedIconSizes.isEmpty())
+    {
+        QStringList sizes;
+        for (int size : proj.generatedIconSizes)
+            sizes.append(QString("%1x%1").arg(size));
+        mapping["HAS_HICOLOR_ICONS"] = "";
+        mapping["HICOLOR_ICON_SIZES"] = sizes.join(" ");
+        mapping["HICOLOR_ICONS_DIR"] = proj.generatedIconsDir;
+        mapping["HICOLOR_ICON_NAME"] = generatedIconName(proj);
+    } else {
+        mapping["HAS_SCALABLE_ICON"] = "";
+    }
 }
@@ -1,8 +1,12 @@
 #pragma once
 
+#include <QMap>
 #include <projectdefinition.h>
 
 bool    checkDesktopRC(const ProjectDefinition& proj, bool bypass = false);
 bool    generateLinuxDesktopRC(ProjectDefinition& proj);
 void    setDesktopRC(ProjectDefinition& proj);
 void    setIconSize(ProjectDefinition& proj);
+void    generateHicolorIcons(ProjectDefinition& proj);
+QString generatedIconName(const ProjectDefinition& proj);
+void    setIconMapping(const ProjectDefinition& proj, QMap<QString, QString>& mapping);
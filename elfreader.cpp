@@ -0,0 +1,209 @@
+#include <QFile>
+#include <QtEndian>
+#include <cstring>
+#include <elfreader.h>
+
+// Values from the ELF specification, we don't want to depend on the system <elf.h>
+enum ElfConstants {
+    ElfClass32 = 1,
+    ElfClass64 = 2,
+    ElfDataLittleEndian = 1,
+    PtLoad = 1,
+    PtDynamic = 2,
+    DtNull = 0,
+    DtNeeded = 1,
+    DtStrtab = 5,
+    DtSoname = 14,
+    DtRpath = 15,
+    DtRunpath = 29
+};
+
+struct LoadSegment
+{
+    quint64 vaddr;
+    quint64 offset;
+    quint64 filesz;
+};
+
+class ElfReader
+{
+public:
+    ElfReader(const uchar* data, qint64 size, bool is64)
+        : m_data(data), m_size(size), m_is64(is64)
+    {
+    }
+    bool    inBounds(quint64 offset, quint64 size) const
+    {
+        return offset <= quint64(m_size) && size <= quint64(m_size) - offset;
+    }
+    quint16 half(quint64 offset) const
+    {
+        return qFromLittleEndian<quint16>(m_data + offset);
+    }
+    quint32 word(quint64 offset) const
+    {
+        return qFromLittleEndian<quint32>(m_data + offset);
+    }
+    // Address/offset/xword sized value depending on the class
+    quint64 addr(quint64 offset) const
+    {
+        return m_is64 ? qFromLittleEndian<quint64>(m_data + offset) : word(offset);
+    }
+    qint64  signedAddr(quint64 offset) const
+    {
+        return m_is64 ? qFromLittleEndian<qint64>(m_data + offset) : qint32(word(offset));
+    }
+    QByteArray  string(quint64 offset) const
+    {
+        if (offset >= quint64(m_size))
+            return QByteArray();
+        const char* start = reinterpret_cast<const char*>(m_data + offset);
+        return QByteArray(start, qstrnlen(start, m_size - offset));
+    }
+private:
+    const uchar*    m_data;
+    qint64          m_size;
+    bool            m_is64;
+};
+
+static qint64  vaddrToOffset(const QList<LoadSegment>& segments, quint64 vaddr)
+{
+    for (const LoadSegment& segment : segments)
+    {
+        if (vaddr >= segment.vaddr && vaddr - segment.vaddr < segment.filesz)
+            return vaddr - segment.vaddr + segment.offset;
+    }
+    return -1;
+}
+
+ElfInfo readElfInfo(const QString& path)
+{
+    ElfInfo info;
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly) || file.size() < 52)
+        return info;
+    const uchar* data = file.map(0, file.size());
+    if (data == nullptr)
+        return info;
+    if (memcmp(data, "\x7f" "ELF", 4) != 0 || data[5] != ElfDataLittleEndian
+        || (data[4] != ElfClass32 && data[4] != ElfClass64))
+        return info;
+    info.is64 = data[4] == ElfClass64;
+    ElfReader reader(data, file.size(), info.is64);
+    if (info.is64 && !reader.inBounds(0, 64))
+        return info;
+    info.machine = reader.half(18);
+    // Offsets in the ELF header depend on the class
+    const quint64 phoff = reader.addr(info.is64 ? 32 : 28);
+    const quint16 phentsize = reader.half(info.is64 ? 54 : 42);
+    const quint16 phnum = reader.half(info.is64 ? 56 : 44);
+    // The fields read below are in the first bytes of a program header, a smaller entry would overlap the next one
+    const quint64 phMinimumSize = info.is64 ? 56 : 32;
+    if (phnum != 0 && phentsize < phMinimumSize)
+        return info;
+    if (!reader.inBounds(phoff, quint64(phentsize) * phnum))
+        return info;
+
+    QList<LoadSegment> loads;
+    quint64 dynamicOffset = 0;
+    quint64 dynamicSize = 0;
+    for (quint16 i = 0; i < phnum; i++)
+    {
+        const quint64 ph = phoff + quint64(i) * phentsize;
+        if (!reader.inBounds(ph, phMinimumSize))
+            return info;
+        const quint32 type = reader.word(ph);
+        LoadSegment segment;
+        if (info.is64)
+        {
+            segment.offset = reader.addr(ph + 8);
+            segment.vaddr = reader.addr(ph + 16);
+            segment.filesz = reader.addr(ph + 32);
+        } else {
+            segment.offset = reader.word(ph + 4);
+            segment.vaddr = reader.word(ph + 8);
+            segment.filesz = reader.word(ph + 16);
+        }
+        if (type == PtLoad)
+            loads.append(segment);
+        if (type == PtDynamic)
+        {
+            dynamicOffset = segment.offset;
+            dynamicSize = segment.filesz;
+        }
+    }
+    info.valid = true;
+    // Static executable
+    if (dynamicSize == 0 || !reader.inBounds(dynamicOffset, dynamicSize))
+        return info;
+
+    const quint64 entrySize = info.is64 ? 16 : 8;
+    quint64 strtabAddr = 0;
+    QList<quint64> neededOffsets;
+    qint64  sonameOffset = -1;
+    qint64  rpathOffset = -1;
+    qint64  runpathOffset = -1;
+    for (quint64 entry = dynamicOffset; entry + entrySize <= dynamicOffset + dynamicSize; entry += entrySize)
+    {
+        const qint64 tag = reader.signedAddr(entry);
+        const quint64 value = reader.addr(entry + entrySize / 2);
+        if (tag == DtNull)
+            break;
+        switch (tag)
+        {
+        case DtNeeded:
+            neededOffsets.append(value);
+            break;
+        case DtStrtab:
+            strtabAddr = value;
+            break;
+        case DtSoname:
+            sonameOffset = value;
+            break;
+        case DtRpath:
+            rpathOffset = value;
+            break;
+        case DtRunpath:
+            runpathOffset = value;
+            break;
+        }
+    }
+    const qint64 strtab = vaddrToOffset(loads, strtabAddr);
+    if (strtab < 0)
+    {
+        info.valid = false;
+        return info;
+    }
+    for (quint64 offset : neededOffsets)
+        info.needed.append(QString::fromUtf8(reader.string(strtab + offset)));
+    if (sonameOffset >= 0)
+        info.soname = QString::fromUtf8(reader.string(strtab + sonameOffset));
+    // DT_RPATH is ignored by the loader when DT_RUNPATH is present
+    qint64 pathOffset = runpathOffset >= 0 ? runpathOffset : rpathOffset;
+    if (pathOffset >= 0)
+    {
+        QByteArray runpath = reader.string(strtab + pathOffset);
+        info.hasRunpathTag = true;
+        info.runpathOffset = strtab + pathOffset;
+        info.runpathSize = runpath.size();
+        info.runpath = QString::fromUtf8(runpath).split(':', Qt::SkipEmptyParts);
+    }
+    return info;
+}
+
+/*
+ * The string table can't grow without rewriting the whole file, but we can reuse
+ * the space of the existing runpath string if the new one is not longer
+ */
+bool        setElfRunpathInPlace(const QString& path, const ElfInfo& info, const QString& runpath)
+{
+    const QByteArray newRunpath = runpath.toUtf8();
+    if (!info.valid || !info.hasRunpathTag || newRunpath.size() > info.runpathSize)
+        return false;
+    QFile file(path);
+    if (!file.open(QIODevice::ReadWrite) || !file.seek(info.runpathOffset))
+        return false;
+    QByteArray padded = newRunpath;
+    padded.append(QByteArray(info.runpathSize - newRunpath.size(), '\0'));
+    return file.write(padded) == padded.size();
+}
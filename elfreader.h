@@ -0,0 +1,24 @@
+#pragma once
+
+#include <QString>
+#include <QStringList>
+
+/*
+ * This only read what is needed to resolve the shared library dependencies of an ELF object
+ * and to change its runpath in place
+ */
+struct ElfInfo
+{
+    bool        valid = false;
+    bool        is64 = false;
+    quint16     machine = 0;
+    QString     soname;
+    QStringList needed;
+    QStringList runpath; // DT_RUNPATH, or DT_RPATH when there is no DT_RUNPATH
+    bool        hasRunpathTag = false;
+    qint64      runpathOffset = -1; // File offset of the runpath string
+    qint64      runpathSize = 0; // Size available in place for the runpath string
+};
+
+ElfInfo     readElfInfo(const QString& path);
+bool        setElfRunpathInPlace(const QString& path, const ElfInfo& info, const QString& runpath);
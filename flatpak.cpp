@@ -6,15 +6,32 @@
 #include "print.h"
 #include "runner.h"
 #include <QDir>
+#include <QSet>
+#include <QSysInfo>
+#include <QVersionNumber>
+#include <QRegularExpression>
+#include <QProcessEnvironment>
+#include <QElapsedTimer>
 #include <desktoprc.h>
+#include <sqpackager.h>
+#include <sourcetree.h>
+#include <buildsystem.h>
+#include <trace.h>
+#include <artifacts.h>
+#include <cache.h>
+#include <reproducible.h>
 
 
-static QString kdeSdkVersion = "org.kde.Sdk/x86_64/5.15-22.08";
-static QString plateformSdk = "org.kde.Platform/x86_64/5.15-22.08";
+// Used when no compatible KDE runtime is installed locally, flatpak-builder will have to download it
+static const QString defaultKdeQt5Version = "5.15-22.08";
+static const QString defaultKdeQt6Version = "6.4";
 
 static void    generateFlatPakBuildAndInstall(const ProjectDefinition& project);
+static QString findKdeRuntimeVersion(QtMajorVersion qtVersion);
 
-bool    checkFlatPak(const ProjectDefinition project, bool bypass)
+extern PackagerOptions gOptions;
+
+bool    checkFlatPak(const ProjectDefinition& project, bool bypass)
 {
     const QString flatpakExpectFileName = project.basePath + "/" + project.org + "." + project.name;
     if (!bypass &&
@@ -43,6 +60,7 @@ bool    checkFlatPak(const ProjectDefinition project, bool bypass)
 
 void    generateFlatPakFile(ProjectDefinition& project)
 {
+    TraceSpan trace("generateFlatPakFile");
     QString fullName = project.org + "." + project.name;
     QString projectBasePath = project.basePath;
     project.flatpakName = fullName;
@@ -57,21 +75,41 @@ void    generateFlatPakFile(ProjectDefinition& project)
         projectBasePath = project.projectBasePath;
         mapping["SUBDIR"] = "subdir: " + project.basePath.mid(project.projectBasePath.size() + 1);
     }
-    //TODO maybe run flatpak search? for Qt versions
-    if (project.qtMajorVersion == QtMajorVersion::Qt5)
-    {
-        mapping["KDE_SDK_VERSION"] = "5.15-22.08";
-    }
-    if (project.qtMajorVersion == QtMajorVersion::Qt6 || project.qtMajorVersion == QtMajorVersion::Auto)
-    {
-        kdeSdkVersion = "org.kde.Sdk/x86_64/6.4";
-        plateformSdk = "org.kde.Plateform/x86_64/6.4";
-        mapping["KDE_SDK_VERSION"] = "6.4";
-    }
+    mapping["KDE_SDK_VERSION"] = findKdeRuntimeVersion(project.qtMajorVersion);
     if (isSubDir)
         mapping["PROJECT_PATH"] = project.projectBasePath;
     else
         mapping["PROJECT_PATH"] = project.basePath;
+    // Without a skip list flatpak-builder copy the whole project dir, build outputs and .git included
+    SourceSnapshot snapshot = sourceSnapshot(mapping["PROJECT_PATH"]);
+    println(QString("Flatpak source snapshot : %1 files, %2 skipped entries").arg(snapshot.files.size()).arg(snapshot.skipped.size()));
+    /*
+     * The build outputs usually don't exist yet when the manifest is generated, the static names are
+     * always skipped. flatpak-builder has no patterns, the wildcard ones can only be given as the
+     * matching entries found now and the bundle we write.
+     */
+    QStringList outputs;
+    for (const QString& exclude : sourceTreeExcludes)
+    {
+        if (!exclude.contains('*'))
+            outputs << exclude;
+    }
+    outputs << project.name + ".flatpak";
+    // The skip paths are relative to the source dir, the outputs are next to sqproject.json
+    QStringList skipped;
+    for (const QString& output : outputs)
+    {
+        skipped << output;
+        if (isSubDir)
+            skipped << project.basePath.mid(project.projectBasePath.size() + 1) + "/" + output;
+    }
+    skipped << snapshot.skipped;
+    skipped.removeDuplicates();
+    QStringList skipLines;
+    for (const QString& skip : skipped)
+        skipLines.append("           - \"" + skip + "\"");
+    mapping["HAS_SOURCE_SKIP"] = "";
+    mapping["SOURCE_SKIP"] = skipLines.join("\n");
     mapping["BINARY_NAME"] = project.name; // TODO check this
     mapping["FLATPACK_FILE_PERM"] = project.flatpakFilesystemPermission.isEmpty() ? "xdg-config" : project.flatpakFilesystemPermission;
     QFile manifest(project.basePath + "/" + fullName + ".yml");
@@ -87,8 +125,92 @@ void    generateFlatPakFile(ProjectDefinition& project)
     manifest.close();
 }
 
+static QString flatpakArch()
+{
+    const QString arch = QSysInfo::currentCpuArchitecture();
+    if (arch == "arm64")
+        return "aarch64";
+    if (arch == "i386")
+        return "i386";
+    return "x86_64";
+}
+
+/*
+ * The runtime a flatpak installation knows are either deployed in <installation>/runtime/<name>/<arch>/<branch>/active
+ * or only pulled as ostree refs in <installation>/repo/refs/remotes/<remote>/runtime/<name>/<arch>/<branch>
+ */
+static QStringList flatpakInstallations()
+{
+    const QProcessEnvironment env = QProcessEnvironment::systemEnvironment();
+    QStringList toret;
+    toret << env.value("FLATPAK_SYSTEM_DIR", "/var/lib/flatpak");
+    toret << env.value("FLATPAK_USER_DIR", QDir::homePath() + "/.local/share/flatpak");
+    return toret;
+}
+
+static QSet<QString> installedRuntimeBranches(const QString& runtime)
+{
+    const QString arch = flatpakArch();
+    QSet<QString> branches;
+    for (const QString& installation : flatpakInstallations())
+    {
+        QDir deployDir(installation + "/runtime/" + runtime + "/" + arch);
+        for (const QString& branch : deployDir.entryList(QDir::Dirs | QDir::NoDotAndDotDot))
+        {
+            if (QFileInfo::exists(deployDir.filePath(branch + "/active")))
+                branches.insert(branch);
+        }
+        QDir remotesDir(installation + "/repo/refs/remotes");
+        for (const QString& remote : remotesDir.entryList(QDir::Dirs | QDir::NoDotAndDotDot))
+        {
+            QDir refDir(remotesDir.filePath(remote + "/runtime/" + runtime + "/" + arch));
+            for (const QString& branch : refDir.entryList(QDir::Files))
+                branches.insert(branch);
+        }
+    }
+    return branches;
+}
+
+/*
+ * KDE runtime branches are named after the Qt version : 5.15-22.08 for Qt5 (the suffix is the KDE release)
+ * and 6.4, 6.5... for Qt6. We need both the Sdk and the Platform to be installed
+ * This only lists a few directories, it is done again each time so a runtime installed during --watch is seen
+ */
+static QString findKdeRuntimeVersion(QtMajorVersion qtVersion)
+{
+    println("Searching for installed KDE flatpak runtimes");
+    const bool qt5 = qtVersion == QtMajorVersion::Qt5;
+    const QRegularExpression branchExp(qt5 ? "^5\\.15-(\\d+\\.\\d+)$" : "^(6\\.\\d+)$");
+    QSet<QString> compatible = installedRuntimeBranches("org.kde.Sdk");
+    compatible.intersect(installedRuntimeBranches("org.kde.Platform"));
+    QString picked;
+    QVersionNumber pickedVersion;
+    for (const QString& branch : compatible)
+    {
+        auto match = branchExp.match(branch);
+        if (!match.hasMatch())
+            continue;
+        QVersionNumber version = QVersionNumber::fromString(match.captured(1));
+        println("\tFound org.kde.Sdk and org.kde.Platform " + branch);
+        if (picked.isEmpty() || version > pickedVersion)
+        {
+            picked = branch;
+            pickedVersion = version;
+        }
+    }
+    if (picked.isEmpty())
+    {
+        picked = qt5 ? defaultKdeQt5Version : defaultKdeQt6Version;
+        println("\tNo compatible KDE runtime installed, using " + picked + " that will need to be installed");
+    } else {
+        println("\tUsing KDE runtime " + picked);
+    }
+    return picked;
+}
+
 void    generateFlatPakBuildAndInstall(const ProjectDefinition& project)
 {
+    TraceSpan trace("generateFlatPakBuildAndInstall");
     println("Generating Build and Install script for flatpak");
     QMap<QString, QString> mapping;
     QString fullName = project.flatpakName;
@@ -96,12 +218,17 @@ void    generateFlatPakBuildAndInstall(const ProjectDefinition& project)
     mapping["PROJECT_TARGET"] = project.targetName;
     mapping["FLATPAK_TARGET"] = project.targetName;
     mapping["PROJECT_ICON_FILE"] = project.desktopIcon;
-    QFileInfo fi(project.basePath + "/" + project.desktopIcon);
-    mapping["FLATPAK_ICON_FILENAME"] = project.org + "." + project.name + "." + fi.suffix();
     mapping["DESKTOP_FILE"] = project.desktopFile;
     mapping["FLATPAK_DESKTOP_FILE"] = fullName + "." + "desktop";
     mapping["FLATPAK_ICON_BASENAME"] = fullName;
-    mapping["ICON_SIZE"] = QString("%1x%2").arg(project.iconSize.width()).arg(project.iconSize.height());
+    setIconMapping(project, mapping);
+    mapping["JOBS"] = QString::number(gOptions.jobs);
+    setBuildSystemMapping(project, mapping);
+    if (project.buildSystem == BuildSystem::CMake)
+    {
+        mapping["CMAKE_DEFINES"] = cmakeDefinitions(QStringList() << "SQPROJECT_LINUX_INSTALL" << "SQPROJECT_FLATPAK_BUILD"
+                                                    << "SQPROJECT_INSTALL_PREFIX=/app/").trimmed();
+    }
     QFile buildFile(project.basePath + "/flatpak_sqpackager_build.sh");
     if (!buildFile.open(QIODevice::WriteOnly | QIODevice::Text))
     {
@@ -122,19 +249,139 @@ void    generateFlatPakBuildAndInstall(const ProjectDefinition& project)
     println("flatpak_sqpackager_install.sh file genarated");
 }
 
+// This is the modified base64 ostree use for delta names : no padding and _ instead of /
+static QString ostreeDeltaBase64(const QString& commit)
+{
+    QString toret = QByteArray::fromHex(commit.toLatin1()).toBase64(QByteArray::OmitTrailingEquals);
+    return toret.replace('/', '_');
+}
+
+static qint64 staticDeltaSize(const QString& repo, const QString& from, const QString& to)
+{
+    const QString fromB64 = ostreeDeltaBase64(from);
+    QDir deltaDir(repo + "/deltas/" + fromB64.left(2) + "/" + fromB64.mid(2) + "-" + ostreeDeltaBase64(to));
+    if (!deltaDir.exists())
+        return -1;
+    qint64 size = 0;
+    for (const QFileInfo& fi : deltaDir.entryInfoList(QDir::Files))
+        size += fi.size();
+    return size;
+}
+
+/*
+ * The repository is kept between releases, so we can generate static deltas from the
+ * last commits to the new one. Clients updating from one of these commits only download the delta
+ */
+static void    generateStaticDeltas(const ProjectDefinition& project, const QString& repo)
+{
+    TraceSpan trace("generateStaticDeltas");
+    Runner run(true);
+    const QString ref = "app/" + project.flatpakName + "/" + flatpakArch() + "/master";
+    QFile refFile(repo + "/refs/heads/" + ref);
+    if (!refFile.open(QIODevice::ReadOnly))
+        error_and_exit("Can't read the exported ref " + ref + " in " + repo + " : " + refFile.errorString());
+    const QString head = refFile.readAll().trimmed();
+    println("Generating static deltas to " + head.left(12) + " for the last " + QString::number(gOptions.flatpakDeltaDepth) + " commit(s)");
+    QString from = head;
+    QList<QPair<QString, qint64>> deltaSizes;
+    for (int i = 0; i < gOptions.flatpakDeltaDepth; i++)
+    {
+        // ostree rev-parse understand the commit^ parent notation
+        if (!run.run("ostree", QStringList() << "--repo=" + repo << "rev-parse" << from + "^"))
+            break;
+        from = run.getStdout().trimmed();
+        if (staticDeltaSize(repo, from, head) < 0)
+        {
+            bool ok = run.runWithOut("ostree", QStringList() << "--repo=" + repo << "static-delta" << "generate" << "--from=" + from << "--to=" + head);
+            if (!ok)
+                error_and_exit("Failed to generate the static delta from " + from);
+        }
+        deltaSizes.append(qMakePair(from, staticDeltaSize(repo, from, head)));
+    }
+    if (!run.runWithOut("flatpak", QStringList() << "build-update-repo" << repo))
+        error_and_exit("Error with flatpak build-update-repo");
+    if (deltaSizes.isEmpty())
+    {
+        println("\tFirst commit in " + repo + ", no delta to generate");
+        return ;
+    }
+    for (const auto& delta : deltaSizes)
+    {
+        println(QString("\tDelta %1 -> %2 : %3 KiB").arg(delta.first.left(12), head.left(12)).arg(delta.second / 1024));
+    }
+}
+
+/*
+ * In incremental mode the flatpak-builder state dir is kept (module cache and ccache)
+ * and we only export and bundle again if the content of the build actually changed
+ */
 void    buildFlatPak(const ProjectDefinition& project)
 {
+    TraceSpan trace("buildFlatPak");
+    // The runtime and the SDK are given by the manifest, which is part of the sources
+    const QByteArray cacheKey = artifactCacheKey(project, "flatpak", toolIdentity("flatpak", QStringList() << "--version")
+                                                 + " " + toolIdentity("flatpak-builder", QStringList() << "--version"));
+    if (restoreCachedArtifacts(project, cacheKey))
+        return ;
+    const int firstArtifact = registeredArtifactCount();
+    QElapsedTimer timer;
+    timer.start();
     Runner run(true);
     QDir dir(project.basePath + "/flatpak-build-dir");
     if (!dir.exists()) {
         dir.mkdir(".");
     }
+    const QString stateDir = project.basePath + "/.flatpak-builder";
+    const QString exportHashFile = stateDir + "/sqpackager-export-hash";
+    const QString bundleFile = project.name + ".flatpak";
+    QStringList builderArgs;
+    // --force-clean only empty the app dir, unchanged modules are restored from the cache
+    builderArgs << "--force-clean" << "--jobs=" + QString::number(gOptions.jobs);
+    if (gOptions.flatpakIncremental)
+    {
+        println("Incremental flatpak build, keeping the builder state in " + stateDir);
+        builderArgs << "--state-dir=" + stateDir << "--ccache";
+    }
     bool result;
-    result = run.runWithOut("flatpak-builder", QStringList() << "--force-clean" << "flat-build-dir/" << project.flatpakFile, project.basePath);
+    result = run.runWithOut("flatpak-builder", QStringList() << builderArgs << "flat-build-dir/" << project.flatpakFile, project.basePath);
     if (!result)
         error_and_exit("Building flatpak file failed");
-    result = run.runWithOut("flatpak", QStringList() << "build-export" << "flatpak-export" << "flat-build-dir/", project.basePath);
+    QByteArray exportHash;
+    if (gOptions.flatpakIncremental)
+    {
+        exportHash = hashDirectory(project.basePath + "/flat-build-dir");
+        QFile previousHash(exportHashFile);
+        if (QFileInfo::exists(project.basePath + "/" + bundleFile) && previousHash.open(QIODevice::ReadOnly)
+            && previousHash.readAll().trimmed() == exportHash)
+        {
+            println("Flatpak build content did not change (" + exportHash.left(12) + "), skipping export and bundle");
+            printSummary("Flatpak bundle up to date : " + project.basePath + "/" + bundleFile);
+            registerArtifact("flatpak", "bundle", project.basePath + "/" + bundleFile, timer.elapsed(), "sqpackager_flatpak_bundle");
+            storeCachedArtifacts(project, cacheKey, firstArtifact);
+            return ;
+        }
+    }
+    const QString exportRepo = gOptions.flatpakRepo.isEmpty() ? "flatpak-export" : gOptions.flatpakRepo;
+    QStringList exportArgs;
+    exportArgs << "build-export" << exportRepo << "flat-build-dir/";
+    // The file times are already zeroed by ostree, only the commit has a date
+    if (gOptions.reproducible)
+        exportArgs << "--timestamp=" + buildDateTime().toString(Qt::ISODate);
+    result = run.runWithOut("flatpak", exportArgs, project.basePath);
     if (!result)
         error_and_exit("Error with flatpak build-export");
-    run.runWithOut("flatpak", QStringList() << "build-bundle" << "flatpak-export" << project.name + ".flatpak" << project.flatpakName, project.basePath);
+    if (!gOptions.flatpakRepo.isEmpty())
+        generateStaticDeltas(project, QDir(project.basePath).absoluteFilePath(exportRepo));
+    result = run.runWithOut("flatpak", QStringList() << "build-bundle" << exportRepo << bundleFile << project.flatpakName, project.basePath);
+    if (result && gOptions.flatpakIncremental)
+    {
+        QFile hashFile(exportHashFile);
+        if (hashFile.open(QIODevice::WriteOnly))
+            hashFile.write(exportHash + "\n");
+    }
+    if (!result)
+        error_and_exit("Error with flatpak build-bundle");
+    printSummary("Flatpak bundle created : " + project.basePath + "/" + bundleFile);
+    registerArtifact("flatpak", "bundle", project.basePath + "/" + bundleFile, timer.elapsed(), "sqpackager_flatpak_bundle");
+    storeCachedArtifacts(project, cacheKey, firstArtifact);
 }
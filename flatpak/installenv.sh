@@ -1,2 +1,29 @@
+#!/bin/sh
+# Install the KDE flatpak Sdk and Platform used by the manifests SQPackager generates
+# Usage : installenv.sh [5|6] [branch]
+# Without a branch the newest one flathub has for the Qt major version (6 by default) is installed,
+# SQPackager then picks the newest compatible runtime installed when it generates the manifest
+set -e
+
+QT_MAJOR=${1:-6}
+BRANCH=$2
+ARCH=$(flatpak --default-arch)
+
+case "$QT_MAJOR" in
+    5) BRANCH_PATTERN='^5\.15-[0-9]+\.[0-9]+$' ;;
+    6) BRANCH_PATTERN='^6\.[0-9]+$' ;;
+    *) echo "Usage : $0 [5|6] [branch]" >&2; exit 1 ;;
+esac
+
 flatpak --user remote-add --if-not-exists flathub https://flathub.org/repo/flathub.flatpakrepo
-flatpak install flathub org.kde.Sdk/x86_64/5.15-22.08 org.kde.Platform/x86_64/5.15-22.08
+if [ -z "$BRANCH" ]; then
+    BRANCH=$(flatpak remote-ls --user --runtime --all --arch="$ARCH" --columns=ref flathub \
+             | awk -F/ -v arch="$ARCH" '$(NF-2) == "org.kde.Sdk" && $(NF-1) == arch { print $NF }' \
+             | grep -E "$BRANCH_PATTERN" | sort -V | tail -n 1)
+    if [ -z "$BRANCH" ]; then
+        echo "No org.kde.Sdk branch for Qt $QT_MAJOR found on flathub" >&2
+        exit 1
+    fi
+fi
+echo "Installing the KDE runtime $BRANCH"
+flatpak install --user --noninteractive flathub "org.kde.Sdk/$ARCH/$BRANCH" "org.kde.Platform/$ARCH/$BRANCH"
@@ -0,0 +1,141 @@
+#include <QFile>
+#include <QFileInfo>
+#include <QtEndian>
+#include <QRegularExpression>
+#include <imageinfo.h>
+
+static QSize   readPngSize(QFile& file, QString& error)
+{
+    // 8 bytes signature then the IHDR chunk : length, type, width, height
+    QByteArray header = file.read(24);
+    if (header.size() < 24 || !header.startsWith("\x89PNG\r\n\x1a\n") || header.mid(12, 4) != "IHDR")
+    {
+        error = "not a valid PNG file";
+        return QSize();
+    }
+    const uchar* data = reinterpret_cast<const uchar*>(header.constData());
+    return QSize(qFromBigEndian<quint32>(data + 16), qFromBigEndian<quint32>(data + 20));
+}
+
+static QSize   readIcoSize(QFile& file, QString& error)
+{
+    QByteArray header = file.read(6);
+    const uchar* data = reinterpret_cast<const uchar*>(header.constData());
+    if (header.size() < 6 || qFromLittleEndian<quint16>(data) != 0 || qFromLittleEndian<quint16>(data + 2) != 1)
+    {
+        error = "not a valid ICO file";
+        return QSize();
+    }
+    const quint16 count = qFromLittleEndian<quint16>(data + 4);
+    QByteArray entries = file.read(count * 16);
+    if (count == 0 || entries.size() < count * 16)
+    {
+        error = "truncated ICO file";
+        return QSize();
+    }
+    QSize toret;
+    for (quint16 i = 0; i < count; i++)
+    {
+        // A 0 width or height means 256
+        int width = quint8(entries.at(i * 16));
+        int height = quint8(entries.at(i * 16 + 1));
+        QSize size(width == 0 ? 256 : width, height == 0 ? 256 : height);
+        if (!toret.isValid() || size.width() * size.height() > toret.width() * toret.height())
+            toret = size;
+    }
+    return toret;
+}
+
+static QSize   readXpmSize(QFile& file, QString& error)
+{
+    // The first string of the array is "<width> <height> <colors> <chars per pixel>"
+    static const QRegularExpression valuesExp("\\{[^\"]*\"\\s*(\\d+)\\s+(\\d+)\\s+\\d+\\s+\\d+");
+    QByteArray header = file.read(4096);
+    auto match = valuesExp.match(QString::fromLatin1(header));
+    if (!header.contains("XPM") || !match.hasMatch())
+    {
+        error = "not a valid XPM file";
+        return QSize();
+    }
+    return QSize(match.captured(1).toInt(), match.captured(2).toInt());
+}
+
+static double  svgLength(const QString& value)
+{
+    static const QRegularExpression lengthExp("^\\s*([\\d.]+)\\s*(px)?\\s*$");
+    auto match = lengthExp.match(value);
+    if (!match.hasMatch())
+        return -1;
+    return match.captured(1).toDouble();
+}
+
+static QSize   readSvgSize(QFile& file, QString& error)
+{
+    static const QRegularExpression svgTagExp("<svg\\b([^>]*)>");
+    static const QRegularExpression attributeExp("\\b(width|height|viewBox)\\s*=\\s*[\"']([^\"']*)[\"']");
+    // The svg element is near the start, after the xml declaration and maybe some comments
+    QByteArray header;
+    QRegularExpressionMatch tagMatch;
+    while (!file.atEnd() && header.size() < 64 * 1024)
+    {
+        header.append(file.read(4096));
+        tagMatch = svgTagExp.match(QString::fromUtf8(header));
+        if (tagMatch.hasMatch())
+            break;
+    }
+    if (!tagMatch.hasMatch())
+    {
+        error = "can't find the svg element";
+        return QSize();
+    }
+    double width = -1;
+    double height = -1;
+    QStringList viewBox;
+    auto attributes = attributeExp.globalMatch(tagMatch.captured(1));
+    while (attributes.hasNext())
+    {
+        auto attribute = attributes.next();
+        if (attribute.captured(1) == "width")
+            width = svgLength(attribute.captured(2));
+        if (attribute.captured(1) == "height")
+            height = svgLength(attribute.captured(2));
+        if (attribute.captured(1) == "viewBox")
+            viewBox = attribute.captured(2).split(QRegularExpression("[\\s,]+"), Qt::SkipEmptyParts);
+    }
+    // Relative or missing width/height, the viewBox give the size
+    if ((width < 0 || height < 0) && viewBox.size() == 4)
+    {
+        width = viewBox.at(2).toDouble();
+        height = viewBox.at(3).toDouble();
+    }
+    if (width <= 0 || height <= 0)
+    {
+        error = "the svg element has no usable width/height or viewBox";
+        return QSize();
+    }
+    return QSize(qRound(width), qRound(height));
+}
+
+QSize   readImageSize(const QString& path, QString* error)
+{
+    QString dummy;
+    QString& err = error != nullptr ? *error : dummy;
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        err = file.errorString();
+        return QSize();
+    }
+    QByteArray magic = file.peek(16);
+    const QString suffix = QFileInfo(path).suffix().toLower();
+    if (magic.startsWith("\x89PNG"))
+        return readPngSize(file, err);
+    if (magic.startsWith(QByteArray("\0\0\1\0", 4)))
+        return readIcoSize(file, err);
+    if (magic.startsWith("/* XPM */") || suffix == "xpm")
+        return readXpmSize(file, err);
+    if (suffix == "svg" || magic.startsWith("<?xml") || magic.startsWith("<svg"))
+        return readSvgSize(file, err);
+    err = "unsupported image format (supported formats are PNG, SVG, XPM and ICO)";
+    return QSize();
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <QSize>
+#include <QString>
+
+/*
+ * Read the size of an image from its header, only the first bytes of the file are read
+ * Supported formats are PNG, SVG, XPM and ICO (the largest entry is returned)
+ * Return an invalid QSize and set error if the size can't be found
+ */
+QSize   readImageSize(const QString& path, QString* error = nullptr);
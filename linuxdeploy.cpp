@@ -0,0 +1,262 @@
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QElapsedTimer>
+#include <QDirIterator>
+#include <QSet>
+#include <QProcessEnvironment>
+#include <linuxdeploy.h>
+#include <basestuff.h>
+#include <elfreader.h>
+#include <print.h>
+#include <runner.h>
+#include <trace.h>
+
+// Plugins needed when the closure contains the Qt module, as <plugin dir>/<file pattern>
+static const QList<QPair<QString, QStringList>> pluginsForModule = {
+    {"Gui", {"platforms/libqxcb.so", "platforms/libqwayland*.so", "xcbglintegrations/*.so",
+             "platforminputcontexts/*.so", "imageformats/*.so", "iconengines/*.so"}},
+    {"WaylandClient", {"wayland-shell-integration/*.so", "wayland-decoration-client/*.so", "wayland-graphics-integration-client/*.so"}},
+    {"Network", {"tls/*.so"}},
+    {"Sql", {"sqldrivers/libqsqlite.so"}},
+    {"Multimedia", {"multimedia/*.so"}}
+};
+
+static void readLdSoConf(const QString& path, QStringList& paths)
+{
+    QFile conf(path);
+    if (!conf.open(QIODevice::ReadOnly | QIODevice::Text))
+        return ;
+    while (!conf.atEnd())
+    {
+        QString line = conf.readLine().trimmed();
+        if (line.isEmpty() || line.startsWith('#'))
+            continue;
+        if (line.startsWith("include "))
+        {
+            QString includePattern = line.mid(8).trimmed();
+            if (QFileInfo(includePattern).isRelative())
+                includePattern = QFileInfo(path).absolutePath() + "/" + includePattern;
+            QFileInfo pattern(includePattern);
+            QDir includeDir(pattern.absolutePath());
+            for (const QString& file : includeDir.entryList(QStringList() << pattern.fileName(), QDir::Files, QDir::Name))
+                readLdSoConf(includeDir.filePath(file), paths);
+            continue;
+        }
+        paths.append(line);
+    }
+}
+
+/*
+ * This replaces ldd : it follows DT_NEEDED with the same search order as the loader
+ * (RUNPATH, LD_LIBRARY_PATH, ld.so.conf, default paths) without starting any process
+ */
+class LibraryResolver
+{
+public:
+    LibraryResolver(const ElfInfo& target, const QString& qtLibPath)
+    {
+        m_target = target;
+        m_searchPaths = QProcessEnvironment::systemEnvironment().value("LD_LIBRARY_PATH").split(':', Qt::SkipEmptyParts);
+        m_searchPaths.append(qtLibPath);
+        readLdSoConf("/etc/ld.so.conf", m_searchPaths);
+        m_searchPaths << "/lib" << "/usr/lib" << "/lib64" << "/usr/lib64";
+    }
+    const ElfInfo&  info(const QString& path)
+    {
+        if (!m_infos.contains(path))
+            m_infos[path] = readElfInfo(path);
+        return m_infos[path];
+    }
+    QString resolve(const QString& soname, const QString& fromPath)
+    {
+        const ElfInfo& from = info(fromPath);
+        const QString origin = QFileInfo(fromPath).absolutePath();
+        for (QString dir : from.runpath)
+        {
+            dir.replace("$ORIGIN", origin).replace("${ORIGIN}", origin);
+            if (isCompatible(dir + "/" + soname))
+                return QFileInfo(dir + "/" + soname).absoluteFilePath();
+        }
+        if (m_resolved.contains(soname))
+            return m_resolved.value(soname);
+        for (const QString& dir : m_searchPaths)
+        {
+            if (isCompatible(dir + "/" + soname))
+            {
+                m_resolved[soname] = QFileInfo(dir + "/" + soname).absoluteFilePath();
+                return m_resolved[soname];
+            }
+        }
+        return QString();
+    }
+private:
+    bool    isCompatible(const QString& path)
+    {
+        if (!QFileInfo::exists(path))
+            return false;
+        const ElfInfo& candidate = info(path);
+        return candidate.valid && candidate.is64 == m_target.is64 && candidate.machine == m_target.machine;
+    }
+    ElfInfo                 m_target;
+    QStringList             m_searchPaths;
+    QMap<QString, QString>  m_resolved;
+    QMap<QString, ElfInfo>  m_infos;
+};
+
+static bool    isQtModule(const QString& soname, const QString& module)
+{
+    // libQt6Gui.so.6
+    return soname.startsWith("libQt") && soname.mid(6).startsWith(module + ".so");
+}
+
+static bool    setRunpath(const QString& file, const QString& runpath)
+{
+    if (setElfRunpathInPlace(file, readElfInfo(file), runpath))
+        return true;
+    Runner run;
+    return run.run("patchelf", QStringList() << "--set-rpath" << runpath << file);
+}
+
+QStringList deployLinuxQt(const ProjectDefinition& project, const QMap<QString, QString>& qtPaths,
+                          const QString& binary, const QString& prefix)
+{
+    TraceSpan trace("deployLinuxQt");
+    const QString qtLibs = qtPaths.value("QT_INSTALL_LIBS");
+    const QString qtPlugins = qtPaths.value("QT_INSTALL_PLUGINS");
+    const QString libDir = prefix + "/lib";
+    ElfInfo binaryInfo = readElfInfo(binary);
+    if (!binaryInfo.valid)
+        error_and_exit("The built binary " + binary + " is not a valid ELF file");
+
+    println("Resolving the shared libraries closure");
+    QElapsedTimer timer;
+    timer.start();
+    LibraryResolver resolver(binaryInfo, qtLibs);
+    const bool qtInSystemDir = qtLibs.startsWith("/usr/lib") || qtLibs.startsWith("/lib");
+    QMap<QString, QString> bundled; // soname -> path
+    QStringList plugins; // relative to the Qt plugins dir
+    QStringList queue;
+    QSet<QString> visited;
+    auto walkQueue = [&]() {
+        while (!queue.isEmpty())
+        {
+            const QString current = queue.takeFirst();
+            if (visited.contains(current))
+                continue;
+            visited.insert(current);
+            for (const QString& soname : resolver.info(current).needed)
+            {
+                if (bundled.contains(soname))
+                    continue;
+                const QString path = resolver.resolve(soname, current);
+                if (path.isEmpty())
+                    error_and_exit("Can't find the library " + soname + " needed by " + current);
+                // Everything else is expected to be provided by the system
+                bool bundle = soname.startsWith("libQt") || soname.startsWith("libicu") || (!qtInSystemDir && path.startsWith(qtLibs));
+                if (!bundle)
+                    continue;
+                bundled[soname] = path;
+                queue.append(path);
+            }
+        }
+    };
+    queue.append(binary);
+    bool closureChanged = true;
+    while (closureChanged)
+    {
+        walkQueue();
+        // Plugins are loaded at runtime, they are not in DT_NEEDED and depend on the modules used
+        closureChanged = false;
+        for (const auto& modulePlugins : pluginsForModule)
+        {
+            bool used = false;
+            for (const QString& soname : bundled.keys())
+                used = used || isQtModule(soname, modulePlugins.first);
+            if (!used)
+                continue;
+            for (const QString& pattern : modulePlugins.second)
+            {
+                QFileInfo patternFi(pattern);
+                QDir pluginDir(qtPlugins + "/" + patternFi.path());
+                for (const QString& file : pluginDir.entryList(QStringList() << patternFi.fileName(), QDir::Files))
+                {
+                    const QString relative = patternFi.path() + "/" + file;
+                    if (plugins.contains(relative))
+                        continue;
+                    plugins.append(relative);
+                    queue.append(qtPlugins + "/" + relative);
+                    closureChanged = true;
+                }
+            }
+        }
+    }
+    QStringList qmlImports;
+    if (project.qmlProject)
+    {
+        qmlImports = qmlImportPaths(project, qtPaths);
+        for (const QString& importPath : qmlImports)
+        {
+            QDirIterator it(importPath, QStringList() << "*.so", QDir::Files, QDirIterator::Subdirectories);
+            while (it.hasNext())
+                queue.append(it.next());
+        }
+        walkQueue();
+    }
+    println(QString("\tClosure resolved in %1 ms : %2 libraries, %3 plugins, %4 QML imports")
+            .arg(timer.elapsed()).arg(bundled.size()).arg(plugins.size()).arg(qmlImports.size()));
+
+    println("Copying the Qt files into " + prefix);
+    QDir().mkpath(libDir);
+    QStringList notPatched;
+    const QString binaryDir = QFileInfo(binary).absolutePath();
+    if (!setRunpath(binary, "$ORIGIN/" + QDir(binaryDir).relativeFilePath(libDir)))
+        notPatched << binary;
+    for (auto it = bundled.cbegin(); it != bundled.cend(); ++it)
+    {
+        const QString dest = libDir + "/" + it.key();
+        QFile::remove(dest);
+        if (!QFile::copy(it.value(), dest))
+            error_and_exit("Could not copy " + it.value() + " to " + dest);
+        QFile::setPermissions(dest, QFile::permissions(dest) | QFileDevice::WriteOwner);
+        if (!setRunpath(dest, "$ORIGIN"))
+            notPatched << it.key();
+    }
+    for (const QString& plugin : plugins)
+    {
+        const QString dest = prefix + "/plugins/" + plugin;
+        QDir().mkpath(QFileInfo(dest).absolutePath());
+        QFile::remove(dest);
+        if (!QFile::copy(qtPlugins + "/" + plugin, dest))
+            error_and_exit("Could not copy the plugin " + qtPlugins + "/" + plugin + " to " + dest);
+        QFile::setPermissions(dest, QFile::permissions(dest) | QFileDevice::WriteOwner);
+        if (!setRunpath(dest, "$ORIGIN/../../lib"))
+            notPatched << plugin;
+    }
+    const QString qtQml = qtPaths.value("QT_INSTALL_QML");
+    for (const QString& importPath : qmlImports)
+    {
+        const QString dest = prefix + "/qml/" + QDir(qtQml).relativeFilePath(importPath);
+        if (!copyRecursively(importPath, dest))
+            error_and_exit("Could not copy the QML import " + importPath + " to " + dest);
+        QDirIterator it(dest, QStringList() << "*.so", QDir::Files, QDirIterator::Subdirectories);
+        while (it.hasNext())
+        {
+            const QString file = it.next();
+            QFile::setPermissions(file, QFile::permissions(file) | QFileDevice::WriteOwner);
+            if (!setRunpath(file, "$ORIGIN/" + QDir(QFileInfo(file).absolutePath()).relativeFilePath(libDir)))
+                notPatched << file;
+        }
+    }
+
+    // Qt read qt.conf next to the executable, the paths are relative to Prefix
+    QString relativePrefix = QDir(binaryDir).relativeFilePath(prefix);
+    if (relativePrefix.isEmpty())
+        relativePrefix = ".";
+    QFile qtConf(binaryDir + "/qt.conf");
+    if (!qtConf.open(QIODevice::WriteOnly | QIODevice::Text))
+        error_and_exit("Can't create qt.conf : " + qtConf.errorString());
+    qtConf.write("[Paths]\nPrefix = " + relativePrefix.toUtf8() + "\nLibraries = lib\nPlugins = plugins\nQml2Imports = qml\nQmlImports = qml\n");
+    qtConf.close();
+    return notPatched;
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <QMap>
+#include <QString>
+#include <QStringList>
+#include <projectdefinition.h>
+
+/*
+ * Deploy Qt next to a Linux binary without ldd nor linuxdeployqt, used by the standalone release and the AppImage
+ * The Qt and ICU libraries of the closure go in <prefix>/lib, the plugins of the Qt modules used in <prefix>/plugins
+ * and the QML imports in <prefix>/qml. Everything else is expected from the system
+ */
+
+// binary is the copy in the release, the RUNPATH of every deployed file is set and qt.conf written next to binary
+// Give the files whose RUNPATH could not be set (no room in place and no patchelf)
+QStringList deployLinuxQt(const ProjectDefinition& project, const QMap<QString, QString>& qtPaths,
+                          const QString& binary, const QString& prefix);
@@ -0,0 +1,100 @@
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSysInfo>
+#include <QElapsedTimer>
+#include <projectdefinition.h>
+#include <sqpackager.h>
+#include <basestuff.h>
+#include <compile_defines.h>
+#include <elfreader.h>
+#include <linuxdeploy.h>
+#include <buildsystem.h>
+#include <print.h>
+#include <runner.h>
+#include <trace.h>
+#include <artifacts.h>
+#include <sourcetree.h>
+#include <reproducible.h>
+
+extern PackagerOptions gOptions;
+
+/*
+ * qmake (or CMake as build RPATH) puts this in the executable RUNPATH, this reserves the room to write $ORIGIN/lib
+ * in place once the executable is copied in the release
+ */
+static const QString runpathPlaceholder = "/sqpackager/runpath/placeholder/for/the/standalone/release";
+
+void    buildLinuxStandalone(const ProjectDefinition& project)
+{
+    TraceSpan trace("buildLinuxStandalone");
+    printSummary("===== Building Linux standalone release =====");
+    QElapsedTimer stepTimer;
+    stepTimer.start();
+    Runner run(true);
+    const QString qmake = findQMake(project);
+    const QMap<QString, QString> qtPaths = queryQMake(qmake);
+    const QString buildDir = project.basePath + "/linux_standalone_build";
+
+    QDir().mkpath(buildDir);
+    if (project.buildSystem == BuildSystem::CMake)
+    {
+        cmakeBuild(run, project, "cmake", buildDir, QStringList() << CompileDefines::standalone, qtPaths.value("QT_INSTALL_PREFIX"),
+                   QStringList() << "-DCMAKE_BUILD_RPATH=" + runpathPlaceholder);
+    } else {
+        QStringList qmakeOptions;
+        qmakeOptions << project.proFile << "CONFIG+=release" << "DEFINES+=" + CompileDefines::standalone << "QMAKE_RPATHDIR+=" + runpathPlaceholder;
+        if (!run.run(qmake, buildDir, qmakeOptions))
+        {
+            println(run.getStdout());
+            println(run.getStderr());
+            error_and_exit("QMake failed to run");
+        }
+        if (!run.runWithOut("make", QStringList() << "-j" + QString::number(gOptions.jobs), buildDir))
+            error_and_exit("Building the project failed");
+    }
+
+    const QString arch = QSysInfo::currentCpuArchitecture();
+    const QString releaseName = project.unixNormalizedName + "-" + project.version.simpleVersion + "-linux-" + arch;
+    const QString stagingParent = buildDir + "/sqpackager_release";
+    const QString releaseDir = stagingParent + "/" + releaseName;
+    QDir(releaseDir).removeRecursively();
+    QDir().mkpath(releaseDir);
+
+    const QString binary = buildDir + "/" + project.targetName;
+    if (!readElfInfo(binary).valid)
+        error_and_exit("The built binary " + binary + " is not a valid ELF file");
+    println("Copying files into " + releaseDir);
+    if (!QFile::copy(binary, releaseDir + "/" + project.targetName))
+        error_and_exit("Could not copy " + binary + " in " + releaseDir);
+    // Nothing sets LD_LIBRARY_PATH for the standalone release, a file left with the build RUNPATH would load the system Qt
+    const QStringList notPatched = deployLinuxQt(project, qtPaths, releaseDir + "/" + project.targetName, releaseDir);
+    if (!notPatched.isEmpty())
+        error_and_exit("Could not set the RUNPATH (no room in place and no patchelf) of : " + notPatched.join(", ") + ", install patchelf");
+
+    if (project.readmeFile.isEmpty() == false)
+    {
+        const QString readme = project.projectBasePath + "/" + project.readmeFile;
+        if (!QFile::copy(readme, releaseDir + "/" + QFileInfo(project.readmeFile).fileName()))
+            error_and_exit("Could not copy the readme file " + readme + " in " + releaseDir);
+    }
+    const QString license = project.projectBasePath + "/" + project.licenseFile;
+    if (!QFile::copy(license, releaseDir + "/" + QFileInfo(project.licenseFile).fileName()))
+        error_and_exit("Could not copy the license file " + license + " in " + releaseDir);
+    for (const ReleaseFile& file : project.releaseFiles)
+    {
+        if (file.type != Local)
+            continue;
+        if (!copyRecursively(project.basePath + "/" + file.source, releaseDir + "/" + file.destination))
+            error_and_exit("Could not copy one of the project file : " + file.name + " - " + file.source);
+    }
+
+    QDir().mkpath(project.basePath + "/" + sourceDistDir);
+    const QString tarball = project.basePath + "/" + sourceDistDir + "/" + releaseName + ".tar.gz";
+    bool ok = run.runWithOut("tar", QStringList() << "--owner=0" << "--group=0" << "--numeric-owner"
+                             << tarGzCreateArguments(tarball) << "-C" << stagingParent << releaseName);
+    if (!ok)
+        error_and_exit("Could not create the standalone tarball");
+    printSummary("Linux standalone release created : " + tarball);
+    registerArtifact("linux-standalone", "tarball", tarball, stepTimer.elapsed(), "sqpackager_linux_standalone");
+}
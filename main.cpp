@@ -5,14 +5,18 @@
 #include <QFileInfo>
 #include <QCommandLineParser>
 #include <QDateTime>
+#include <QStandardPaths>
 
 #include <runner.h>
 #include <sqpackager.h>
 #include <basestuff.h>
+#include <buildsystem.h>
 #include <desktoprc.h>
 #include <print.h>
-
-QTextStream cout(stdout);
+#include <trace.h>
+#include <artifacts.h>
+#include <watch.h>
+#include <reproducible.h>
 
 PackagerOptions gOptions;
 
@@ -28,39 +32,97 @@ int main(int argc, char *argv[])
     parser.addOptions({
                     {"version", "version", "Force the given version for the project"},
                     {"gen-flatpak", "Generate a flatpak manifest"},
+                    {"flatpak-incremental", "Keep the flatpak-builder cache between builds and skip export/bundle when nothing changed"},
+                    {"flatpak-repo", "path", "Export into a persistent OSTree repository and generate static deltas"},
+                    {"flatpak-delta-depth", "count", "Number of previous commits to generate static deltas from (default 3)"},
                     {"gen-windows", "Check and generate Windows related stuff"},
                     {"gen-debian", "Check and generate Debian files"},
                     {"build", "type", "Build the selected type"},
                     {"prepare", "type", "Prepare the system to be able to build the type"},
                     {"windows-build-path", "path", "Set the base directory where compilation takes place"},
                     {"windows-deploy-path", "path", "Set the base directory where deployement takes place"},
+                    {"windows-cross-qt", "path", "The Qt built for Windows to use with --build windows-cross"},
+                    {"windows-cross-toolchain", "triplet", "The mingw-w64 toolchain to use with --build windows-cross (default x86_64-w64-mingw32)"},
+                    {"cache", "Reuse the packages of a previous build of the same sources and toolchain"},
+                    {"cache-dir", "path", "Directory of the artifact cache (default ~/.cache/sqpackager/artifacts), implies --cache"},
+                    {"cache-url", "url", "HTTP server used as a shared artifact cache with GET and PUT, implies --cache"},
+                    {"reproducible", "Give byte identical artifacts for the same sources, the dates are SOURCE_DATE_EPOCH or the last git commit time"},
+                    {"verify-reproducible", "Do the requested builds twice with --reproducible and compare the artifacts"},
+                    {"quiet", "Only show the summaries, warnings and errors on the console"},
+                    {"log-dir", "dir", "Write the whole output in <dir>/sqpackager.log and each build output in <dir>/<build>.log"},
+                    {"trace", "file", "Write a Chrome trace event file of the phases and the child processes"},
+                    {"jobs", "count", "Number of parallel build jobs, default to the number of cpu cores limited by the available memory"},
+                    {"appimage-runtime", "path", "The AppImage runtime to use for the appimage build"},
                     {"gen-desktop", "Generate a .desktop file"},
-                    {"gen-unix", "Generate a .desktop file and an unix installer"}
+                    {"gen-unix", "Generate a .desktop file and an unix installer"},
+                    {"watch", "After the --gen options, regenerate the files whose inputs change until interrupted"}
                       });
     //return a.exec();
     parser.process(a);
     //testTemplate();
-    ProjectDefinition project;
-    if (parser.positionalArguments().isEmpty())
+    if (parser.isSet("quiet"))
+        setQuietOutput(true);
+    if (parser.isSet("log-dir"))
+        setLogDirectory(parser.value("log-dir"));
+    if (parser.isSet("trace"))
+        startTrace(parser.value("trace"));
+    TraceSpan trace("sqpackager");
+    gOptions.jobs = defaultJobCount();
+    if (parser.isSet("cache") || parser.isSet("cache-dir") || parser.isSet("cache-url"))
     {
-        project = getProjectDescription();
-    } else {
-        project = getProjectDescription(parser.positionalArguments().at(0));
+        gOptions.cacheDir = parser.value("cache-dir");
+        if (gOptions.cacheDir.isEmpty())
+            gOptions.cacheDir = QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation) + "/sqpackager/artifacts";
+        gOptions.cacheUrl = parser.value("cache-url");
+        while (gOptions.cacheUrl.endsWith("/"))
+            gOptions.cacheUrl.chop(1);
     }
-    extractInfosFromProFile(project);
-    findLicense(project);
-    findReadme(project);
-    if (project.qtModules.contains("quick"))
-        project.qmlProject = true;
-    if (parser.isSet("version"))
+    if (parser.isSet("jobs"))
     {
-        project.version.type = VersionType::Forced;
-        project.version.forcedVersion = parser.value("version");
+        bool ok;
+        gOptions.jobs = parser.value("jobs").toInt(&ok);
+        if (!ok || gOptions.jobs < 1)
+            error_and_exit("The <jobs> option must be a positive number");
     }
-    else
+    // Only the builds use the jobs, the --gen options stay quiet about it
+    if (parser.isSet("build") || parser.isSet("verify-reproducible"))
+        println(QString("Using %1 parallel job(s)").arg(gOptions.jobs));
+    if (parser.isSet("reproducible") || parser.isSet("verify-reproducible"))
     {
-        findVersion(project);
+        const QString projectFile = parser.positionalArguments().isEmpty() ? "sqproject.json" : parser.positionalArguments().at(0);
+        enableReproducibleBuild(QFileInfo(projectFile).absolutePath());
     }
+    // --watch reload the project with this when sqproject.json or the .pro/CMakeLists.txt file change
+    auto loadProject = [&parser]() {
+        ProjectDefinition project;
+        if (parser.positionalArguments().isEmpty())
+        {
+            project = getProjectDescription();
+        } else {
+            project = getProjectDescription(parser.positionalArguments().at(0));
+        }
+        if (project.buildSystem == BuildSystem::CMake)
+            extractInfosFromCMakeLists(project);
+        else
+            extractInfosFromProFile(project);
+        findLicense(project);
+        findReadme(project);
+        if (project.qtModules.contains("quick"))
+            project.qmlProject = true;
+        if (parser.isSet("version"))
+        {
+            project.version.type = VersionType::Forced;
+            project.version.forcedVersion = parser.value("version");
+        }
+        else
+        {
+            findVersion(project);
+        }
+        return project;
+    };
+    ProjectDefinition project = loadProject();
+    if (parser.isSet("verify-reproducible"))
+        exit(verifyReproducibleBuild(project) ? 0 : 1);
     /*println(createArchive(project));
     exit(0);*/
     // Windows Stuff
@@ -71,7 +133,17 @@ int main(int argc, char *argv[])
     if (parser.isSet("gen-windows"))
         genWindows(project);
     if (parser.isSet("build") && parser.value("build") == "windows")
+    {
+        LogJob job("windows");
         buildWindows(project);
+    }
+    if (parser.isSet("build") && parser.value("build") == "windows-cross")
+    {
+        LogJob job("windows-cross");
+        gOptions.windowsCrossQt = parser.value("windows-cross-qt");
+        gOptions.windowsCrossToolchain = parser.value("windows-cross-toolchain");
+        buildWindowsCross(project);
+    }
 
     if (parser.isSet("gen-desktop"))
     {
@@ -107,6 +179,7 @@ int main(int argc, char *argv[])
     }
     if (parser.isSet("build") && parser.value("build") == "flatpak")
     {
+        LogJob job("flatpak");
         if (!checkFlatPak(project))
         {
             error_and_exit("The project definition is not suited to generate a flatpak file");
@@ -114,8 +187,47 @@ int main(int argc, char *argv[])
         setDesktopRC(project);
         if (project.flatpakFile.isEmpty())
             generateFlatPakFile(project);
+        gOptions.flatpakIncremental = parser.isSet("flatpak-incremental");
+        gOptions.flatpakRepo = parser.value("flatpak-repo");
+        gOptions.flatpakDeltaDepth = 3;
+        if (parser.isSet("flatpak-delta-depth"))
+        {
+            bool ok;
+            gOptions.flatpakDeltaDepth = parser.value("flatpak-delta-depth").toInt(&ok);
+            if (!ok || gOptions.flatpakDeltaDepth < 0)
+                error_and_exit("The <flatpak-delta-depth> option must be a positive number or 0");
+        }
         buildFlatPak(project);
     }
+    // AppImage
+    if (parser.isSet("build") && parser.value("build") == "appimage")
+    {
+        LogJob job("appimage");
+        gOptions.appImageRuntime = parser.value("appimage-runtime");
+        if (!checkDesktopRC(project))
+            error_and_exit("The project description is not suited to generate a .desktop file. Please follow the previously error");
+        setDesktopRC(project);
+        if (!checkAppImage(project))
+        {
+            error_and_exit("The project definition or the system is not suited to build an AppImage");
+        }
+        if (QFileInfo::exists(project.targetName + ".1") || QFileInfo::exists(project.targetName + "manpage.1"))
+            ;
+        else
+            generateManPage(project);
+        generateUnixInstallFile(project);
+        buildAppImage(project);
+    }
+    if (parser.isSet("build") && parser.value("build") == "qt-matrix")
+    {
+        LogJob job("qt-matrix");
+        buildQtMatrix(project);
+    }
+    if (parser.isSet("build") && parser.value("build") == "linux-standalone")
+    {
+        LogJob job("linux-standalone");
+        buildLinuxStandalone(project);
+    }
     // Debian
     if (parser.isSet("prepare") && parser.value("prepare") == "debian")
     {
@@ -138,12 +250,26 @@ int main(int argc, char *argv[])
     }
     if (parser.isSet("build") && parser.value("build") == "debian")
     {
+        LogJob job("debian");
         if (!checkDebian(project))
         {
             error_and_exit("The project definition is not suited to generate debian packaging files");
         }
         buildDebian(project);
     }
+    writeArtifactManifest(project);
+    if (parser.isSet("watch"))
+    {
+        WatchTargets targets;
+        targets.desktop = parser.isSet("gen-desktop");
+        targets.unixInstaller = parser.isSet("gen-unix");
+        targets.flatpak = parser.isSet("gen-flatpak");
+        targets.debian = parser.isSet("gen-debian");
+        if (!targets.desktop && !targets.unixInstaller && !targets.flatpak && !targets.debian)
+            error_and_exit("--watch needs at least one of --gen-desktop, --gen-unix, --gen-flatpak or --gen-debian");
+        watchProject(parser.positionalArguments().isEmpty() ? "sqproject.json" : parser.positionalArguments().at(0),
+                     project, targets, loadProject);
+    }
 }
 
 #include "print.h"
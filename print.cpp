@@ -1,10 +1,16 @@
-#include <QTextStream>
+#include <QDir>
+#include <QFile>
+#include <QHash>
+#include <QAtomicInt>
+#include <QAtomicPointer>
+#include <QSemaphore>
+#include <QRegularExpression>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
 
 #include <print.h>
 
-
-extern QTextStream cout;
-
 QString green(QString text)
 {
     return QString("\033[0m \033[1;32m%1\033[0m").arg(text);
@@ -14,25 +20,264 @@ QString red(QString text)
     return QString("\033[0m \033[1;31m%1\033[0m").arg(text);
 }
 
+enum class LogNodeType {
+    Message,
+    SetDirectory,
+    Flush,
+    Stop
+};
+
+struct LogNode
+{
+    LogNode*    next = nullptr;
+    LogNodeType type = LogNodeType::Message;
+    LogLevel    level = LogLevel::Info;
+    QString     job;
+    QByteArray  text;
+    QSemaphore* done = nullptr;
+};
+
+/*
+ * Producers push on a lock-free stack, the writer takes the whole stack at once and reverse it
+ * Only the push that find the stack empty wake the writer, so a burst of lines cost one wake up
+ * and one write per output
+ */
+class Logger
+{
+public:
+    Logger()
+    {
+        m_thread = std::thread(&Logger::writerLoop, this);
+    }
+    // Run by exit(), everything queued is written before the process ends
+    ~Logger()
+    {
+        stop();
+    }
+    static Logger&  logger()
+    {
+        static Logger toret;
+        return toret;
+    }
+    void    push(LogNode* node)
+    {
+        if (m_stopped.loadAcquire())
+        {
+            // Late messages, after the writer stopped
+            writeNode(node);
+            delete node;
+            return ;
+        }
+        LogNode* head = m_head.loadAcquire();
+        do {
+            node->next = head;
+        } while (!m_head.testAndSetOrdered(head, node, head));
+        if (head == nullptr)
+            m_wake.release();
+    }
+    void    pushAndWait(LogNode* node)
+    {
+        if (m_stopped.loadAcquire())
+        {
+            delete node;
+            return ;
+        }
+        QSemaphore done;
+        node->done = &done;
+        push(node);
+        done.acquire();
+    }
+    void    stop()
+    {
+        if (m_stopped.loadAcquire())
+            return ;
+        LogNode* node = new LogNode;
+        node->type = LogNodeType::Stop;
+        push(node);
+        m_thread.join();
+        m_stopped.storeRelease(1);
+    }
+    QAtomicInt  quiet;
+    // Job names are never freed so producers can read them without a lock
+    QAtomicPointer<const QString>   currentJob;
+
+private:
+    void    writerLoop()
+    {
+        bool running = true;
+        while (running)
+        {
+            m_wake.acquire();
+            m_wake.tryAcquire(m_wake.available());
+            LogNode* list = m_head.fetchAndStoreAcquire(nullptr);
+            // The stack is in reverse order
+            LogNode* ordered = nullptr;
+            while (list != nullptr)
+            {
+                LogNode* next = list->next;
+                list->next = ordered;
+                ordered = list;
+                list = next;
+            }
+            while (ordered != nullptr)
+            {
+                LogNode* node = ordered;
+                ordered = node->next;
+                switch (node->type)
+                {
+                case LogNodeType::Message:
+                    writeNode(node);
+                    break;
+                case LogNodeType::SetDirectory:
+                    openDirectory(QString::fromUtf8(node->text));
+                    break;
+                case LogNodeType::Flush:
+                    flushOutputs();
+                    break;
+                case LogNodeType::Stop:
+                    running = false;
+                    break;
+                }
+                if (node->done != nullptr)
+                    node->done->release();
+                delete node;
+            }
+            flushOutputs();
+        }
+        for (QFile* file : m_jobFiles)
+            delete file;
+        m_jobFiles.clear();
+    }
+    bool    onConsole(LogLevel level) const
+    {
+        return !quiet.loadRelaxed() || level != LogLevel::Info;
+    }
+    void    writeNode(const LogNode* node)
+    {
+        FILE* console = node->level == LogLevel::Error ? stderr : stdout;
+        if (onConsole(node->level))
+            fwrite(node->text.constData(), 1, node->text.size(), console);
+        if (m_directory.isEmpty())
+            return ;
+        // No colors in the files
+        static const QRegularExpression ansiExp("\033\\[[0-9;]*m");
+        QByteArray plain = node->text;
+        if (plain.contains('\033'))
+            plain = QString::fromUtf8(plain).remove(ansiExp).toUtf8();
+        m_mainFile.write(plain);
+        if (!node->job.isEmpty())
+        {
+            QFile* jobFile = m_jobFiles.value(node->job);
+            if (jobFile == nullptr)
+            {
+                jobFile = new QFile(m_directory + "/" + node->job + ".log");
+                jobFile->open(QIODevice::WriteOnly | QIODevice::Truncate);
+                m_jobFiles[node->job] = jobFile;
+            }
+            jobFile->write(plain);
+        }
+    }
+    void    openDirectory(const QString& path)
+    {
+        m_directory = path;
+        QDir().mkpath(path);
+        m_mainFile.close();
+        m_mainFile.setFileName(path + "/sqpackager.log");
+        if (!m_mainFile.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        {
+            fprintf(stderr, "Could not open the log file %s\n", qPrintable(m_mainFile.fileName()));
+            m_directory.clear();
+        }
+    }
+    void    flushOutputs()
+    {
+        fflush(stdout);
+        fflush(stderr);
+        m_mainFile.flush();
+        for (QFile* file : m_jobFiles)
+            file->flush();
+    }
+
+    QAtomicPointer<LogNode> m_head;
+    QSemaphore              m_wake;
+    QAtomicInt              m_stopped;
+    std::thread             m_thread;
+    // Only used by the writer thread
+    QString                 m_directory;
+    QFile                   m_mainFile;
+    QHash<QString, QFile*>  m_jobFiles;
+};
+
+void    logMessage(LogLevel level, const QString& text)
+{
+    Logger& logger = Logger::logger();
+    LogNode* node = new LogNode;
+    node->level = level;
+    node->text = text.toUtf8();
+    const QString* job = logger.currentJob.loadAcquire();
+    if (job != nullptr)
+        node->job = *job;
+    logger.push(node);
+}
+
 void print(QString text)
 {
-    cout << text;
+    logMessage(LogLevel::Info, text);
 }
 
 void println(QString text)
 {
-    cout << text << "\n";
-    cout.flush();
+    logMessage(LogLevel::Info, text + "\n");
 }
 
 void printlnOk(QString text, bool ok)
 {
-    cout << text << ": " << (ok ? green("Ok") : red("Ko")) << "\n";
-    cout.flush();
+    logMessage(LogLevel::Info, text + ": " + (ok ? green("Ok") : red("Ko")) + "\n");
 }
 
 void printlnYes(QString text, bool ok)
 {
-    cout << text << ": " << (ok ? green("Yes") : red("No")) << "\n";
-    cout.flush();
+    logMessage(LogLevel::Info, text + ": " + (ok ? green("Yes") : red("No")) + "\n");
+}
+
+void printSummary(QString text)
+{
+    logMessage(LogLevel::Summary, text + "\n");
+}
+
+// Child process output is forwarded as it comes, it already contains its new lines
+void printOutput(const QByteArray& output)
+{
+    logMessage(LogLevel::Info, QString::fromLocal8Bit(output));
+}
+
+void    setQuietOutput(bool quiet)
+{
+    Logger::logger().quiet.storeRelaxed(quiet ? 1 : 0);
+}
+
+void    setLogDirectory(const QString& path)
+{
+    LogNode* node = new LogNode;
+    node->type = LogNodeType::SetDirectory;
+    node->text = QDir(path).absolutePath().toUtf8();
+    Logger::logger().pushAndWait(node);
+}
+
+void    flushLog()
+{
+    LogNode* node = new LogNode;
+    node->type = LogNodeType::Flush;
+    Logger::logger().pushAndWait(node);
+}
+
+LogJob::LogJob(const QString& name)
+{
+    Logger& logger = Logger::logger();
+    m_previous = logger.currentJob.fetchAndStoreOrdered(new QString(name));
+}
+
+LogJob::~LogJob()
+{
+    Logger::logger().currentJob.storeRelease(m_previous);
 }
@@ -2,10 +2,41 @@
 #define PRINT_H
 
 #include <QString>
+#include <QByteArray>
+
+/*
+ * Messages are queued and written by a background thread
+ * With --quiet only the Summary, Warning and Error levels reach the console, everything still go to the log files
+ */
+enum class LogLevel {
+    Info,
+    Summary,
+    Warning,
+    Error
+};
 
 void    print(QString text);
 void    println(QString text);
 void    printlnOk(QString text, bool ok);
 void    printlnYes(QString text, bool ok);
+void    printSummary(QString text);
+void    printOutput(const QByteArray& output);
+void    logMessage(LogLevel level, const QString& text);
+
+void    setQuietOutput(bool quiet);
+// Write sqpackager.log and a file per job in this directory
+void    setLogDirectory(const QString& path);
+// Block until everything queued is written
+void    flushLog();
+
+// Messages logged while this exist also go to <log directory>/<name>.log
+class LogJob
+{
+public:
+    LogJob(const QString& name);
+    ~LogJob();
+private:
+    const QString*  m_previous;
+};
 
 #endif // PRINT_H
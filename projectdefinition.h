@@ -1,6 +1,7 @@
 #ifndef PROJECTDEFINITION_H
 #define PROJECTDEFINITION_H
 
+#include <QMap>
 #include <QSize>
 #include <QString>
 #include <QStringList>
@@ -25,6 +26,11 @@ enum class QtMajorVersion {
     Auto
 };
 
+enum class BuildSystem {
+    QMake,
+    CMake
+};
+
 enum class VersionType {
     Forced,
     Git,
@@ -56,6 +62,8 @@ struct ProjectDefinition
     QStringList qtModules;
     QString     icon;
     QSize       iconSize;
+    QString     generatedIconsDir;
+    QList<int>  generatedIconSizes;
     QString     org;
     QString     basePath; // This is the path where the .pro file is
     QString     projectBasePath; // This can override basePath for when the .pro file is a sub 'project' like the ExampleApp
@@ -67,11 +75,14 @@ struct ProjectDefinition
     QString     debianPackageName;
     QString     qmlDir;
     QString     proFile;
+    BuildSystem buildSystem;
+    QString     cmakeFile; // The top CMakeLists.txt, used when buildSystem is CMake
     ProjectVersion     version;
     QString     readmeFile;
     QString     licenseFile;
     QString     licenseName;
     QtMajorVersion  qtMajorVersion;
+    QStringList qtMatrix; // Qt version prefixes for --build qt-matrix, empty for every installed Qt
     QString     desktopIcon;
     QString     desktopFile;
     QString     desktopFileNormalizedName;
@@ -79,6 +90,8 @@ struct ProjectDefinition
     QStringList categories;
     QString     targetName;
     QString     translationDir;
+    QStringList windowsPluginDirs; // Added to the plugin directories always deployed on Windows
+    QMap<QString, QStringList>   windowsModulePluginDirs; // Added to the plugin directories deployed for a Qt module
     QList<ReleaseFile>       releaseFiles;
 };
 
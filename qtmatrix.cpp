@@ -0,0 +1,207 @@
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QElapsedTimer>
+#include <QStandardPaths>
+#include <QVersionNumber>
+#include <QtConcurrent>
+
+#include <projectdefinition.h>
+#include <sqpackager.h>
+#include <basestuff.h>
+#include <buildsystem.h>
+#include <runner.h>
+#include <print.h>
+#include <trace.h>
+
+extern PackagerOptions gOptions;
+
+struct QtKit
+{
+    QString         name;
+    QString         qmake;
+    QVersionNumber  version;
+    QString         prefix;
+    // Filled by the build
+    bool            ok = false;
+    QString         failedStep;
+    qint64          configureMs = 0;
+    qint64          buildMs = 0;
+};
+
+// The first line of a qtchooser config is the bin directory
+static void qtChooserQMakes(const QString& dirPath, QStringList& qmakes)
+{
+    QDir dir(dirPath);
+    for (const QFileInfo& conf : dir.entryInfoList(QStringList() << "*.conf", QDir::Files))
+    {
+        QFile file(conf.absoluteFilePath());
+        if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+            continue;
+        const QString binDir = QString::fromLocal8Bit(file.readLine()).trimmed();
+        if (!binDir.isEmpty())
+            qmakes << binDir + "/qmake";
+    }
+}
+
+static void globQMakes(const QString& baseDir, const QStringList& dirPatterns, const QString& subPath, QStringList& qmakes)
+{
+    for (const QFileInfo& fi : QDir(baseDir).entryInfoList(dirPatterns, QDir::Dirs | QDir::NoDotAndDotDot))
+        qmakes << fi.absoluteFilePath() + subPath;
+}
+
+/*
+ * Every Qt installed on the system, from qtchooser configs, distribution directories and the Qt installer
+ * Two qmake giving the same version and prefix (a qtchooser wrapper and the real one) are the same kit
+ */
+static QList<QtKit> discoverQtKits()
+{
+    TraceSpan trace("discoverQtKits");
+    QStringList candidates;
+    const QString home = QDir::homePath();
+    for (const QString& dir : {QString("/etc/xdg/qtchooser"), QString("/usr/share/qtchooser"), QString("/usr/lib/qtchooser"), home + "/.config/qtchooser"})
+        qtChooserQMakes(dir, candidates);
+    for (const QFileInfo& multiarch : QDir("/usr/lib").entryInfoList(QStringList() << "*-linux-*", QDir::Dirs | QDir::NoDotAndDotDot))
+    {
+        qtChooserQMakes(multiarch.absoluteFilePath() + "/qtchooser", candidates);
+        globQMakes(multiarch.absoluteFilePath(), QStringList() << "qt5" << "qt6", "/bin/qmake", candidates);
+    }
+    globQMakes("/usr/lib", QStringList() << "qt*", "/bin/qmake", candidates);
+    globQMakes("/usr/lib64", QStringList() << "qt*", "/bin/qmake", candidates);
+    for (const QFileInfo& version : QDir(home + "/Qt").entryInfoList(QStringList() << "[56].*", QDir::Dirs | QDir::NoDotAndDotDot))
+        globQMakes(version.absoluteFilePath(), QStringList() << "gcc_*", "/bin/qmake", candidates);
+    for (const QString& name : {"qmake6", "qmake-qt5", "qmake"})
+    {
+        const QString path = QStandardPaths::findExecutable(name);
+        if (!path.isEmpty())
+            candidates << path;
+    }
+
+    QList<QtKit> kits;
+    QStringList seen;
+    QStringList names;
+    for (const QString& qmake : candidates)
+    {
+        QFileInfo fi(qmake);
+        if (!fi.isExecutable())
+            continue;
+        // A qtchooser wrapper without a default config fails here
+        bool ok;
+        const QMap<QString, QString> query = queryQMake(fi.absoluteFilePath(), &ok);
+        if (!ok)
+            continue;
+        QtKit kit;
+        kit.qmake = fi.absoluteFilePath();
+        kit.version = QVersionNumber::fromString(query.value("QT_VERSION"));
+        kit.prefix = query.value("QT_INSTALL_PREFIX");
+        if (kit.version.isNull() || seen.contains(kit.prefix + " " + kit.version.toString()))
+            continue;
+        seen << kit.prefix + " " + kit.version.toString();
+        const QString prefixName = kit.prefix == "/usr" ? "system" : QFileInfo(kit.prefix).fileName();
+        kit.name = kit.version.toString() + "-" + prefixName;
+        for (int i = 2; names.contains(kit.name); i++)
+            kit.name = kit.version.toString() + "-" + prefixName + "-" + QString::number(i);
+        names << kit.name;
+        kits << kit;
+    }
+    return kits;
+}
+
+// The qt-matrix entries are version prefixes, 6 match every Qt 6 and 5.15 every 5.15.x
+static bool kitSelected(const ProjectDefinition& project, const QtKit& kit)
+{
+    if (project.qtMajorVersion == QtMajorVersion::Qt5 && kit.version.majorVersion() != 5)
+        return false;
+    if (project.qtMajorVersion == QtMajorVersion::Qt6 && kit.version.majorVersion() != 6)
+        return false;
+    if (project.qtMatrix.isEmpty())
+        return true;
+    for (const QString& entry : project.qtMatrix)
+    {
+        const QVersionNumber wanted = QVersionNumber::fromString(entry);
+        if (!wanted.isNull() && wanted.isPrefixOf(kit.version))
+            return true;
+    }
+    return false;
+}
+
+// Run a build step, its output goes to the kit log file instead of being mixed with the other kits
+static bool runKitStep(const QString& command, const QStringList& args, const QString& buildDir, QFile& log)
+{
+    Runner run;
+    log.write(QString("%1 %2\n").arg(command, args.join(" ")).toLocal8Bit());
+    // A compiler output can be huge, it is written as it comes
+    run.setLineHandler([&log](QProcess::ProcessChannel, const QByteArray& line) {
+        log.write(line + "\n");
+    });
+    bool ok = run.start(command, buildDir, args) && run.waitForFinished();
+    log.flush();
+    return ok;
+}
+
+static void buildKit(const ProjectDefinition& project, QtKit& kit, int jobs)
+{
+    TraceSpan trace("buildKit " + kit.name);
+    const QString buildDir = project.basePath + "/qt_matrix_build/" + kit.name;
+    QDir(buildDir).removeRecursively();
+    QDir().mkpath(buildDir);
+    QFile log(buildDir + "/sqpackager_build.log");
+    log.open(QIODevice::WriteOnly | QIODevice::Truncate);
+    const bool cmake = project.buildSystem == BuildSystem::CMake;
+    QElapsedTimer timer;
+    timer.start();
+    const QStringList configureArgs = cmake ? cmakeConfigureArguments(project, buildDir, QStringList(), kit.prefix)
+                                            : QStringList() << project.proFile << "CONFIG+=release";
+    if (!runKitStep(cmake ? "cmake" : kit.qmake, configureArgs, buildDir, log))
+    {
+        kit.failedStep = cmake ? "cmake" : "qmake";
+        return ;
+    }
+    kit.configureMs = timer.restart();
+    const QStringList buildArgs = cmake ? cmakeBuildArguments(buildDir, jobs) : QStringList() << "-j" + QString::number(jobs);
+    if (!runKitStep(cmake ? "cmake" : "make", buildArgs, buildDir, log))
+    {
+        kit.failedStep = cmake ? "ninja" : "make";
+        kit.buildMs = timer.elapsed();
+        return ;
+    }
+    kit.buildMs = timer.elapsed();
+    kit.ok = true;
+}
+
+void    buildQtMatrix(const ProjectDefinition& project)
+{
+    TraceSpan trace("buildQtMatrix");
+    printSummary("===== Building against every installed Qt =====");
+    QList<QtKit> kits;
+    for (const QtKit& kit : discoverQtKits())
+    {
+        const bool selected = kitSelected(project, kit);
+        println(QString("Found Qt %1 : %2%3").arg(kit.name, kit.qmake, selected ? "" : " (not selected)"));
+        if (selected)
+            kits << kit;
+    }
+    if (kits.isEmpty())
+        error_and_exit("No installed Qt matches the project, check the <qt-matrix> and <qt-major-version> fields");
+    // The kits are built at the same time, they share the jobs
+    const int jobs = qMax(1, gOptions.jobs / static_cast<int>(kits.size()));
+    QElapsedTimer timer;
+    timer.start();
+    QtConcurrent::blockingMap(kits, [&project, jobs](QtKit& kit) {
+        buildKit(project, kit, jobs);
+        println(QString("Qt %1 build %2").arg(kit.name, kit.ok ? "finished" : "failed at " + kit.failedStep));
+    });
+
+    printSummary(QString("Qt matrix results (%1 kits in %2 s, %3 jobs each)").arg(kits.size()).arg(timer.elapsed() / 1000., 0, 'f', 1).arg(jobs));
+    int failed = 0;
+    for (const QtKit& kit : kits)
+    {
+        const QString status = kit.ok ? "Ok" : "Failed (" + kit.failedStep + ")";
+        printSummary(QString("  %1 %2 configure %3 s, build %4 s - qt_matrix_build/%5/sqpackager_build.log")
+                     .arg(kit.name, -20).arg(status, -16).arg(kit.configureMs / 1000., 0, 'f', 1).arg(kit.buildMs / 1000., 0, 'f', 1).arg(kit.name));
+        if (!kit.ok)
+            failed++;
+    }
+    if (failed != 0)
+        error_and_exit(QString("%1 of the %2 Qt builds failed").arg(failed).arg(kits.size()));
+}
@@ -0,0 +1,155 @@
+#include <QCoreApplication>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMap>
+#include <QRegularExpression>
+#include <QSet>
+#include <QTemporaryDir>
+
+#include <reproducible.h>
+#include <sqpackager.h>
+#include <artifacts.h>
+#include <runner.h>
+#include <print.h>
+#include <trace.h>
+
+extern PackagerOptions gOptions;
+
+// Options the checking builds must not get, a restored cache entry would always match
+static const QStringList notReproducedOptions = {"verify-reproducible", "watch", "cache"};
+static const QStringList notReproducedValueOptions = {"cache-dir", "cache-url"};
+
+void    enableReproducibleBuild(const QString& projectDir)
+{
+    QByteArray epoch = qgetenv("SOURCE_DATE_EPOCH");
+    QString origin = "SOURCE_DATE_EPOCH";
+    if (epoch.isEmpty())
+    {
+        Runner run;
+        run.setOutputLimit(0);
+        if (run.run("git", projectDir, QStringList() << "log" << "-1" << "--format=%ct"))
+            epoch = run.getStdout().trimmed();
+        origin = "the last git commit";
+    }
+    bool ok;
+    const qint64 seconds = epoch.toLongLong(&ok);
+    if (!ok || seconds < 0)
+        error_and_exit("Reproducible builds need the SOURCE_DATE_EPOCH environment variable when the project is not in a git repository");
+    gOptions.reproducible = true;
+    gOptions.sourceDate = QDateTime::fromSecsSinceEpoch(seconds).toUTC();
+    qputenv("SOURCE_DATE_EPOCH", QByteArray::number(seconds));
+    println("Reproducible build, the source date is " + gOptions.sourceDate.toString(Qt::ISODate) + " from " + origin);
+}
+
+QDateTime   buildDateTime()
+{
+    if (gOptions.reproducible)
+        return gOptions.sourceDate;
+    return QDateTime::currentDateTime();
+}
+
+QStringList tarGzCreateArguments(const QString& archive)
+{
+    if (!gOptions.reproducible)
+        return QStringList() << "-zcf" << archive;
+    // gzip -n does not store the time in the gzip header
+    return QStringList() << "--sort=name" << "--mtime=@" + QString::number(gOptions.sourceDate.toSecsSinceEpoch())
+                         << "--owner=0" << "--group=0" << "--numeric-owner"
+                         << "--use-compress-program=gzip -n" << "-cf" << archive;
+}
+
+static QStringList  reproducedArguments()
+{
+    QStringList toret;
+    const QStringList arguments = QCoreApplication::arguments().mid(1);
+    for (int i = 0; i < arguments.size(); i++)
+    {
+        const QString name = QString(arguments.at(i)).remove(QRegularExpression("^--?")).section('=', 0, 0);
+        if (notReproducedOptions.contains(name))
+            continue;
+        if (notReproducedValueOptions.contains(name))
+        {
+            if (!arguments.at(i).contains('='))
+                i++;
+            continue;
+        }
+        toret << arguments.at(i);
+    }
+    return toret << "--reproducible";
+}
+
+// artifact path -> sha256
+static QMap<QString, QString>   readManifestHashes(const QString& manifestPath)
+{
+    QFile manifest(manifestPath);
+    if (!manifest.open(QIODevice::ReadOnly))
+        error_and_exit("Can't read " + manifestPath + " : " + manifest.errorString());
+    QMap<QString, QString> toret;
+    for (const QJsonValue& artifact : QJsonDocument::fromJson(manifest.readAll()).object().value("artifacts").toArray())
+        toret[artifact.toObject().value("path").toString()] = artifact.toObject().value("sha256").toString();
+    return toret;
+}
+
+/*
+ * The artifacts of the first build are copied in a temporary directory before the second one
+ * overwrites them, so the differing files can be compared with diffoscope. It is outside the
+ * project, createArchive would put them in the second build source tarball otherwise.
+ */
+bool    verifyReproducibleBuild(const ProjectDefinition& project)
+{
+    TraceSpan trace("verifyReproducibleBuild");
+    const QString manifestPath = artifactManifestPath(project);
+    QTemporaryDir firstBuild(QDir::tempPath() + "/sqpackager-reproducible-XXXXXX");
+    if (!firstBuild.isValid())
+        error_and_exit("Could not create a temporary directory for the first build artifacts : " + firstBuild.errorString());
+    const QString firstBuildDir = firstBuild.path();
+    const QStringList arguments = reproducedArguments();
+    QList<QMap<QString, QString>> builds;
+    for (int i = 1; i <= 2; i++)
+    {
+        printSummary(QString("Reproducibility check, build %1 of 2").arg(i));
+        QFile::remove(manifestPath);
+        Runner run(true);
+        if (!run.runWithOut(QCoreApplication::applicationFilePath(), arguments, QDir::currentPath()))
+            error_and_exit(QString("The build %1 of the reproducibility check failed").arg(i));
+        builds.append(readManifestHashes(manifestPath));
+        if (builds.last().isEmpty())
+            error_and_exit("The build did not produce any artifact to compare, give it a --build option");
+        if (i == 1)
+        {
+            for (const QString& path : builds.first().keys())
+            {
+                if (!QFile::copy(path, firstBuildDir + "/" + QFileInfo(path).fileName()))
+                    error_and_exit("Could not keep " + path + " from the first build in " + firstBuildDir);
+            }
+        }
+    }
+    QSet<QString> paths;
+    for (const auto& build : builds)
+    {
+        for (const QString& path : build.keys())
+            paths.insert(path);
+    }
+    int different = 0;
+    for (const QString& path : paths)
+    {
+        if (builds.at(0).value(path) == builds.at(1).value(path))
+            continue;
+        different++;
+        logMessage(LogLevel::Warning, "Not reproducible : " + path + "\n"
+                   + "\tdiffoscope " + firstBuildDir + "/" + QFileInfo(path).fileName() + " " + path + "\n");
+    }
+    if (different == 0)
+    {
+        printSummary(QString("The %1 artifact(s) are reproducible").arg(paths.size()));
+        return true;
+    }
+    firstBuild.setAutoRemove(false);
+    printSummary(QString("%1 of the %2 artifact(s) differ between the two builds, the first build files are in %3")
+                 .arg(different).arg(paths.size()).arg(firstBuildDir));
+    return false;
+}
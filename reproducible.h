@@ -0,0 +1,20 @@
+#pragma once
+
+#include <QDateTime>
+#include <QString>
+#include <QStringList>
+
+struct ProjectDefinition;
+
+/*
+ * With --reproducible every date written in an artifact is the source date: SOURCE_DATE_EPOCH when
+ * it is set, the time of the last git commit otherwise. It is exported so the tools we run
+ * (gcc __DATE__, dpkg, mksquashfs...) use the same date.
+ */
+void        enableReproducibleBuild(const QString& projectDir);
+// The source date in reproducible mode, the current time otherwise
+QDateTime   buildDateTime();
+// The tar arguments to create a .tar.gz archive, sorted and with normalized times and owners in reproducible mode
+QStringList tarGzCreateArguments(const QString& archive);
+// Run sqpackager twice in reproducible mode with the same arguments and compare the artifact hashes
+bool        verifyReproducibleBuild(const ProjectDefinition& project);
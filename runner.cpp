@@ -1,10 +1,83 @@
+#include <QElapsedTimer>
+#include <cstring>
+
 #include "runner.h"
 #include "print.h"
+#include "trace.h"
+
+// The output is read at least this often (ms) while waiting for a command
+static const int outputPollInterval = 50;
+
+void OutputTail::setCapacity(int capacity)
+{
+    m_capacity = capacity;
+    clear();
+}
+
+int OutputTail::capacity() const
+{
+    return m_capacity;
+}
+
+void OutputTail::append(const QByteArray& data)
+{
+    if (m_capacity == 0)
+    {
+        m_buffer.append(data);
+        return ;
+    }
+    if (data.size() >= m_capacity)
+    {
+        m_dropped += m_buffer.size() + data.size() - m_capacity;
+        m_buffer = data.right(m_capacity);
+        m_start = 0;
+        return ;
+    }
+    const char* source = data.constData();
+    int left = data.size();
+    if (m_buffer.size() < m_capacity)
+    {
+        const int length = qMin(left, m_capacity - m_buffer.size());
+        m_buffer.append(source, length);
+        source += length;
+        left -= length;
+    }
+    // Full, overwrite from the oldest byte
+    while (left > 0)
+    {
+        const int length = qMin(left, m_capacity - m_start);
+        std::memcpy(m_buffer.data() + m_start, source, length);
+        m_start = (m_start + length) % m_capacity;
+        m_dropped += length;
+        source += length;
+        left -= length;
+    }
+}
+
+void OutputTail::clear()
+{
+    m_buffer.clear();
+    m_start = 0;
+    m_dropped = 0;
+}
+
+QByteArray OutputTail::contents() const
+{
+    if (m_start == 0)
+        return m_buffer;
+    return m_buffer.mid(m_start) + m_buffer.left(m_start);
+}
+
+qint64 OutputTail::dropped() const
+{
+    return m_dropped;
+}
 
 Runner::Runner(bool verbose, bool dummy)
 {
     m_verbose = verbose;
     m_dummy = dummy;
+    setOutputLimit(errorTailSize);
 }
 
 bool Runner::run(QString command)
@@ -19,8 +92,11 @@ bool Runner::run(QString command, QStringList args)
         println(command + " " + args.join(" "));
     if (m_dummy)
         return true;
+    resetOutput();
     m_process.start(command, args);
-    bool finished = m_process.waitForFinished();
+    traceStarted();
+    bool finished = waitForOutput(30000);
+    traceFinished(command, args);
     if (finished)
         return m_process.exitCode() == 0;
     return false;
@@ -35,10 +111,13 @@ bool Runner::run(QString command, QString workingDir, QStringList args)
     if (m_dummy)
         return true;
     m_process.setWorkingDirectory(workingDir);
+    resetOutput();
     m_process.start(command, args);
+    traceStarted();
     //printlnYes("Started : ", m_process.waitForStarted());
     //println(m_process.errorString());
-    bool finished = m_process.waitForFinished();
+    bool finished = waitForOutput(30000);
+    traceFinished(command, args);
     //printlnYes("Finished : ", finished);
     //println(QString::number(m_process.exitCode()));
     m_process.setWorkingDirectory(oldWD);
@@ -63,20 +142,169 @@ bool Runner::runWithOut(QString command, QStringList args, QString workingDir)
     QProcess::ProcessChannelMode oldMode = m_process.processChannelMode();
     m_process.setProcessChannelMode(QProcess::MergedChannels);
     m_process.setReadChannel(QProcess::StandardOutput);
+    resetOutput();
     m_process.start(command, args);
     bool started = m_process.waitForStarted();
-    if (!started)
-        return false;
-    m_process.waitForReadyRead();
-    while (!m_process.atEnd())
+    traceStarted();
+    if (started)
     {
-        println(m_process.readAll());
-        m_process.waitForReadyRead();
+        // The output is already shown, only its end is kept even when everything was asked
+        const int outputLimit = m_stdout.capacity();
+        if (outputLimit == 0 || outputLimit > errorTailSize)
+            setOutputLimit(errorTailSize);
+        m_echo = true;
+        waitForOutput(-1);
+        m_echo = false;
+        traceFinished(command, args);
+        if (outputLimit != m_stdout.capacity())
+        {
+            const QByteArray tail = m_stdout.contents();
+            setOutputLimit(outputLimit);
+            m_stdout.append(tail);
+        }
     }
-    m_process.waitForFinished();
     m_process.setWorkingDirectory(oldWD);
     m_process.setProcessChannelMode(oldMode);
-    return m_process.exitCode() == 0;
+    return started && m_process.exitCode() == 0;
+}
+
+bool Runner::start(QString command, QString workingDir, QStringList args)
+{
+    if (m_verbose)
+        println("{" + workingDir + "} " + command + " " + args.join(" "));
+    if (m_dummy)
+        return true;
+    m_process.setWorkingDirectory(workingDir);
+    resetOutput();
+    m_process.start(command, args);
+    bool started = m_process.waitForStarted();
+    traceStarted();
+    return started;
+}
+
+bool Runner::waitForFinished()
+{
+    if (m_dummy)
+        return true;
+    bool finished = waitForOutput(-1);
+    traceFinished(m_process.program(), m_process.arguments());
+    m_process.setWorkingDirectory(QString());
+    if (finished)
+        return m_process.exitStatus() == QProcess::NormalExit && m_process.exitCode() == 0;
+    return false;
+}
+
+void Runner::setLineHandler(LineHandler handler)
+{
+    m_lineHandler = handler;
+}
+
+void Runner::setOutputLimit(int bytes)
+{
+    m_stdout.setCapacity(bytes);
+    m_stderr.setCapacity(bytes);
+}
+
+void Runner::resetOutput()
+{
+    m_stdout.clear();
+    m_stderr.clear();
+    m_partialStdout.clear();
+    m_partialStderr.clear();
+}
+
+/*
+ * The output is taken out of QProcess while the command runs so it does not pile up in its buffers
+ * waitForReadyRead only wakes up for the current read channel, waiting a bit for the end reads both pipes
+ */
+bool Runner::waitForOutput(int msecs)
+{
+    QElapsedTimer timer;
+    timer.start();
+    bool finished = false;
+    while (m_process.state() != QProcess::NotRunning)
+    {
+        int wait = outputPollInterval;
+        if (msecs >= 0)
+            wait = static_cast<int>(qMin<qint64>(wait, msecs - timer.elapsed()));
+        if (wait <= 0)
+            break;
+        finished = m_process.waitForFinished(wait);
+        readOutput();
+        if (finished)
+            break;
+    }
+    readOutput();
+    flushPartialLines();
+    return finished;
+}
+
+void Runner::readOutput()
+{
+    handleOutput(QProcess::StandardOutput, m_process.readAllStandardOutput());
+    handleOutput(QProcess::StandardError, m_process.readAllStandardError());
+}
+
+void Runner::handleOutput(QProcess::ProcessChannel channel, const QByteArray& data)
+{
+    if (data.isEmpty())
+        return ;
+    if (m_echo)
+        printOutput(data);
+    if (channel == QProcess::StandardOutput)
+        m_stdout.append(data);
+    else
+        m_stderr.append(data);
+    if (!m_lineHandler)
+        return ;
+    QByteArray& partial = channel == QProcess::StandardOutput ? m_partialStdout : m_partialStderr;
+    partial.append(data);
+    int start = 0;
+    int end;
+    while ((end = partial.indexOf('\n', start)) != -1)
+    {
+        int length = end - start;
+        if (length > 0 && partial.at(end - 1) == '\r')
+            length--;
+        m_lineHandler(channel, partial.mid(start, length));
+        start = end + 1;
+    }
+    partial.remove(0, start);
+    // A tool redrawing a progress line never ends it, it is given in pieces
+    if (partial.size() > errorTailSize)
+    {
+        m_lineHandler(channel, partial);
+        partial.clear();
+    }
+}
+
+void Runner::flushPartialLines()
+{
+    if (!m_lineHandler)
+        return ;
+    if (!m_partialStdout.isEmpty())
+        m_lineHandler(QProcess::StandardOutput, m_partialStdout);
+    if (!m_partialStderr.isEmpty())
+        m_lineHandler(QProcess::StandardError, m_partialStderr);
+    m_partialStdout.clear();
+    m_partialStderr.clear();
+}
+
+void Runner::traceStarted()
+{
+    if (!traceEnabled())
+        return ;
+    // The pid is not available anymore once the process finished
+    m_process.waitForStarted();
+    m_tracePid = m_process.processId();
+    m_traceStart = traceTimestamp();
+}
+
+void Runner::traceFinished(const QString& command, const QStringList& args)
+{
+    if (!traceEnabled())
+        return ;
+    traceProcess(command, args, m_tracePid, m_traceStart, m_process.exitStatus() == QProcess::NormalExit ? m_process.exitCode() : -1);
 }
 
 bool Runner::pathContains(QString toSearch)
@@ -101,12 +329,16 @@ const int Runner::exitCode() const
 
 QByteArray Runner::getStdout()
 {
-    return m_process.readAllStandardOutput();
+    QByteArray toret = m_stdout.contents();
+    m_stdout.clear();
+    return toret;
 }
 
 QByteArray Runner::getStderr()
 {
-    return m_process.readAllStandardError();
+    QByteArray toret = m_stderr.contents();
+    m_stderr.clear();
+    return toret;
 }
 
 QProcessEnvironment Runner::env() const
@@ -130,4 +362,5 @@ Runner::Runner()
 {
     m_verbose = false;
     m_dummy = false;
+    setOutputLimit(errorTailSize);
 }
@@ -4,20 +4,57 @@
 #include <QProcess>
 #include <QString>
 #include <QByteArray>
+#include <functional>
+
+/*
+ * Keep the last bytes of a child process output, the oldest ones are overwritten
+ * A capacity of 0 keeps everything
+ */
+class OutputTail
+{
+public:
+    void        setCapacity(int capacity);
+    int         capacity() const;
+    void        append(const QByteArray& data);
+    void        clear();
+    QByteArray  contents() const;
+    // Bytes overwritten since the last clear
+    qint64      dropped() const;
+
+private:
+    QByteArray  m_buffer;
+    int         m_capacity = 0;
+    int         m_start = 0;
+    qint64      m_dropped = 0;
+};
 
 class Runner
 {
 public:
+    // Enough of the end of an output to report why a tool failed
+    static const int    errorTailSize = 64 * 1024;
+    // Each line of the output is given to the handler while the command runs, without its end of line
+    using LineHandler = std::function<void(QProcess::ProcessChannel channel, const QByteArray& line)>;
+
     Runner();
     Runner(bool verbose, bool dummy = false);
     bool        run(QString command);
     bool        run(QString command, QStringList args);
     bool        run(QString command, QString workingDir, QStringList args);
     bool        runWithOut(QString command, QStringList args, QString workingDir = "");
+    // Start the command without waiting, waitForFinished must be called before reusing the runner
+    bool        start(QString command, QString workingDir, QStringList args);
+    bool        waitForFinished();
+
+    void        setLineHandler(LineHandler handler);
+    // Only the last errorTailSize bytes of each channel are kept for getStdout/getStderr by default,
+    // 0 keeps everything for the callers parsing the output. runWithOut always keeps only the tail.
+    void        setOutputLimit(int bytes);
 
     bool        pathContains(QString path);
     void        addPath(QString path);
     const int   exitCode() const;
+    // The output kept since the command started, reading it empties it
     QByteArray  getStdout();
     QByteArray  getStderr();
     QProcessEnvironment env() const;
@@ -25,9 +62,23 @@ public:
     void        setEnv(QProcessEnvironment env);
 
 private:
+    void        traceStarted();
+    void        traceFinished(const QString& command, const QStringList& args);
+    void        resetOutput();
+    bool        waitForOutput(int msecs);
+    void        readOutput();
+    void        handleOutput(QProcess::ProcessChannel channel, const QByteArray& data);
+    void        flushPartialLines();
+
     QProcess    m_process;
-    QByteArray  m_stdout;
-    QByteArray  m_stderr;
+    qint64      m_traceStart = 0;
+    qint64      m_tracePid = 0;
+    OutputTail  m_stdout;
+    OutputTail  m_stderr;
+    QByteArray  m_partialStdout;
+    QByteArray  m_partialStderr;
+    LineHandler m_lineHandler;
+    bool        m_echo = false;
     bool        m_verbose;
     bool        m_dummy;
 };
@@ -0,0 +1,370 @@
+#include <QThread>
+#include <QtEndian>
+#include <QtConcurrent>
+#include <lzma.h>
+#include <sevenziparchive.h>
+
+// Property ids and values from the 7z format description of 7-Zip
+enum SevenZipConstants : quint8 {
+    SevenZipEnd = 0x00,
+    SevenZipHeader = 0x01,
+    SevenZipMainStreamsInfo = 0x04,
+    SevenZipFilesInfo = 0x05,
+    SevenZipPackInfo = 0x06,
+    SevenZipUnpackInfo = 0x07,
+    SevenZipSubStreamsInfo = 0x08,
+    SevenZipSize = 0x09,
+    SevenZipCrc = 0x0A,
+    SevenZipFolder = 0x0B,
+    SevenZipCodersUnpackSize = 0x0C,
+    SevenZipNumUnpackStream = 0x0D,
+    SevenZipEmptyStream = 0x0E,
+    SevenZipEmptyFile = 0x0F,
+    SevenZipName = 0x11,
+    SevenZipMTime = 0x14,
+    SevenZipWinAttributes = 0x15,
+    SevenZipLzma2Id = 0x21,
+    // One byte codec id, followed by properties
+    SevenZipCoderFlags = 0x21,
+    SevenZipSignatureHeaderSize = 32,
+    WindowsAttributeArchive = 0x20
+};
+
+// Files are grouped in solid blocks of this size, a bigger file gets a block of its own
+static const qint64 blockSize = 64 * 1024 * 1024;
+// The preset 7-Zip uses for -m0=lzma2, its dictionary is 16MiB
+static const quint32 lzmaPreset = 7;
+// Milliseconds between the 1601 FILETIME epoch and the unix one
+static const qint64 fileTimeEpochOffset = 11644473600000ll;
+
+template<typename T>
+static void append(QByteArray& out, T value)
+{
+    value = qToLittleEndian(value);
+    out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+// The 7z variable length number, the bits set at the top of the first byte give the number of bytes following it
+static void appendNumber(QByteArray& out, quint64 value)
+{
+    quint8 first = 0;
+    quint8 mask = 0x80;
+    int i;
+    for (i = 0; i < 8; i++)
+    {
+        if (value < (quint64(1) << (7 * (i + 1))))
+        {
+            first |= quint8(value >> (8 * i));
+            break;
+        }
+        first |= mask;
+        mask >>= 1;
+    }
+    out.append(char(first));
+    for (; i > 0; i--)
+    {
+        out.append(char(value & 0xFF));
+        value >>= 8;
+    }
+}
+
+static void appendBits(QByteArray& out, const QList<bool>& bits)
+{
+    quint8 byte = 0;
+    for (int i = 0; i < bits.size(); i++)
+    {
+        if (bits.at(i))
+            byte |= 0x80 >> (i % 8);
+        if (i % 8 == 7)
+        {
+            out.append(char(byte));
+            byte = 0;
+        }
+    }
+    if (bits.size() % 8 != 0)
+        out.append(char(byte));
+}
+
+static void appendProperty(QByteArray& out, quint8 id, const QByteArray& data)
+{
+    out.append(char(id));
+    appendNumber(out, data.size());
+    out.append(data);
+}
+
+// The smallest 2^n or 3 * 2^n LZMA2 dictionary size holding size
+static quint8 dictionaryProperty(quint32 size)
+{
+    for (quint8 p = 0; p < 40; p++)
+    {
+        if ((quint64(2 | (p & 1)) << (p / 2 + 11)) >= size)
+            return p;
+    }
+    return 40;
+}
+
+static quint32 dictionarySize(quint8 property)
+{
+    return property >= 40 ? 0xFFFFFFFF : quint32(2 | (property & 1)) << (property / 2 + 11);
+}
+
+// A raw LZMA2 stream, like the one of a 7z folder with a single coder. Empty on error
+static QByteArray lzma2Compress(const QByteArray& data, quint32 dictionary)
+{
+    lzma_options_lzma options;
+    if (lzma_lzma_preset(&options, lzmaPreset))
+        return QByteArray();
+    options.dict_size = qMax(quint32(LZMA_DICT_SIZE_MIN), qMin(options.dict_size, dictionary));
+    lzma_filter filters[] = {{LZMA_FILTER_LZMA2, &options}, {LZMA_VLI_UNKNOWN, nullptr}};
+    // Incompressible data is stored in uncompressed chunks of at most 64KiB with a 3 bytes header, the encoder
+    // needs more room than that while it tries to compress a chunk
+    QByteArray out(data.size() + data.size() / 64 + 64 * 1024, Qt::Uninitialized);
+    size_t outSize = 0;
+    if (lzma_raw_buffer_encode(filters, nullptr, reinterpret_cast<const uint8_t*>(data.constData()), data.size(),
+                               reinterpret_cast<uint8_t*>(out.data()), &outSize, out.size()) != LZMA_OK)
+        return QByteArray();
+    out.resize(outSize);
+    return out;
+}
+
+static quint32 crc32(const QByteArray& data)
+{
+    return lzma_crc32(reinterpret_cast<const uint8_t*>(data.constData()), data.size(), 0);
+}
+
+SevenZipArchive::SevenZipArchive(const QString& path)
+    : m_file(path)
+{
+}
+
+SevenZipArchive::~SevenZipArchive()
+{
+    for (Block& block : m_blocks)
+        block.packed.waitForFinished();
+    // Not closed, the archive is incomplete
+    if (m_file.isOpen())
+    {
+        m_file.close();
+        m_file.remove();
+    }
+}
+
+bool    SevenZipArchive::open(QString* error)
+{
+    QString dummy;
+    QString& err = error != nullptr ? *error : dummy;
+    if (!m_file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    {
+        err = m_file.errorString();
+        return false;
+    }
+    // The signature header is written by close, when the header position is known
+    const QByteArray signatureHeader(SevenZipSignatureHeaderSize, '\0');
+    if (m_file.write(signatureHeader) != signatureHeader.size())
+    {
+        err = m_file.errorString();
+        m_file.close();
+        m_file.remove();
+        return false;
+    }
+    return true;
+}
+
+void    SevenZipArchive::addFile(const QByteArray& name, const QByteArray& content, quint32 crc, const QDateTime& time)
+{
+    if (!m_error.isEmpty())
+        return ;
+    m_files.append({name, content.size(), crc, time});
+    // Empty files have no stream
+    if (content.isEmpty())
+        return ;
+    m_pending.append(content);
+    m_pendingFiles++;
+    if (m_pending.size() >= blockSize)
+        startBlock();
+}
+
+void    SevenZipArchive::startBlock()
+{
+    Block block;
+    block.unpackSize = m_pending.size();
+    block.fileCount = m_pendingFiles;
+    block.dictionaryProperty = dictionaryProperty(quint32(qMin(block.unpackSize, qint64(0xFFFFFFFF))));
+    const quint32 dictionary = dictionarySize(block.dictionaryProperty);
+    const QByteArray data = m_pending;
+    block.packed = QtConcurrent::run([data, dictionary] {
+        return lzma2Compress(data, dictionary);
+    });
+    m_blocks.append(block);
+    m_pending = QByteArray();
+    m_pendingFiles = 0;
+    // Each block waiting for the file holds up to blockSize bytes twice, the oldest one is waited for
+    // when there are more blocks in flight than threads
+    while (m_written < m_blocks.size()
+           && (m_blocks.at(m_written).packed.isFinished() || m_blocks.size() - m_written > QThread::idealThreadCount()))
+        writeBlock(m_blocks[m_written++]);
+}
+
+void    SevenZipArchive::writeBlock(Block& block)
+{
+    const QByteArray packed = block.packed.result();
+    // The result is not needed anymore, only the sizes are
+    block.packed = QFuture<QByteArray>();
+    if (!m_error.isEmpty())
+        return ;
+    if (packed.isEmpty())
+    {
+        m_error = "LZMA2 compression failed";
+        return ;
+    }
+    if (m_file.write(packed) != packed.size())
+    {
+        m_error = m_file.errorString();
+        return ;
+    }
+    block.packSize = packed.size();
+}
+
+QByteArray  SevenZipArchive::header() const
+{
+    QByteArray out;
+    // Like 7-Zip, an empty archive is only the signature header
+    if (m_files.isEmpty())
+        return out;
+    out.append(char(SevenZipHeader));
+    if (!m_blocks.isEmpty())
+    {
+        out.append(char(SevenZipMainStreamsInfo));
+        out.append(char(SevenZipPackInfo));
+        appendNumber(out, 0); // pack position, right after the signature header
+        appendNumber(out, m_blocks.size());
+        out.append(char(SevenZipSize));
+        for (const Block& block : m_blocks)
+            appendNumber(out, block.packSize);
+        out.append(char(SevenZipEnd));
+
+        out.append(char(SevenZipUnpackInfo));
+        out.append(char(SevenZipFolder));
+        appendNumber(out, m_blocks.size());
+        out.append(char(0)); // not external
+        for (const Block& block : m_blocks)
+        {
+            appendNumber(out, 1); // one coder
+            out.append(char(SevenZipCoderFlags));
+            out.append(char(SevenZipLzma2Id));
+            appendNumber(out, 1);
+            out.append(char(block.dictionaryProperty));
+        }
+        out.append(char(SevenZipCodersUnpackSize));
+        for (const Block& block : m_blocks)
+            appendNumber(out, block.unpackSize);
+        out.append(char(SevenZipEnd));
+
+        // The files of a block are its substreams, the size of the last one is what is left
+        out.append(char(SevenZipSubStreamsInfo));
+        bool oneFilePerBlock = true;
+        for (const Block& block : m_blocks)
+            oneFilePerBlock = oneFilePerBlock && block.fileCount == 1;
+        if (!oneFilePerBlock)
+        {
+            out.append(char(SevenZipNumUnpackStream));
+            for (const Block& block : m_blocks)
+                appendNumber(out, block.fileCount);
+            out.append(char(SevenZipSize));
+            int fileIndex = 0;
+            for (const Block& block : m_blocks)
+            {
+                for (int i = 0; i < block.fileCount; i++)
+                {
+                    while (m_files.at(fileIndex).size == 0)
+                        fileIndex++;
+                    if (i < block.fileCount - 1)
+                        appendNumber(out, m_files.at(fileIndex).size);
+                    fileIndex++;
+                }
+            }
+        }
+        out.append(char(SevenZipCrc));
+        out.append(char(1)); // all defined
+        for (const File& file : m_files)
+        {
+            if (file.size != 0)
+                append<quint32>(out, file.crc);
+        }
+        out.append(char(SevenZipEnd));
+        out.append(char(SevenZipEnd));
+    }
+
+    out.append(char(SevenZipFilesInfo));
+    appendNumber(out, m_files.size());
+    QList<bool> emptyStreams;
+    QList<bool> emptyFiles;
+    for (const File& file : m_files)
+    {
+        emptyStreams.append(file.size == 0);
+        if (file.size == 0)
+            emptyFiles.append(true);
+    }
+    // Without the empty file property an entry without stream is a directory
+    if (!emptyFiles.isEmpty())
+    {
+        QByteArray bits;
+        appendBits(bits, emptyStreams);
+        appendProperty(out, SevenZipEmptyStream, bits);
+        bits.clear();
+        appendBits(bits, emptyFiles);
+        appendProperty(out, SevenZipEmptyFile, bits);
+    }
+    QByteArray names(1, '\0'); // not external
+    QByteArray times(2, '\0');
+    times[0] = 1; // all defined, not external
+    QByteArray attributes = times;
+    for (const File& file : m_files)
+    {
+        for (QChar c : QString::fromUtf8(file.name))
+            append<quint16>(names, c.unicode());
+        append<quint16>(names, 0);
+        append<quint64>(times, quint64(file.time.toMSecsSinceEpoch() + fileTimeEpochOffset) * 10000);
+        append<quint32>(attributes, WindowsAttributeArchive);
+    }
+    appendProperty(out, SevenZipName, names);
+    appendProperty(out, SevenZipMTime, times);
+    appendProperty(out, SevenZipWinAttributes, attributes);
+    out.append(char(SevenZipEnd));
+    out.append(char(SevenZipEnd));
+    return out;
+}
+
+bool    SevenZipArchive::close(QString* error)
+{
+    QString dummy;
+    QString& err = error != nullptr ? *error : dummy;
+    if (!m_pending.isEmpty())
+        startBlock();
+    while (m_written < m_blocks.size())
+        writeBlock(m_blocks[m_written++]);
+    if (m_error.isEmpty())
+    {
+        const QByteArray nextHeader = header();
+        QByteArray startHeader;
+        append<quint64>(startHeader, m_file.pos() - SevenZipSignatureHeaderSize);
+        append<quint64>(startHeader, nextHeader.size());
+        append<quint32>(startHeader, crc32(nextHeader));
+        QByteArray signatureHeader("7z\xBC\xAF\x27\x1C", 6);
+        signatureHeader.append(char(0));
+        signatureHeader.append(char(4));
+        append<quint32>(signatureHeader, crc32(startHeader));
+        signatureHeader.append(startHeader);
+        if (m_file.write(nextHeader) != nextHeader.size() || !m_file.seek(0)
+            || m_file.write(signatureHeader) != signatureHeader.size() || !m_file.flush())
+            m_error = m_file.errorString();
+    }
+    m_file.close();
+    if (!m_error.isEmpty())
+    {
+        err = m_error;
+        m_file.remove();
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <QString>
+#include <QByteArray>
+#include <QDateTime>
+#include <QFile>
+#include <QFuture>
+#include <QList>
+
+/*
+ * Write a 7z archive from files given one by one, like the ones read by writeZipArchive
+ * The files are LZMA2 compressed in solid blocks, a block is compressed in the background
+ * while the next files are added and the blocks are written in order
+ */
+class SevenZipArchive
+{
+public:
+    SevenZipArchive(const QString& path);
+    ~SevenZipArchive();
+    bool        open(QString* error = nullptr);
+    // The name uses / as separator, the errors are reported by close
+    void        addFile(const QByteArray& name, const QByteArray& content, quint32 crc, const QDateTime& time);
+    // Write the remaining blocks and the header, the archive is removed on error
+    bool        close(QString* error = nullptr);
+
+private:
+    struct File
+    {
+        QByteArray  name;
+        qint64      size;
+        quint32     crc;
+        QDateTime   time;
+    };
+    struct Block
+    {
+        QFuture<QByteArray> packed;
+        qint64              unpackSize;
+        int                 fileCount;
+        quint8              dictionaryProperty;
+        qint64              packSize = 0;
+    };
+
+    void        startBlock();
+    void        writeBlock(Block& block);
+    QByteArray  header() const;
+
+    QFile       m_file;
+    QList<File> m_files;
+    QList<Block> m_blocks;
+    QByteArray  m_pending;
+    int         m_pendingFiles = 0;
+    // The first block not written yet
+    int         m_written = 0;
+    QString     m_error;
+};
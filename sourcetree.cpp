@@ -0,0 +1,105 @@
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QCryptographicHash>
+#include <QRegularExpression>
+#include <sourcetree.h>
+#include <basestuff.h>
+
+/*
+ * These are VCS metadata and everything SQPackager (or the tools it calls) write
+ * in the project directory. None of this belongs in a source snapshot.
+ */
+const QStringList sourceTreeExcludes = {
+    ".git",
+    ".gitmodules",
+    ".svn",
+    ".hg",
+    ".flatpak-builder",
+    "flat-build-dir",
+    "flatpak-build-dir",
+    "flatpak-export",
+    "*.flatpak",
+    "project_build_dir",
+    "appimage_build",
+    "*.AppImage",
+    "linux_standalone_build",
+    "qt_matrix_build",
+    "windows_build",
+    "windows_deploy",
+    "sqpackager_dist",
+    "sqpackager-artifacts.json",
+    "sq_project_forced_version.pri",
+    "*.pro.user"
+};
+
+const QString sourceDistDir = "sqpackager_dist";
+
+static QList<QRegularExpression> excludeExpressions()
+{
+    QList<QRegularExpression> toret;
+    for (const QString& pattern : sourceTreeExcludes)
+        toret.append(QRegularExpression(QRegularExpression::wildcardToRegularExpression(pattern)));
+    return toret;
+}
+
+bool    isExcludedFromSources(const QString& fileName)
+{
+    static const QList<QRegularExpression> expressions = excludeExpressions();
+    for (const QRegularExpression& exp : expressions)
+    {
+        if (exp.match(fileName).hasMatch())
+            return true;
+    }
+    return false;
+}
+
+static void    walkSourceTree(const QDir& dir, const QString& relativePath, SourceSnapshot& snapshot)
+{
+    const auto entries = dir.entryInfoList(QDir::AllEntries | QDir::Hidden | QDir::System | QDir::NoDotAndDotDot, QDir::Name);
+    for (const QFileInfo& fi : entries)
+    {
+        const QString relative = relativePath.isEmpty() ? fi.fileName() : relativePath + "/" + fi.fileName();
+        if (isExcludedFromSources(fi.fileName()))
+        {
+            snapshot.skipped.append(relative);
+            continue;
+        }
+        if (fi.isDir() && !fi.isSymLink())
+            walkSourceTree(QDir(fi.absoluteFilePath()), relative, snapshot);
+        else
+            snapshot.files.append(relative);
+    }
+}
+
+/*
+ * Walk the source tree, without going into the excluded directories
+ */
+SourceSnapshot  sourceSnapshot(const QString& path)
+{
+    SourceSnapshot snapshot;
+    walkSourceTree(QDir(path), QString(), snapshot);
+    return snapshot;
+}
+
+QByteArray      sourceSnapshotHash(const QString& path, const SourceSnapshot& snapshot)
+{
+    QDir    baseDir(path);
+    QCryptographicHash hash(QCryptographicHash::Sha256);
+    for (const QString& file : snapshot.files)
+    {
+        QFile f(baseDir.filePath(file));
+        hash.addData(file.toUtf8());
+        hash.addData(QByteArray(1, '\0'));
+        QFileInfo fi(f);
+        if (fi.isSymLink())
+        {
+            hash.addData(fi.symLinkTarget().toUtf8());
+            continue;
+        }
+        if (!f.open(QIODevice::ReadOnly))
+            error_and_exit("Can't open " + f.fileName() + " to hash it : " + f.errorString());
+        hash.addData(&f);
+    }
+    return hash.result().toHex();
+}
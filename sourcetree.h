@@ -0,0 +1,20 @@
+#pragma once
+
+#include <QString>
+#include <QStringList>
+#include <QByteArray>
+
+struct SourceSnapshot
+{
+    QStringList files; // relative to the snapshot path
+    QStringList skipped;
+};
+
+extern const QStringList sourceTreeExcludes;
+// The tarballs are written there, they are not sources and would change the next source snapshot
+extern const QString     sourceDistDir;
+
+bool            isExcludedFromSources(const QString& fileName);
+SourceSnapshot  sourceSnapshot(const QString& path);
+// sha256 hex of the paths and content of the snapshot files, this reads the whole tree
+QByteArray      sourceSnapshotHash(const QString& path, const SourceSnapshot& snapshot);
@@ -1,5 +1,6 @@
 #ifndef SQPACKAGER_H
 #define SQPACKAGER_H
+#include <QDateTime>
 #include <projectdefinition.h>
 
 struct  PackagerOptions
@@ -7,18 +8,42 @@ struct  PackagerOptions
     QString qmakePath;
     QString windowsBuildPath;
     QString windowsDeployPath;
+    int     jobs;
+    bool    flatpakIncremental;
+    QString flatpakRepo;
+    int     flatpakDeltaDepth;
+    QString appImageRuntime;
+    QString windowsCrossQt;
+    QString windowsCrossToolchain;
+    QString cacheDir;
+    QString cacheUrl;
+    bool    reproducible;
+    QDateTime sourceDate;
 };
 
-bool    checkFlatPak(const ProjectDefinition project, bool bypass = false);
+bool    checkFlatPak(const ProjectDefinition& project, bool bypass = false);
 void    generateFlatPakFile(ProjectDefinition& project);
 void    buildFlatPak(const ProjectDefinition& project);
 
 void    generateDebianFiles(ProjectDefinition& project);
+void    setDebianDefinition(ProjectDefinition& project);
+void    generateDebianRules(const ProjectDefinition& project);
+void    generateDebianControl(const ProjectDefinition& project);
+void    generateDebianCopyright(const ProjectDefinition& project);
 bool    checkDebian(const ProjectDefinition& project);
 void    buildDebian(const ProjectDefinition& project);
 void    prepareDebian(const ProjectDefinition& project);
+QString getDebianVersion(const ProjectDefinition& proj);
+
+bool    checkAppImage(const ProjectDefinition& project);
+void    buildAppImage(const ProjectDefinition& project);
+
+void    buildLinuxStandalone(const ProjectDefinition& project);
+
+void    buildQtMatrix(const ProjectDefinition& project);
 
 void    genWindows(ProjectDefinition& project);
 void    buildWindows(ProjectDefinition &project);
+void    buildWindowsCross(ProjectDefinition& project);
 
 #endif // SQPACKAGER_H
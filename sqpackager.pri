@@ -0,0 +1,74 @@
+# Everything but main.cpp, shared by the application and the benchmarks in tests/benchmarks
+
+QT += gui concurrent
+
+CONFIG += c++17
+
+# You can make your code fail to compile if it uses deprecated APIs.
+# In order to do so, uncomment the following line.
+DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
+
+INCLUDEPATH += $$PWD
+
+# The AppImage squashfs image is written in-process with zstd compression, the Windows 7z archive with liblzma
+unix {
+    CONFIG += link_pkgconfig
+    PKGCONFIG += libzstd liblzma
+}
+win32: LIBS += -lzstd -llzma
+
+SOURCES += \
+        $$PWD/appimage.cpp \
+        $$PWD/artifacts.cpp \
+        $$PWD/basestuff.cpp \
+        $$PWD/buildsystem.cpp \
+        $$PWD/cache.cpp \
+        $$PWD/debian/debian.cpp \
+        $$PWD/elfreader.cpp \
+        $$PWD/flatpak.cpp \
+        $$PWD/github.cpp \
+        $$PWD/linuxdeploy.cpp \
+        $$PWD/linuxstandalone.cpp \
+        $$PWD/print.cpp \
+        $$PWD/qtmatrix.cpp \
+        $$PWD/reproducible.cpp \
+        $$PWD/runner.cpp \
+        $$PWD/sevenziparchive.cpp \
+        $$PWD/sourcetree.cpp \
+        $$PWD/squashfsimage.cpp \
+        $$PWD/trace.cpp \
+        $$PWD/Windows/peimports.cpp \
+        $$PWD/Windows/variantbuild.cpp \
+        $$PWD/Windows/windows.cpp \
+        $$PWD/desktoprc.cpp \
+        $$PWD/imageinfo.cpp \
+        $$PWD/unix.cpp \
+        $$PWD/watch.cpp \
+        $$PWD/ziparchive.cpp
+
+HEADERS += \
+    $$PWD/artifacts.h \
+    $$PWD/basestuff.h \
+    $$PWD/buildsystem.h \
+    $$PWD/cache.h \
+    $$PWD/compile_defines.h \
+    $$PWD/elfreader.h \
+    $$PWD/github.h \
+    $$PWD/linuxdeploy.h \
+    $$PWD/print.h \
+    $$PWD/projectdefinition.h \
+    $$PWD/reproducible.h \
+    $$PWD/runner.h \
+    $$PWD/sevenziparchive.h \
+    $$PWD/sourcetree.h \
+    $$PWD/squashfsimage.h \
+    $$PWD/trace.h \
+    $$PWD/desktoprc.h \
+    $$PWD/imageinfo.h \
+    $$PWD/sqpackager.h \
+    $$PWD/watch.h \
+    $$PWD/ziparchive.h \
+    $$PWD/Windows/peimports.h \
+    $$PWD/Windows/variantbuild.h
+
+RESOURCES += $$PWD/templates.qrc
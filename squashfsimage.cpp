@@ -0,0 +1,568 @@
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QtEndian>
+#include <QtConcurrent>
+#include <memory>
+#include <zstd.h>
+#include <squashfsimage.h>
+#include <trace.h>
+
+// Values from the squashfs 4.0 format, see fs/squashfs/squashfs_fs.h in the kernel
+enum SquashfsConstants : quint32 {
+    SquashfsMagic = 0x73717368,
+    SquashfsBlockSize = 128 * 1024,
+    SquashfsBlockLog = 17,
+    SquashfsMetadataSize = 8192,
+    SquashfsCompressionZstd = 6,
+    SquashfsFlagNoXattrs = 0x0200,
+    SquashfsMetadataUncompressed = 0x8000,
+    SquashfsDataUncompressed = 0x01000000,
+    SquashfsNoFragment = 0xFFFFFFFF,
+    SquashfsNoXattr = 0xFFFFFFFF,
+    SquashfsDirectoryType = 1,
+    SquashfsFileType = 2,
+    SquashfsSymlinkType = 3,
+    SquashfsExtendedDirectoryType = 8,
+    SquashfsExtendedFileType = 9,
+    SquashfsDirectoryHeaderEntries = 256,
+    SquashfsNameMaxSize = 256,
+    SquashfsSuperblockSize = 96,
+    SquashfsPadding = 4096
+};
+
+static const quint64 squashfsNoTable = 0xFFFFFFFFFFFFFFFFull;
+
+// Files are read and compressed by batch of this size to bound the memory used
+static const qint64 batchSize = 64 * 1024 * 1024;
+
+struct SquashfsNode
+{
+    quint16     type;
+    QByteArray  name;
+    QString     path;
+    quint16     mode;
+    quint32     time;
+    qint64      size = 0;
+    QByteArray  symlinkTarget;
+    // Indexes in the node list, sorted by name
+    QList<int>  children;
+    quint32     inodeNumber = 0;
+    // Filled by the data pass
+    quint64         blocksStart = 0;
+    QList<quint32>  blockSizes;
+    quint32         fragment = SquashfsNoFragment;
+    quint32         fragmentOffset = 0;
+    // Start of the metadata block in the inode table << 16 | offset in the block
+    quint64     inodeReference = 0;
+};
+
+struct SquashfsPiece
+{
+    int     node;
+    qint64  offset;
+    qint64  size;
+};
+
+// A data block of one file or a fragment block holding the content of several small files
+struct SquashfsBlock
+{
+    QList<SquashfsPiece>    pieces;
+    qint64      rawSize = 0;
+    int         fragment = -1;
+    // Filled by the compression
+    QByteArray  data;
+    bool        compressed = false;
+    bool        ok = false;
+};
+
+template<typename T>
+static void append(QByteArray& out, T value)
+{
+    value = qToLittleEndian(value);
+    out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+// Empty when the compressed data would not be smaller
+static QByteArray zstdCompress(const QByteArray& data, int level)
+{
+    thread_local std::unique_ptr<ZSTD_CCtx, decltype(&ZSTD_freeCCtx)> context(ZSTD_createCCtx(), ZSTD_freeCCtx);
+    QByteArray toret(ZSTD_compressBound(data.size()), Qt::Uninitialized);
+    const size_t size = ZSTD_compressCCtx(context.get(), toret.data(), toret.size(), data.constData(), data.size(), level);
+    if (ZSTD_isError(size) || size >= static_cast<size_t>(data.size()))
+        return QByteArray();
+    toret.truncate(size);
+    return toret;
+}
+
+/*
+ * The inode, directory, fragment and id tables are lists of metadata blocks of 8KiB before compression,
+ * each one prefixed by its size. Entries can span two blocks.
+ */
+class SquashfsMetadata
+{
+public:
+    explicit SquashfsMetadata(int level) : m_level(level) {}
+    quint64     reference() const
+    {
+        return (static_cast<quint64>(m_table.size()) << 16) | m_block.size();
+    }
+    void        append(const QByteArray& data)
+    {
+        int written = 0;
+        while (written < data.size())
+        {
+            const int size = qMin<int>(SquashfsMetadataSize - m_block.size(), data.size() - written);
+            m_block.append(data.constData() + written, size);
+            written += size;
+            if (m_block.size() == SquashfsMetadataSize)
+                flush();
+        }
+    }
+    QByteArray  finish()
+    {
+        if (!m_block.isEmpty())
+            flush();
+        return m_table;
+    }
+    // Start of each block in the table, the lookup tables point to them
+    QList<quint64>  blockStarts;
+
+private:
+    void        flush()
+    {
+        blockStarts.append(m_table.size());
+        const QByteArray compressed = zstdCompress(m_block, m_level);
+        if (compressed.isEmpty())
+        {
+            ::append<quint16>(m_table, m_block.size() | SquashfsMetadataUncompressed);
+            m_table.append(m_block);
+        } else {
+            ::append<quint16>(m_table, compressed.size());
+            m_table.append(compressed);
+        }
+        m_block.clear();
+    }
+    QByteArray  m_table;
+    QByteArray  m_block;
+    int         m_level;
+};
+
+static quint16 unixMode(QFileDevice::Permissions permissions)
+{
+    const int bits = static_cast<int>(permissions);
+    return ((bits >> 12) & 7) << 6 | ((bits >> 4) & 7) << 3 | (bits & 7);
+}
+
+static bool addDirectory(QList<SquashfsNode>& nodes, int index, QList<int>& files, const QDateTime& modificationTime, QString& err)
+{
+    QDir dir(nodes.at(index).path);
+    const QFileInfoList entries = dir.entryInfoList(QDir::AllEntries | QDir::Hidden | QDir::System | QDir::NoDotAndDotDot, QDir::NoSort);
+    QList<int> children;
+    for (const QFileInfo& fi : entries)
+    {
+        SquashfsNode node;
+        node.name = fi.fileName().toUtf8();
+        node.path = fi.filePath();
+        node.time = (modificationTime.isValid() ? modificationTime : fi.lastModified()).toSecsSinceEpoch();
+        node.mode = unixMode(fi.permissions());
+        if (node.name.size() > static_cast<int>(SquashfsNameMaxSize))
+        {
+            err = fi.filePath() + " has a name too long for squashfs";
+            return false;
+        }
+        if (fi.isSymLink())
+        {
+            node.type = SquashfsSymlinkType;
+            node.mode = 0777;
+#if QT_VERSION >= QT_VERSION_CHECK(6, 6, 0)
+            node.symlinkTarget = fi.readSymLink().toUtf8();
+#else
+            // Only the resolved target is available, the links inside the tree are made relative again
+            const QString target = fi.symLinkTarget();
+            node.symlinkTarget = (target.startsWith(nodes.first().path + "/") ? dir.relativeFilePath(target) : target).toUtf8();
+#endif
+        } else if (fi.isDir()) {
+            node.type = SquashfsDirectoryType;
+        } else if (fi.isFile()) {
+            node.type = SquashfsFileType;
+            node.size = fi.size();
+        } else {
+            err = fi.filePath() + " is not a file, a directory or a symbolic link";
+            return false;
+        }
+        children.append(nodes.size());
+        nodes.append(node);
+    }
+    std::sort(children.begin(), children.end(), [&nodes](int a, int b) {
+        return nodes.at(a).name < nodes.at(b).name;
+    });
+    nodes[index].children = children;
+    for (int child : children)
+    {
+        if (nodes.at(child).type == SquashfsFileType)
+            files.append(child);
+    }
+    for (int child : children)
+    {
+        if (nodes.at(child).type == SquashfsDirectoryType && !addDirectory(nodes, child, files, modificationTime, err))
+            return false;
+    }
+    return true;
+}
+
+static void compressBlock(const QList<SquashfsNode>& nodes, SquashfsBlock& block, int level)
+{
+    QByteArray content;
+    content.reserve(block.rawSize);
+    for (const SquashfsPiece& piece : block.pieces)
+    {
+        QFile file(nodes.at(piece.node).path);
+        if (!file.open(QIODevice::ReadOnly) || !file.seek(piece.offset))
+            return ;
+        const QByteArray data = file.read(piece.size);
+        // The file changed since it was listed
+        if (data.size() != piece.size)
+            return ;
+        content.append(data);
+    }
+    block.data = zstdCompress(content, level);
+    block.compressed = block.data.isEmpty() == false;
+    if (!block.compressed)
+        block.data = content;
+    block.ok = true;
+}
+
+// Data blocks in the listing order, the files smaller than a block are packed in fragment blocks
+static QList<SquashfsBlock> planBlocks(QList<SquashfsNode>& nodes, const QList<int>& files, int& fragmentCount)
+{
+    QList<SquashfsBlock> toret;
+    int openFragment = -1;
+    for (int index : files)
+    {
+        SquashfsNode& node = nodes[index];
+        if (node.size == 0)
+            continue;
+        if (node.size >= SquashfsBlockSize)
+        {
+            for (qint64 offset = 0; offset < node.size; offset += SquashfsBlockSize)
+            {
+                SquashfsBlock block;
+                block.rawSize = qMin<qint64>(SquashfsBlockSize, node.size - offset);
+                block.pieces.append(SquashfsPiece{index, offset, block.rawSize});
+                toret.append(block);
+            }
+            continue;
+        }
+        if (openFragment < 0 || toret.at(openFragment).rawSize + node.size > SquashfsBlockSize)
+        {
+            SquashfsBlock block;
+            block.fragment = fragmentCount++;
+            openFragment = toret.size();
+            toret.append(block);
+        }
+        SquashfsBlock& fragment = toret[openFragment];
+        node.fragment = fragment.fragment;
+        node.fragmentOffset = fragment.rawSize;
+        fragment.pieces.append(SquashfsPiece{index, 0, node.size});
+        fragment.rawSize += node.size;
+    }
+    return toret;
+}
+
+static void appendInodeHeader(QByteArray& out, quint16 type, const SquashfsNode& node)
+{
+    append<quint16>(out, type);
+    append<quint16>(out, node.mode);
+    append<quint16>(out, 0); // uid index
+    append<quint16>(out, 0); // gid index
+    append<quint32>(out, node.time);
+    append<quint32>(out, node.inodeNumber);
+}
+
+static void writeFileInode(SquashfsMetadata& inodes, SquashfsNode& node)
+{
+    QByteArray inode;
+    if (node.blocksStart > 0xFFFFFFFFull || node.size > 0xFFFFFFFFll)
+    {
+        appendInodeHeader(inode, SquashfsExtendedFileType, node);
+        append<quint64>(inode, node.blocksStart);
+        append<quint64>(inode, node.size);
+        append<quint64>(inode, 0); // sparse bytes
+        append<quint32>(inode, 1); // link count
+        append<quint32>(inode, node.fragment);
+        append<quint32>(inode, node.fragmentOffset);
+        append<quint32>(inode, SquashfsNoXattr);
+    } else {
+        appendInodeHeader(inode, SquashfsFileType, node);
+        append<quint32>(inode, node.blocksStart);
+        append<quint32>(inode, node.fragment);
+        append<quint32>(inode, node.fragmentOffset);
+        append<quint32>(inode, node.size);
+    }
+    for (quint32 size : node.blockSizes)
+        append<quint32>(inode, size);
+    node.inodeReference = inodes.reference();
+    inodes.append(inode);
+}
+
+static void writeSymlinkInode(SquashfsMetadata& inodes, SquashfsNode& node)
+{
+    QByteArray inode;
+    appendInodeHeader(inode, SquashfsSymlinkType, node);
+    append<quint32>(inode, 1); // link count
+    append<quint32>(inode, node.symlinkTarget.size());
+    inode.append(node.symlinkTarget);
+    node.inodeReference = inodes.reference();
+    inodes.append(inode);
+}
+
+/*
+ * Entries are grouped under headers giving the inode block and a base inode number,
+ * a header has at most 256 entries and its entries must have their inode in the same block
+ */
+static QByteArray directoryListing(const QList<SquashfsNode>& nodes, const SquashfsNode& directory)
+{
+    QByteArray toret;
+    int first = 0;
+    while (first < directory.children.size())
+    {
+        const SquashfsNode& base = nodes.at(directory.children.at(first));
+        const quint64 block = base.inodeReference >> 16;
+        int count = 1;
+        while (first + count < directory.children.size() && count < static_cast<int>(SquashfsDirectoryHeaderEntries))
+        {
+            const SquashfsNode& next = nodes.at(directory.children.at(first + count));
+            const qint64 difference = qint64(next.inodeNumber) - base.inodeNumber;
+            if ((next.inodeReference >> 16) != block || difference < -32768 || difference > 32767)
+                break;
+            count++;
+        }
+        append<quint32>(toret, count - 1);
+        append<quint32>(toret, block);
+        append<quint32>(toret, base.inodeNumber);
+        for (int i = first; i < first + count; i++)
+        {
+            const SquashfsNode& child = nodes.at(directory.children.at(i));
+            append<quint16>(toret, child.inodeReference & 0xFFFF);
+            append<qint16>(toret, static_cast<qint16>(qint64(child.inodeNumber) - base.inodeNumber));
+            append<quint16>(toret, child.type);
+            append<quint16>(toret, child.name.size() - 1);
+            toret.append(child.name);
+        }
+        first += count;
+    }
+    return toret;
+}
+
+// The numbers follow the order the inodes are written in, the children of a directory get close numbers
+static void numberInodes(QList<SquashfsNode>& nodes, int index, quint32& counter)
+{
+    for (int child : nodes.at(index).children)
+    {
+        if (nodes.at(child).type == SquashfsDirectoryType)
+            numberInodes(nodes, child, counter);
+    }
+    for (int child : nodes.at(index).children)
+    {
+        if (nodes.at(child).type != SquashfsDirectoryType)
+            nodes[child].inodeNumber = ++counter;
+    }
+    nodes[index].inodeNumber = ++counter;
+}
+
+// A directory inode needs the position of its listing, that needs the inodes of its children
+static void writeDirectory(QList<SquashfsNode>& nodes, int index, quint32 parentInode, SquashfsMetadata& inodes, SquashfsMetadata& directories)
+{
+    quint32 linkCount = 2;
+    for (int child : nodes.at(index).children)
+    {
+        if (nodes.at(child).type == SquashfsDirectoryType)
+        {
+            writeDirectory(nodes, child, nodes.at(index).inodeNumber, inodes, directories);
+            linkCount++;
+        }
+    }
+    for (int child : nodes.at(index).children)
+    {
+        if (nodes.at(child).type == SquashfsFileType)
+            writeFileInode(inodes, nodes[child]);
+        if (nodes.at(child).type == SquashfsSymlinkType)
+            writeSymlinkInode(inodes, nodes[child]);
+    }
+    SquashfsNode& node = nodes[index];
+    const quint64 listingReference = directories.reference();
+    const QByteArray listing = directoryListing(nodes, node);
+    directories.append(listing);
+    // The size counts the . and .. entries that are not written
+    const quint32 size = listing.size() + 3;
+    QByteArray inode;
+    if (size > 0xFFFF)
+    {
+        appendInodeHeader(inode, SquashfsExtendedDirectoryType, node);
+        append<quint32>(inode, linkCount);
+        append<quint32>(inode, size);
+        append<quint32>(inode, listingReference >> 16);
+        append<quint32>(inode, parentInode);
+        append<quint16>(inode, 0); // no index, the lookups read the whole listing
+        append<quint16>(inode, listingReference & 0xFFFF);
+        append<quint32>(inode, SquashfsNoXattr);
+    } else {
+        appendInodeHeader(inode, SquashfsDirectoryType, node);
+        append<quint32>(inode, listingReference >> 16);
+        append<quint32>(inode, linkCount);
+        append<quint16>(inode, size);
+        append<quint16>(inode, listingReference & 0xFFFF);
+        append<quint32>(inode, parentInode);
+    }
+    node.inodeReference = inodes.reference();
+    inodes.append(inode);
+}
+
+// A lookup table is the position in the image of each metadata block of a table
+static QByteArray lookupTable(const SquashfsMetadata& table, quint64 tableStart)
+{
+    QByteArray toret;
+    for (quint64 start : table.blockStarts)
+        append<quint64>(toret, tableStart + start);
+    return toret;
+}
+
+bool    writeSquashfsImage(QFile& image, const QString& sourceDir, QString* error, const QDateTime& modificationTime, int compressionLevel)
+{
+    TraceSpan trace("writeSquashfsImage");
+    QString dummy;
+    QString& err = error != nullptr ? *error : dummy;
+    const QFileInfo rootFi(sourceDir);
+    if (!rootFi.isDir())
+    {
+        err = sourceDir + " is not a directory";
+        return false;
+    }
+    QList<SquashfsNode> nodes;
+    SquashfsNode root;
+    root.type = SquashfsDirectoryType;
+    root.path = rootFi.absoluteFilePath();
+    root.time = (modificationTime.isValid() ? modificationTime : rootFi.lastModified()).toSecsSinceEpoch();
+    root.mode = unixMode(rootFi.permissions());
+    nodes.append(root);
+    QList<int> files;
+    if (!addDirectory(nodes, 0, files, modificationTime, err))
+        return false;
+
+    const qint64 imageStart = image.pos();
+    // The superblock is written last, once the tables positions are known
+    if (image.write(QByteArray(SquashfsSuperblockSize, '\0')) != SquashfsSuperblockSize)
+    {
+        err = image.errorString();
+        return false;
+    }
+    int fragmentCount = 0;
+    QList<SquashfsBlock> blocks = planBlocks(nodes, files, fragmentCount);
+    // The fragment blocks are planned and written in the order of their index
+    SquashfsMetadata fragments(compressionLevel);
+    int batchStart = 0;
+    while (batchStart < blocks.size())
+    {
+        int batchEnd = batchStart;
+        qint64 size = 0;
+        while (batchEnd < blocks.size() && (batchEnd == batchStart || size + blocks.at(batchEnd).rawSize <= batchSize))
+            size += blocks.at(batchEnd++).rawSize;
+        QtConcurrent::blockingMap(blocks.begin() + batchStart, blocks.begin() + batchEnd, [&nodes, compressionLevel](SquashfsBlock& block) {
+            compressBlock(nodes, block, compressionLevel);
+        });
+        for (int i = batchStart; i < batchEnd; i++)
+        {
+            SquashfsBlock& block = blocks[i];
+            if (!block.ok)
+            {
+                err = "Could not read " + nodes.at(block.pieces.first().node).path;
+                return false;
+            }
+            const quint64 position = image.pos() - imageStart;
+            if (image.write(block.data) != block.data.size())
+            {
+                err = image.errorString();
+                return false;
+            }
+            const quint32 storedSize = block.data.size() | (block.compressed ? 0u : static_cast<quint32>(SquashfsDataUncompressed));
+            if (block.fragment >= 0)
+            {
+                QByteArray entry;
+                append<quint64>(entry, position);
+                append<quint32>(entry, storedSize);
+                append<quint32>(entry, 0);
+                fragments.append(entry);
+            } else {
+                SquashfsNode& node = nodes[block.pieces.first().node];
+                if (node.blockSizes.isEmpty())
+                    node.blocksStart = position;
+                node.blockSizes.append(storedSize);
+            }
+            block.data = QByteArray();
+        }
+        batchStart = batchEnd;
+    }
+
+    SquashfsMetadata inodes(compressionLevel);
+    SquashfsMetadata directories(compressionLevel);
+    quint32 inodeCount = 0;
+    numberInodes(nodes, 0, inodeCount);
+    writeDirectory(nodes, 0, inodeCount + 1, inodes, directories);
+    SquashfsMetadata ids(compressionLevel);
+    QByteArray rootId;
+    append<quint32>(rootId, 0);
+    ids.append(rootId);
+
+    // The kernel checks this order: inodes, directories, fragments, ids, and the id lookup table ends the image
+    const quint64 inodeTableStart = image.pos() - imageStart;
+    const QByteArray inodeTable = inodes.finish();
+    const quint64 directoryTableStart = inodeTableStart + inodeTable.size();
+    const QByteArray directoryTable = directories.finish();
+    const quint64 fragmentsStart = directoryTableStart + directoryTable.size();
+    const QByteArray fragmentTable = fragments.finish();
+    const QByteArray fragmentLookup = lookupTable(fragments, fragmentsStart);
+    const quint64 fragmentLookupStart = fragmentsStart + fragmentTable.size();
+    const quint64 idsStart = fragmentLookupStart + fragmentLookup.size();
+    const QByteArray idTable = ids.finish();
+    const QByteArray idLookup = lookupTable(ids, idsStart);
+    const quint64 idLookupStart = idsStart + idTable.size();
+    const quint64 bytesUsed = idLookupStart + idLookup.size();
+    QByteArray tables = inodeTable + directoryTable + fragmentTable + fragmentLookup + idTable + idLookup;
+    // Images are padded to 4KiB like mksquashfs does, so they can be loop mounted
+    tables.append(QByteArray((SquashfsPadding - bytesUsed % SquashfsPadding) % SquashfsPadding, '\0'));
+    if (image.write(tables) != tables.size())
+    {
+        err = image.errorString();
+        return false;
+    }
+
+    const quint64 rootReference = nodes.at(0).inodeReference;
+    QByteArray superblock;
+    append<quint32>(superblock, SquashfsMagic);
+    append<quint32>(superblock, inodeCount);
+    append<quint32>(superblock, (modificationTime.isValid() ? modificationTime : QDateTime::currentDateTimeUtc()).toSecsSinceEpoch());
+    append<quint32>(superblock, SquashfsBlockSize);
+    append<quint32>(superblock, fragmentCount);
+    append<quint16>(superblock, SquashfsCompressionZstd);
+    append<quint16>(superblock, SquashfsBlockLog);
+    append<quint16>(superblock, SquashfsFlagNoXattrs);
+    append<quint16>(superblock, 1); // id count
+    append<quint16>(superblock, 4); // major version
+    append<quint16>(superblock, 0); // minor version
+    append<quint64>(superblock, rootReference);
+    append<quint64>(superblock, bytesUsed);
+    append<quint64>(superblock, idLookupStart);
+    append<quint64>(superblock, squashfsNoTable); // xattr table
+    append<quint64>(superblock, inodeTableStart);
+    append<quint64>(superblock, directoryTableStart);
+    append<quint64>(superblock, fragmentLookupStart);
+    append<quint64>(superblock, squashfsNoTable); // export table
+    const qint64 end = image.pos();
+    if (!image.seek(imageStart) || image.write(superblock) != superblock.size() || !image.seek(end))
+    {
+        err = image.errorString();
+        return false;
+    }
+    return true;
+}
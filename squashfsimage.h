@@ -0,0 +1,15 @@
+#pragma once
+
+#include <QString>
+#include <QDateTime>
+
+class QFile;
+
+/*
+ * Write the content of sourceDir as a zstd compressed squashfs 4.0 image at the current position of image
+ * The offsets inside the image are relative to that position, so the image can follow the AppImage runtime
+ * Every file is owned by root, the data blocks are compressed in parallel by memory-bounded batches
+ * If modificationTime is valid it is used for every inode and for the image instead of the files time
+ */
+bool    writeSquashfsImage(QFile& image, const QString& sourceDir, QString* error = nullptr,
+                           const QDateTime& modificationTime = QDateTime(), int compressionLevel = 19);
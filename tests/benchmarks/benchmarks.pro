@@ -0,0 +1,13 @@
+# Not a testcase: make check leaves the benchmarks out, run tst_benchmarks by hand
+include(../../sqpackager.pri)
+include(../tests.pri)
+
+QT += testlib
+
+CONFIG += console
+CONFIG -= app_bundle
+
+TARGET = tst_benchmarks
+
+SOURCES += \
+    tst_benchmarks.cpp
@@ -0,0 +1,230 @@
+#include <QtTest>
+#include <QDir>
+#include <QFile>
+#include <QJsonObject>
+#include <QTemporaryDir>
+#include <atomic>
+#include <cstdlib>
+#include <functional>
+#include <basestuff.h>
+#include <sqpackager.h>
+#include <print.h>
+#include <testutils.h>
+
+// The application defines it in main.cpp
+PackagerOptions gOptions;
+
+/*
+ * With glibc the allocations are counted by replacing malloc in this executable, this also
+ * catches the Qt containers that don't go through operator new. Only the thread running
+ * the measured function counts, the logger thread is left out.
+ */
+#if defined(__GLIBC__)
+extern "C" {
+void*   __libc_malloc(size_t size);
+void*   __libc_calloc(size_t count, size_t size);
+void*   __libc_realloc(void* ptr, size_t size);
+}
+
+static std::atomic<qint64>  allocationCount{0};
+static thread_local bool    countAllocations = false;
+
+extern "C" void*    malloc(size_t size)
+{
+    if (countAllocations)
+        allocationCount.fetch_add(1, std::memory_order_relaxed);
+    return __libc_malloc(size);
+}
+
+extern "C" void*    calloc(size_t count, size_t size)
+{
+    if (countAllocations)
+        allocationCount.fetch_add(1, std::memory_order_relaxed);
+    return __libc_calloc(count, size);
+}
+
+extern "C" void*    realloc(void* ptr, size_t size)
+{
+    if (countAllocations)
+        allocationCount.fetch_add(1, std::memory_order_relaxed);
+    return __libc_realloc(ptr, size);
+}
+#endif
+
+/*
+ * Time the functions that run on every invocation on large synthetic inputs
+ * The generated file tree has 100000 files, SQPACKAGER_BENCHMARK_FILES changes it
+ */
+class BenchmarkHotFunctions : public QObject
+{
+    Q_OBJECT
+
+private:
+    QString generateTemplate(int lines)
+    {
+        QByteArray content;
+        for (int i = 0; i < 100; i++)
+            m_mapping[QString("KEY_%1").arg(i)] = QString("value %1").arg(i);
+        for (int i = 0; i < lines; i++)
+        {
+            // Every 10th line opens or closes a block, half of them with a missing key
+            if (i % 20 == 0)
+                content += QString("%%{IF KEY_%1%%\n").arg(i % 200).toUtf8();
+            else if (i % 20 == 10)
+                content += "%%}IF%%\n";
+            else
+                content += QString("install -v -D %%KEY_%1%% $PREFIX/share/%%KEY_%2%%/file%3\n").arg(i % 100).arg((i + 7) % 100).arg(i).toUtf8();
+        }
+        writeTestFile(m_dir.path(), "large.tt", content);
+        return m_dir.filePath("large.tt");
+    }
+
+    // extractInfosFromProFile only reads the .pro file itself, include() lines would be plain lines to it
+    QString generateProFile(int lines)
+    {
+        static const QStringList modules = {"core", "gui", "widgets", "network", "sql", "quick", "qml", "svg"};
+        QByteArray content = "TARGET = benchmark\n";
+        for (int i = 0; i < lines; i++)
+        {
+            if (i % 50 == 0)
+                content += "QT += " + modules.at(i % modules.size()).toUtf8() + " " + modules.at((i + 3) % modules.size()).toUtf8() + "\n";
+            else
+                content += QString("SOURCES += src/dir%1/file%2.cpp\n").arg(i % 97).arg(i).toUtf8();
+        }
+        writeTestFile(m_dir.path(), "benchmark.pro", content);
+        return m_dir.filePath("benchmark.pro");
+    }
+
+    void    generateTree(const QString& dir, int fileCount)
+    {
+        QDir().mkpath(dir);
+        for (int i = 0; i < fileCount; i++)
+            writeTestFile(dir, QString("file%1.txt").arg(i, 6, 10, QChar('0')), QByteArray::number(i));
+    }
+
+    QTemporaryDir                                   m_dir;
+    QMap<QString, QString>                          m_mapping;
+    QList<ProjectDefinition>                        m_versions;
+    QJsonObject                                     m_projectObj;
+    QMap<QString, std::function<void()>>            m_functions;
+    QList<QPair<QString, QString>>                  m_rows; // function name, input description
+
+private slots:
+    void    initTestCase()
+    {
+        QVERIFY(m_dir.isValid());
+        setQuietOutput(true);
+        int fileCount = 100000;
+        if (qEnvironmentVariableIsSet("SQPACKAGER_BENCHMARK_FILES"))
+        {
+            bool ok;
+            fileCount = qEnvironmentVariable("SQPACKAGER_BENCHMARK_FILES").toInt(&ok);
+            if (!ok || fileCount < 1)
+                QFAIL("SQPACKAGER_BENCHMARK_FILES must be a positive number");
+        }
+
+        const QString templatePath = generateTemplate(10000);
+        m_rows.append({"useTemplateFile", "10000 lines"});
+        m_functions["useTemplateFile"] = [=] {
+            useTemplateFile(templatePath, m_mapping);
+        };
+
+        for (const QString& version : {"1.2.3", "v2.0", "nightly", "20240101"})
+        {
+            ProjectDefinition proj;
+            proj.version.type = VersionType::Forced;
+            proj.version.simpleVersion = version;
+            m_versions << proj;
+        }
+        ProjectDefinition gitProj;
+        gitProj.version.type = VersionType::Git;
+        gitProj.version.gitLastTag = "v1.4";
+        gitProj.version.gitVersionString = "v1.4-12-gabcdef0";
+        m_versions << gitProj;
+        m_rows.append({"getDebianVersion", "100000 calls"});
+        m_functions["getDebianVersion"] = [=] {
+            for (int i = 0; i < 100000; i++)
+                getDebianVersion(m_versions.at(i % m_versions.size()));
+        };
+
+        const QString treePath = m_dir.filePath("tree");
+        generateTree(treePath, fileCount);
+        m_rows.append({"checkForFile", QString("%1 files, no match").arg(fileCount)});
+        m_functions["checkForFile"] = [=] {
+            // Nothing match so the whole directory is listed
+            static const QRegularExpression noMatch("^license$", QRegularExpression::CaseInsensitiveOption);
+            checkForFile(treePath, noMatch);
+        };
+
+        ProjectDefinition proDef;
+        proDef.basePath = m_dir.path();
+        proDef.proFile = generateProFile(100000);
+        m_rows.append({"extractInfosFromProFile", "100000 lines"});
+        m_functions["extractInfosFromProFile"] = [=] {
+            ProjectDefinition def = proDef;
+            extractInfosFromProFile(def);
+        };
+
+        QJsonObject filesObj;
+        for (int i = 0; i < 10000; i++)
+            filesObj[QString((i % 2 ? "WIN32:" : "") + QString("data/file%1.dat").arg(i))] = i % 10 ? QString("assets/file%1.dat").arg(i) : QString("https://example.org/file%1.dat").arg(i);
+        m_projectObj = QJsonObject{{"files", filesObj}};
+        m_rows.append({"handleFiles", "10000 entries"});
+        m_functions["handleFiles"] = [=] {
+            ProjectDefinition def;
+            handleFiles(def, m_projectObj);
+        };
+
+        ProjectDefinition archiveDef;
+        archiveDef.basePath = treePath;
+        archiveDef.version.simpleVersion = "1.0";
+        m_rows.append({"createArchive", QString("%1 files").arg(fileCount)});
+        m_functions["createArchive"] = [=] {
+            QFile::remove(createArchive(archiveDef));
+        };
+    }
+
+    void    hotFunctions_data()
+    {
+        QTest::addColumn<QString>("function");
+        for (const auto& row : m_rows)
+            QTest::newRow(qPrintable(row.first + " (" + row.second + ")")) << row.first;
+    }
+
+    void    hotFunctions()
+    {
+        QFETCH(QString, function);
+        const std::function<void()> run = m_functions.value(function);
+        // A first untimed run fill the caches
+        run();
+        QBENCHMARK {
+            run();
+        }
+    }
+
+    // The allocations of one call, reported as the benchmark result of these rows
+    void    allocations_data()
+    {
+        hotFunctions_data();
+    }
+
+    void    allocations()
+    {
+#if defined(__GLIBC__)
+        QFETCH(QString, function);
+        const std::function<void()> run = m_functions.value(function);
+        run();
+        const qint64 allocationsBefore = allocationCount.load();
+        countAllocations = true;
+        run();
+        countAllocations = false;
+        QTest::setBenchmarkResult(allocationCount.load() - allocationsBefore, QTest::Events);
+#else
+        QSKIP("The allocations are only counted with glibc");
+#endif
+    }
+};
+
+QTEST_GUILESS_MAIN(BenchmarkHotFunctions)
+
+#include "tst_benchmarks.moc"
@@ -0,0 +1,18 @@
+QT += testlib
+QT -= gui
+
+CONFIG += c++17 console testcase
+CONFIG -= app_bundle
+
+include(../tests.pri)
+
+TARGET = tst_elfreader
+
+INCLUDEPATH += ../..
+
+SOURCES += \
+    tst_elfreader.cpp \
+    ../../elfreader.cpp
+
+HEADERS += \
+    ../../elfreader.h
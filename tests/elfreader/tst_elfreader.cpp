@@ -0,0 +1,231 @@
+#include <QtTest>
+#include <QtEndian>
+#include <QTemporaryDir>
+#include <elfreader.h>
+#include <testutils.h>
+
+/*
+ * The fixtures are built here instead of shipping binaries: the ELF header, a PT_LOAD covering the
+ * whole file and a PT_DYNAMIC, then the dynamic section and the string table
+ */
+static void put16(QByteArray& data, int offset, quint16 value)
+{
+    qToLittleEndian<quint16>(value, data.data() + offset);
+}
+
+static void put32(QByteArray& data, int offset, quint32 value)
+{
+    qToLittleEndian<quint32>(value, data.data() + offset);
+}
+
+static void putAddr(QByteArray& data, int offset, bool is64, quint64 value)
+{
+    if (is64)
+        qToLittleEndian<quint64>(value, data.data() + offset);
+    else
+        put32(data, offset, quint32(value));
+}
+
+struct ElfFixture
+{
+    bool        is64 = true;
+    QString     soname;
+    QStringList needed;
+    QString     runpath;
+    QString     rpath;
+    bool        dynamic = true;
+};
+
+static QByteArray elfFile(const ElfFixture& fixture)
+{
+    const bool      is64 = fixture.is64;
+    const int       headerSize = is64 ? 64 : 52;
+    const int       phentsize = is64 ? 56 : 32;
+    const int       phnum = fixture.dynamic ? 2 : 1;
+    const int       entrySize = is64 ? 16 : 8;
+    const quint64   baseAddr = 0x400000;
+
+    QByteArray strtab(1, '\0');
+    QList<QPair<quint64, quint64>> entries;
+    auto addString = [&strtab](const QString& value) {
+        const quint64 offset = strtab.size();
+        strtab += value.toUtf8() + '\0';
+        return offset;
+    };
+    for (const QString& needed : fixture.needed)
+        entries.append({1, addString(needed)});
+    if (!fixture.soname.isEmpty())
+        entries.append({14, addString(fixture.soname)});
+    if (!fixture.rpath.isEmpty())
+        entries.append({15, addString(fixture.rpath)});
+    if (!fixture.runpath.isEmpty())
+        entries.append({29, addString(fixture.runpath)});
+
+    const int dynamicOffset = headerSize + phnum * phentsize;
+    const int dynamicSize = (entries.size() + 2) * entrySize;
+    const int strtabOffset = dynamicOffset + dynamicSize;
+    // DT_STRTAB is an address
+    entries.append({5, baseAddr + strtabOffset});
+    entries.append({0, 0});
+
+    QByteArray file(strtabOffset, '\0');
+    file.replace(0, 4, QByteArray("\x7f" "ELF"));
+    file[4] = is64 ? 2 : 1;
+    file[5] = 1;
+    file[6] = 1;
+    put16(file, 16, 3); // ET_DYN
+    put16(file, 18, is64 ? 62 : 3);
+    put32(file, 20, 1);
+    putAddr(file, is64 ? 32 : 28, is64, headerSize);
+    put16(file, is64 ? 52 : 40, headerSize);
+    put16(file, is64 ? 54 : 42, phentsize);
+    put16(file, is64 ? 56 : 44, phnum);
+
+    const int fileSize = strtabOffset + strtab.size();
+    for (int i = 0; i < phnum; i++)
+    {
+        const int ph = headerSize + i * phentsize;
+        const quint64 offset = i == 0 ? 0 : dynamicOffset;
+        const quint64 size = i == 0 ? fileSize : dynamicSize;
+        put32(file, ph, i == 0 ? 1 : 2);
+        if (is64)
+        {
+            putAddr(file, ph + 8, true, offset);
+            putAddr(file, ph + 16, true, baseAddr + offset);
+            putAddr(file, ph + 32, true, size);
+            putAddr(file, ph + 40, true, size);
+        } else {
+            put32(file, ph + 4, offset);
+            put32(file, ph + 8, baseAddr + offset);
+            put32(file, ph + 16, size);
+            put32(file, ph + 20, size);
+        }
+    }
+    if (fixture.dynamic)
+    {
+        for (int i = 0; i < entries.size(); i++)
+        {
+            putAddr(file, dynamicOffset + i * entrySize, is64, entries.at(i).first);
+            putAddr(file, dynamicOffset + i * entrySize + entrySize / 2, is64, entries.at(i).second);
+        }
+    } else {
+        file.truncate(dynamicOffset);
+    }
+    return fixture.dynamic ? file + strtab : file;
+}
+
+class TestElfReader : public QObject
+{
+    Q_OBJECT
+
+private:
+    QString writeFile(const QString& relativePath, const QByteArray& content)
+    {
+        return writeTestFile(m_dir.path(), relativePath, content);
+    }
+
+    QTemporaryDir   m_dir;
+
+private slots:
+    void    readInfo_data()
+    {
+        QTest::addColumn<bool>("is64");
+        QTest::addColumn<int>("machine");
+        QTest::newRow("ELF64") << true << 62;
+        QTest::newRow("ELF32") << false << 3;
+    }
+
+    void    readInfo()
+    {
+        QFETCH(bool, is64);
+        QFETCH(int, machine);
+        ElfFixture fixture;
+        fixture.is64 = is64;
+        fixture.soname = "libapp.so.1";
+        fixture.needed = QStringList({"libQt6Core.so.6", "libc.so.6"});
+        fixture.runpath = "$ORIGIN/../lib:/opt/qt/lib";
+        const QString path = writeFile(QString("read%1.so").arg(is64 ? 64 : 32), elfFile(fixture));
+        const ElfInfo info = readElfInfo(path);
+        QVERIFY(info.valid);
+        QCOMPARE(info.is64, is64);
+        QCOMPARE(int(info.machine), machine);
+        QCOMPARE(info.soname, QString("libapp.so.1"));
+        QCOMPARE(info.needed, fixture.needed);
+        QVERIFY(info.hasRunpathTag);
+        QCOMPARE(info.runpath, QStringList({"$ORIGIN/../lib", "/opt/qt/lib"}));
+        QCOMPARE(info.runpathSize, qint64(fixture.runpath.size()));
+    }
+
+    // DT_RPATH is only used when there is no DT_RUNPATH, like the loader does
+    void    rpath()
+    {
+        ElfFixture fixture;
+        fixture.rpath = "/old/lib";
+        ElfInfo info = readElfInfo(writeFile("rpath.so", elfFile(fixture)));
+        QVERIFY(info.valid);
+        QCOMPARE(info.runpath, QStringList({"/old/lib"}));
+        fixture.runpath = "/new/lib";
+        info = readElfInfo(writeFile("both.so", elfFile(fixture)));
+        QCOMPARE(info.runpath, QStringList({"/new/lib"}));
+    }
+
+    void    staticExecutable()
+    {
+        ElfFixture fixture;
+        fixture.dynamic = false;
+        const ElfInfo info = readElfInfo(writeFile("static", elfFile(fixture)));
+        QVERIFY(info.valid);
+        QVERIFY(info.needed.isEmpty());
+        QVERIFY(!info.hasRunpathTag);
+    }
+
+    void    setRunpath()
+    {
+        ElfFixture fixture;
+        fixture.needed = QStringList({"libc.so.6"});
+        fixture.runpath = "/build/tree/lib:/opt/qt/lib";
+        const QString path = writeFile("setrunpath.so", elfFile(fixture));
+        const ElfInfo info = readElfInfo(path);
+        QVERIFY(setElfRunpathInPlace(path, info, "$ORIGIN/../lib"));
+        const ElfInfo updated = readElfInfo(path);
+        QVERIFY(updated.valid);
+        QCOMPARE(updated.runpath, QStringList({"$ORIGIN/../lib"}));
+        QCOMPARE(updated.needed, fixture.needed);
+        // There is no room for a longer string
+        QVERIFY(!setElfRunpathInPlace(path, info, fixture.runpath + ":/usr/local/lib"));
+    }
+
+    void    brokenFiles()
+    {
+        ElfFixture fixture;
+        fixture.needed = QStringList({"libc.so.6"});
+        const QByteArray elf64 = elfFile(fixture);
+        fixture.is64 = false;
+        const QByteArray elf32 = elfFile(fixture);
+        QVERIFY(!readElfInfo(writeFile("text.so", QByteArray(512, 'x'))).valid);
+        QVERIFY(!readElfInfo(writeFile("empty.so", QByteArray())).valid);
+        QVERIFY(!readElfInfo(m_dir.filePath("missing.so")).valid);
+        QVERIFY(!readElfInfo(writeFile("header64.so", elf64.left(60))).valid);
+        QVERIFY(!readElfInfo(writeFile("header32.so", elf32.left(48))).valid);
+        // The program headers are past the end of the file
+        QVERIFY(!readElfInfo(writeFile("programheaders.so", elf64.left(100))).valid);
+        QByteArray broken = elf64;
+        put16(broken, 56, 0xFFFF);
+        QVERIFY(!readElfInfo(writeFile("phnum.so", broken)).valid);
+        // Program header entries smaller than the specification ones would be read past their end
+        broken = elf64;
+        put16(broken, 54, 8);
+        QVERIFY(!readElfInfo(writeFile("phentsize64.so", broken)).valid);
+        broken = elf32;
+        put16(broken, 42, 31);
+        QVERIFY(!readElfInfo(writeFile("phentsize32.so", broken)).valid);
+        // The string table address is not in a PT_LOAD segment
+        broken = elf64;
+        put32(broken, 64, 0);
+        QVERIFY(!readElfInfo(writeFile("nostrtab.so", broken)).valid);
+    }
+};
+
+QTEST_APPLESS_MAIN(TestElfReader)
+
+#include "tst_elfreader.moc"
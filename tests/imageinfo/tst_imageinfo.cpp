@@ -0,0 +1,127 @@
+#include <QtTest>
+#include <QtEndian>
+#include <QTemporaryDir>
+#include <imageinfo.h>
+#include <testutils.h>
+
+/*
+ * Only the headers are read, so the fixtures are headers and not complete images
+ */
+static QByteArray pngHeader(quint32 width, quint32 height)
+{
+    QByteArray header("\x89PNG\r\n\x1a\n", 8);
+    header += QByteArray("\0\0\0\x0d" "IHDR", 8);
+    header += QByteArray(8, '\0');
+    qToBigEndian<quint32>(width, header.data() + 16);
+    qToBigEndian<quint32>(height, header.data() + 20);
+    // Bit depth, color type, compression, filter, interlace and the CRC
+    return header + QByteArray("\x08\x06\0\0\0", 5) + QByteArray(4, '\0');
+}
+
+// A 0 in an entry means 256
+static QByteArray icoHeader(const QList<QPair<quint8, quint8>>& sizes)
+{
+    QByteArray header(6, '\0');
+    qToLittleEndian<quint16>(1, header.data() + 2);
+    qToLittleEndian<quint16>(sizes.size(), header.data() + 4);
+    for (const auto& size : sizes)
+    {
+        QByteArray entry(16, '\0');
+        entry[0] = char(size.first);
+        entry[1] = char(size.second);
+        header += entry;
+    }
+    return header;
+}
+
+static QByteArray xpmHeader(int width, int height)
+{
+    return QString("/* XPM */\nstatic const char *icon[] = {\n/* columns rows colors chars-per-pixel */\n"
+                   "\"%1 %2 2 1 \",\n\"  c None\",\n\". c #000000\",\n").arg(width).arg(height).toLatin1();
+}
+
+class TestImageInfo : public QObject
+{
+    Q_OBJECT
+
+private:
+    QString writeFile(const QString& relativePath, const QByteArray& content)
+    {
+        return writeTestFile(m_dir.path(), relativePath, content);
+    }
+
+    QTemporaryDir   m_dir;
+
+private slots:
+    void    validImages_data()
+    {
+        QTest::addColumn<QString>("name");
+        QTest::addColumn<QByteArray>("content");
+        QTest::addColumn<QSize>("size");
+        QTest::newRow("PNG") << "icon.png" << pngHeader(48, 32) << QSize(48, 32);
+        QTest::newRow("PNG without suffix") << "icon" << pngHeader(512, 512) << QSize(512, 512);
+        QTest::newRow("ICO") << "icon.ico" << icoHeader({{16, 16}, {48, 48}, {32, 32}}) << QSize(48, 48);
+        QTest::newRow("ICO 256") << "icon.ico" << icoHeader({{32, 32}, {0, 0}}) << QSize(256, 256);
+        QTest::newRow("XPM") << "icon.xpm" << xpmHeader(64, 48) << QSize(64, 48);
+        QTest::newRow("SVG") << "icon.svg"
+                             << QByteArray("<?xml version=\"1.0\"?>\n<!-- comment -->\n<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"24px\" height=\"16\">\n</svg>\n")
+                             << QSize(24, 16);
+        QTest::newRow("SVG viewBox") << "icon.svg"
+                                     << QByteArray("<svg width=\"100%\" height=\"100%\" viewBox=\"0 0 128.4 64\"></svg>")
+                                     << QSize(128, 64);
+        // The svg element is found past the first read
+        QTest::newRow("SVG long prolog") << "icon.svg"
+                                         << "<?xml version=\"1.0\"?>\n<!--" + QByteArray(10000, '-') + "-->\n<svg viewBox='0,0,32,32'/>"
+                                         << QSize(32, 32);
+    }
+
+    void    validImages()
+    {
+        QFETCH(QString, name);
+        QFETCH(QByteArray, content);
+        QFETCH(QSize, size);
+        QString error;
+        QCOMPARE(readImageSize(writeFile(name, content), &error), size);
+        QVERIFY(error.isEmpty());
+    }
+
+    void    brokenImages_data()
+    {
+        QTest::addColumn<QString>("name");
+        QTest::addColumn<QByteArray>("content");
+        const QByteArray png = pngHeader(48, 48);
+        const QByteArray ico = icoHeader({{16, 16}, {32, 32}});
+        QTest::newRow("PNG signature only") << "icon.png" << png.left(8);
+        QTest::newRow("PNG truncated IHDR") << "icon.png" << png.left(20);
+        QTest::newRow("PNG without IHDR") << "icon.png" << QByteArray(png).replace(12, 4, "IDAT");
+        QTest::newRow("ICO truncated header") << "icon.ico" << ico.left(4);
+        QTest::newRow("ICO truncated entries") << "icon.ico" << ico.left(6 + 16 + 8);
+        QTest::newRow("ICO no entry") << "icon.ico" << icoHeader({});
+        QTest::newRow("XPM truncated") << "icon.xpm" << xpmHeader(64, 48).left(30);
+        QTest::newRow("SVG truncated") << "icon.svg" << QByteArray("<?xml version=\"1.0\"?>\n<svg width=\"24\"");
+        QTest::newRow("SVG without size") << "icon.svg" << QByteArray("<svg xmlns=\"http://www.w3.org/2000/svg\"></svg>");
+        QTest::newRow("SVG relative size") << "icon.svg" << QByteArray("<svg width=\"50%\" height=\"50%\"></svg>");
+        QTest::newRow("empty") << "icon.png" << QByteArray();
+        QTest::newRow("unsupported") << "icon.bmp" << QByteArray("BM") + QByteArray(60, '\0');
+    }
+
+    void    brokenImages()
+    {
+        QFETCH(QString, name);
+        QFETCH(QByteArray, content);
+        QString error;
+        QVERIFY(!readImageSize(writeFile(name, content), &error).isValid());
+        QVERIFY(!error.isEmpty());
+    }
+
+    void    missingFile()
+    {
+        QString error;
+        QVERIFY(!readImageSize(m_dir.filePath("missing.png"), &error).isValid());
+        QVERIFY(!error.isEmpty());
+    }
+};
+
+QTEST_APPLESS_MAIN(TestImageInfo)
+
+#include "tst_imageinfo.moc"
@@ -0,0 +1,18 @@
+QT += testlib
+QT -= gui
+
+CONFIG += c++17 console testcase
+CONFIG -= app_bundle
+
+include(../tests.pri)
+
+TARGET = tst_peimports
+
+INCLUDEPATH += ../../Windows
+
+SOURCES += \
+    tst_peimports.cpp \
+    ../../Windows/peimports.cpp
+
+HEADERS += \
+    ../../Windows/peimports.h
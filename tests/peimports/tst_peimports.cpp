@@ -0,0 +1,173 @@
+#include <QtTest>
+#include <QtEndian>
+#include <QTemporaryDir>
+#include <peimports.h>
+#include <testutils.h>
+
+/*
+ * The fixtures are built here instead of shipping binaries: the headers and one section
+ * holding the import descriptors, the delay import descriptors then the dll names
+ */
+static void put16(QByteArray& data, int offset, quint16 value)
+{
+    qToLittleEndian<quint16>(value, data.data() + offset);
+}
+
+static void put32(QByteArray& data, int offset, quint32 value)
+{
+    qToLittleEndian<quint32>(value, data.data() + offset);
+}
+
+static void put64(QByteArray& data, int offset, quint64 value)
+{
+    qToLittleEndian<quint64>(value, data.data() + offset);
+}
+
+static QByteArray peFile(bool is64, const QStringList& imports, const QStringList& delayImports)
+{
+    const int       optionalSize = is64 ? 240 : 224;
+    const quint32   sectionRva = 0x1000;
+    const int       sectionOffset = 0x200;
+    const int       importsSize = (imports.size() + 1) * 20;
+    const int       delayImportsSize = (delayImports.size() + 1) * 32;
+
+    QByteArray section(importsSize + delayImportsSize, '\0');
+    QByteArray names;
+    for (int i = 0; i < imports.size(); i++)
+    {
+        put32(section, i * 20 + 12, sectionRva + section.size() + names.size());
+        names += imports.at(i).toLatin1() + '\0';
+    }
+    for (int i = 0; i < delayImports.size(); i++)
+    {
+        // Attribute 1 : the addresses are RVA
+        put32(section, importsSize + i * 32, 1);
+        put32(section, importsSize + i * 32 + 4, sectionRva + section.size() + names.size());
+        names += delayImports.at(i).toLatin1() + '\0';
+    }
+    section += names;
+    section.append((0x200 - section.size() % 0x200) % 0x200, '\0');
+
+    QByteArray file(sectionOffset, '\0');
+    file[0] = 'M';
+    file[1] = 'Z';
+    put32(file, 0x3C, 0x40);
+    file.replace(0x40, 4, QByteArray("PE\0\0", 4));
+    const int coff = 0x44;
+    put16(file, coff, is64 ? 0x8664 : 0x14c);
+    put16(file, coff + 2, 1);
+    put16(file, coff + 16, optionalSize);
+    put16(file, coff + 18, 0x2022);
+    const int optional = coff + 20;
+    put16(file, optional, is64 ? 0x20b : 0x10b);
+    if (is64)
+        put64(file, optional + 24, 0x140000000);
+    else
+        put32(file, optional + 28, 0x400000);
+    const int dirCount = optional + (is64 ? 108 : 92);
+    put32(file, dirCount, 16);
+    const int directories = dirCount + 4;
+    if (!imports.isEmpty())
+    {
+        put32(file, directories + 1 * 8, sectionRva);
+        put32(file, directories + 1 * 8 + 4, importsSize);
+    }
+    if (!delayImports.isEmpty())
+    {
+        put32(file, directories + 13 * 8, sectionRva + importsSize);
+        put32(file, directories + 13 * 8 + 4, delayImportsSize);
+    }
+    const int header = optional + optionalSize;
+    file.replace(header, 8, QByteArray(".idata\0\0", 8));
+    put32(file, header + 8, section.size());
+    put32(file, header + 12, sectionRva);
+    put32(file, header + 16, section.size());
+    put32(file, header + 20, sectionOffset);
+    put32(file, header + 36, 0xC0000040);
+    return file + section;
+}
+
+class TestPeImports : public QObject
+{
+    Q_OBJECT
+
+private:
+    QString writeFile(const QString& relativePath, const QByteArray& content)
+    {
+        return writeTestFile(m_dir.path(), relativePath, content);
+    }
+
+    QTemporaryDir   m_dir;
+
+private slots:
+    void    readImports_data()
+    {
+        QTest::addColumn<bool>("is64");
+        QTest::addColumn<int>("machine");
+        QTest::newRow("PE32+") << true << 0x8664;
+        QTest::newRow("PE32") << false << 0x14c;
+    }
+
+    void    readImports()
+    {
+        QFETCH(bool, is64);
+        QFETCH(int, machine);
+        const QString path = writeFile(QString("read%1.exe").arg(is64 ? 64 : 32),
+                                       peFile(is64, {"Qt6Core.dll", "KERNEL32.dll"}, {"dwmapi.dll"}));
+        const PeInfo pe = readPeImports(path);
+        QVERIFY(pe.valid);
+        QCOMPARE(pe.is64, is64);
+        QCOMPARE(int(pe.machine), machine);
+        QCOMPARE(pe.imports, QStringList({"Qt6Core.dll", "KERNEL32.dll"}));
+        QCOMPARE(pe.delayImports, QStringList({"dwmapi.dll"}));
+    }
+
+    void    noImports()
+    {
+        const PeInfo pe = readPeImports(writeFile("noimports.dll", peFile(true, {}, {})));
+        QVERIFY(pe.valid);
+        QVERIFY(pe.imports.isEmpty());
+        QVERIFY(pe.delayImports.isEmpty());
+    }
+
+    void    brokenFiles()
+    {
+        const QByteArray pe = peFile(true, {"Qt6Core.dll"}, {});
+        QVERIFY(!readPeImports(writeFile("text.dll", QByteArray(512, 'x'))).valid);
+        QVERIFY(!readPeImports(writeFile("truncated.dll", pe.left(0x80))).valid);
+        QVERIFY(!readPeImports(writeFile("empty.dll", QByteArray())).valid);
+        QVERIFY(!readPeImports(m_dir.filePath("missing.dll")).valid);
+    }
+
+    /*
+     * The prune decision: the executable and the plugin are the roots, the dlls they import from the
+     * application directory are kept whatever the case of the name, unused.dll is not reached
+     */
+    void    closure()
+    {
+        const QString exe = writeFile("closure/app.exe", peFile(true, {"Qt6Core.dll", "KERNEL32.dll"}, {"Qt6Network.DLL"}));
+        const QString core = writeFile("closure/qt6core.dll", peFile(true, {"KERNEL32.dll"}, {}));
+        const QString network = writeFile("closure/Qt6Network.dll", peFile(true, {"Qt6Core.dll"}, {}));
+        const QString gui = writeFile("closure/Qt6Gui.dll", peFile(true, {"Qt6Core.dll"}, {}));
+        const QString unused = writeFile("closure/unused.dll", peFile(true, {"Qt6Core.dll"}, {}));
+        const QString plugin = writeFile("closure/platforms/qwindows.dll", peFile(true, {"Qt6Gui.dll"}, {}));
+
+        const PeClosure closure = peImportClosure({exe, plugin}, {core, network, gui, unused});
+        QVERIFY(closure.valid);
+        QCOMPARE(closure.files, QSet<QString>({exe, core, network, gui, plugin}));
+    }
+
+    void    closureUnreadable()
+    {
+        const QString exe = writeFile("unreadable/app.exe", peFile(true, {"broken.dll"}, {}));
+        const QString broken = writeFile("unreadable/broken.dll", QByteArray(512, 'x'));
+
+        const PeClosure closure = peImportClosure({exe}, {broken});
+        QVERIFY(!closure.valid);
+        QCOMPARE(closure.unreadable, broken);
+    }
+};
+
+QTEST_APPLESS_MAIN(TestPeImports)
+
+#include "tst_peimports.moc"
@@ -0,0 +1,28 @@
+QT += testlib concurrent
+QT -= gui
+
+CONFIG += c++17 console testcase
+CONFIG -= app_bundle
+
+include(../tests.pri)
+
+TARGET = tst_sevenziparchive
+
+INCLUDEPATH += ../..
+
+unix {
+    CONFIG += link_pkgconfig
+    PKGCONFIG += liblzma
+}
+win32: LIBS += -llzma
+
+SOURCES += \
+    tst_sevenziparchive.cpp \
+    ../../trace.cpp \
+    ../../sevenziparchive.cpp \
+    ../../ziparchive.cpp
+
+HEADERS += \
+    ../../trace.h \
+    ../../sevenziparchive.h \
+    ../../ziparchive.h
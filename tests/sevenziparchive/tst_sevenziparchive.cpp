@@ -0,0 +1,164 @@
+#include <QtTest>
+#include <QProcess>
+#include <QTemporaryDir>
+#include <QRandomGenerator>
+#include <QStandardPaths>
+#include <sevenziparchive.h>
+#include <ziparchive.h>
+#include <testutils.h>
+
+/*
+ * The archives are written like the Windows release, from the files read by writeZipArchive.
+ * They are extracted with 7-Zip or bsdtar, the tests needing them are skipped when none is installed
+ */
+class TestSevenZipArchive : public QObject
+{
+    Q_OBJECT
+
+private:
+    void    writeFile(const QString& relativePath, const QByteArray& content)
+    {
+        writeTestFile(m_source.path(), relativePath, content);
+        m_files[relativePath] = content;
+    }
+
+    bool    writeArchives(const QString& name, const QDateTime& time = QDateTime())
+    {
+        QString error;
+        SevenZipArchive sevenZip(m_output.filePath(name + ".7z"));
+        if (!sevenZip.open(&error))
+        {
+            qWarning() << error;
+            return false;
+        }
+        const ZipEntryHandler handler = [&sevenZip](const QByteArray& entryName, const QByteArray& content, quint32 crc, const QDateTime& entryTime) {
+            sevenZip.addFile(entryName, content, crc, entryTime);
+        };
+        if (!writeZipArchive(m_output.filePath(name + ".zip"), m_source.path(), "App-1.0", &error, time, handler)
+            || !sevenZip.close(&error))
+        {
+            qWarning() << error;
+            return false;
+        }
+        return true;
+    }
+
+    bool    extract(const QString& archive, const QString& destination)
+    {
+        QProcess process;
+        // bsdtar converts the UTF-16 names to the locale charset
+        QProcessEnvironment env = QProcessEnvironment::systemEnvironment();
+        env.insert("LC_ALL", "C.UTF-8");
+        process.setProcessEnvironment(env);
+        if (QFileInfo(m_extractor).baseName() == "bsdtar")
+            process.start(m_extractor, {"-xf", archive, "-C", destination});
+        else
+            process.start(m_extractor, {"x", "-y", "-o" + destination, archive});
+        if (!process.waitForFinished(60000) || process.exitStatus() != QProcess::NormalExit || process.exitCode() != 0)
+        {
+            qWarning() << process.readAllStandardOutput() << process.readAllStandardError();
+            return false;
+        }
+        return true;
+    }
+
+    QTemporaryDir               m_source;
+    QTemporaryDir               m_output;
+    QMap<QString, QByteArray>   m_files;
+    QString                     m_extractor;
+
+private slots:
+    void    initTestCase()
+    {
+        QVERIFY(m_source.isValid());
+        QVERIFY(m_output.isValid());
+        for (const QString& exe : {"7zz", "7z", "7za", "bsdtar"})
+        {
+            m_extractor = QStandardPaths::findExecutable(exe);
+            if (!m_extractor.isEmpty())
+                break;
+        }
+        QByteArray random(300 * 1024, '\0');
+        QRandomGenerator generator(42);
+        generator.fillRange(reinterpret_cast<quint32*>(random.data()), random.size() / 4);
+        writeFile("app.exe", random);
+        writeFile("empty.txt", QByteArray());
+        writeFile("readme.txt", QByteArray("Some text that LZMA2 can compress well. ").repeated(2000));
+        writeFile("platforms/qwindows.dll", random.left(1000) + QByteArray(5000, 'a'));
+        writeFile(QString::fromUtf8("translations/caf\xc3\xa9.qm"), "non ASCII names are stored in UTF-16");
+        writeFile(".hidden", "hidden files are archived too");
+        writeFile("zz_empty.txt", QByteArray());
+        // More than one solid block
+        writeFile("data/big.bin", random.repeated(240));
+    }
+
+    void    signature()
+    {
+        QVERIFY(writeArchives("signature"));
+        QFile archive(m_output.filePath("signature.7z"));
+        QVERIFY(archive.open(QIODevice::ReadOnly));
+        const QByteArray header = archive.read(32);
+        QCOMPARE(header.left(6), QByteArray("7z\xBC\xAF\x27\x1C", 6));
+        const quint64 nextHeaderOffset = qFromLittleEndian<quint64>(header.constData() + 12);
+        const quint64 nextHeaderSize = qFromLittleEndian<quint64>(header.constData() + 20);
+        QCOMPARE(32 + nextHeaderOffset + nextHeaderSize, quint64(archive.size()));
+    }
+
+    void    extractBack()
+    {
+        if (m_extractor.isEmpty())
+            QSKIP("Neither 7-Zip nor bsdtar is installed");
+        QVERIFY(writeArchives("extract"));
+        const QString destination = m_output.filePath("extracted");
+        QVERIFY(QDir().mkpath(destination));
+        QVERIFY(extract(m_output.filePath("extract.7z"), destination));
+        int count = 0;
+        QDirIterator files(destination, QDir::Files | QDir::Hidden | QDir::NoDotAndDotDot, QDirIterator::Subdirectories);
+        while (files.hasNext())
+        {
+            files.next();
+            count++;
+        }
+        QCOMPARE(count, m_files.size());
+        for (auto it = m_files.cbegin(); it != m_files.cend(); ++it)
+        {
+            QFile file(destination + "/App-1.0/" + it.key());
+            QVERIFY2(file.open(QIODevice::ReadOnly), qPrintable(it.key()));
+            QVERIFY2(file.readAll() == it.value(), qPrintable(it.key()));
+        }
+    }
+
+    void    fixedTime()
+    {
+        const QDateTime time(QDate(2024, 3, 1), QTime(12, 30, 10));
+        QVERIFY(writeArchives("first", time));
+        QVERIFY(writeArchives("second", time));
+        QFile first(m_output.filePath("first.7z"));
+        QFile second(m_output.filePath("second.7z"));
+        QVERIFY(first.open(QIODevice::ReadOnly));
+        QVERIFY(second.open(QIODevice::ReadOnly));
+        QCOMPARE(first.readAll(), second.readAll());
+    }
+
+    void    noFile()
+    {
+        const QString path = m_output.filePath("empty.7z");
+        SevenZipArchive sevenZip(path);
+        QString error;
+        QVERIFY2(sevenZip.open(&error), qPrintable(error));
+        QVERIFY2(sevenZip.close(&error), qPrintable(error));
+        QCOMPARE(QFileInfo(path).size(), qint64(32));
+    }
+
+    void    missingOutputDirectory()
+    {
+        SevenZipArchive sevenZip(m_output.filePath("missing/test.7z"));
+        QString error;
+        QVERIFY(!sevenZip.open(&error));
+        QVERIFY(!error.isEmpty());
+    }
+};
+
+QTEST_GUILESS_MAIN(TestSevenZipArchive)
+
+#include "tst_sevenziparchive.moc"
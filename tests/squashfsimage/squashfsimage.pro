@@ -0,0 +1,26 @@
+QT += testlib concurrent
+QT -= gui
+
+CONFIG += c++17 console testcase
+CONFIG -= app_bundle
+
+include(../tests.pri)
+
+TARGET = tst_squashfsimage
+
+INCLUDEPATH += ../..
+
+unix {
+    CONFIG += link_pkgconfig
+    PKGCONFIG += libzstd
+}
+win32: LIBS += -lzstd
+
+SOURCES += \
+    tst_squashfsimage.cpp \
+    ../../trace.cpp \
+    ../../squashfsimage.cpp
+
+HEADERS += \
+    ../../trace.h \
+    ../../squashfsimage.h
@@ -0,0 +1,137 @@
+#include <QtTest>
+#include <QProcess>
+#include <QTemporaryDir>
+#include <QRandomGenerator>
+#include <QStandardPaths>
+#include <QtEndian>
+#include <squashfsimage.h>
+#include <testutils.h>
+
+class TestSquashfsImage : public QObject
+{
+    Q_OBJECT
+
+private:
+    void    writeFile(const QString& relativePath, const QByteArray& content)
+    {
+        writeTestFile(m_source.path(), relativePath, content);
+        m_files[relativePath] = content;
+    }
+
+    // The image is written after offset bytes, like after the AppImage runtime
+    QByteArray  writeImage(const QString& name, int offset, const QDateTime& time = QDateTime())
+    {
+        QFile image(m_output.filePath(name));
+        if (!image.open(QIODevice::WriteOnly) || image.write(QByteArray(offset, 'R')) != offset)
+            return QByteArray();
+        QString error;
+        if (!writeSquashfsImage(image, m_source.path(), &error, time))
+        {
+            qWarning() << error;
+            return QByteArray();
+        }
+        image.close();
+        if (!image.open(QIODevice::ReadOnly))
+            return QByteArray();
+        return image.readAll();
+    }
+
+    QTemporaryDir               m_source;
+    QTemporaryDir               m_output;
+    QMap<QString, QByteArray>   m_files;
+
+private slots:
+    void    initTestCase()
+    {
+        QVERIFY(m_source.isValid());
+        QVERIFY(m_output.isValid());
+        QByteArray random(300 * 1024, '\0');
+        QRandomGenerator generator(42);
+        generator.fillRange(reinterpret_cast<quint32*>(random.data()), random.size() / 4);
+        // Bigger than a block, not a multiple of the block size
+        writeFile("usr/bin/app", random);
+        writeFile("usr/lib/libtext.so", QByteArray("Some text that zstd can compress well. ").repeated(20000));
+        writeFile("usr/lib/exact.bin", QByteArray(128 * 1024, 'b'));
+        writeFile("empty.txt", QByteArray());
+        writeFile(".hidden", "hidden files are in the image too");
+        // More than the 256 entries of a directory header
+        for (int i = 0; i < 300; i++)
+            writeFile(QString("usr/share/many/file%1.txt").arg(i, 3, 10, QChar('0')), QByteArray::number(i).repeated(i));
+        QFile app(m_source.filePath("usr/bin/app"));
+        QVERIFY(app.setPermissions(app.permissions() | QFileDevice::ExeOwner | QFileDevice::ExeGroup | QFileDevice::ExeOther));
+        QVERIFY(QFile::link("usr/bin/app", m_source.filePath("AppRun")));
+    }
+
+    void    superblock()
+    {
+        const int offset = 1000;
+        const QByteArray file = writeImage("superblock.img", offset);
+        QVERIFY(file.size() > offset + 96);
+        const QByteArray image = file.mid(offset);
+        const uchar* data = reinterpret_cast<const uchar*>(image.constData());
+        QCOMPARE(qFromLittleEndian<quint32>(data), 0x73717368u);
+        // 305 files, the symbolic link and the 6 directories
+        QCOMPARE(qFromLittleEndian<quint32>(data + 4), 312u);
+        QCOMPARE(qFromLittleEndian<quint32>(data + 12), 128u * 1024);
+        QCOMPARE(qFromLittleEndian<quint16>(data + 20), quint16(6)); // zstd
+        QCOMPARE(qFromLittleEndian<quint16>(data + 28), quint16(4));
+        QCOMPARE(qFromLittleEndian<quint16>(data + 30), quint16(0));
+        const quint64 bytesUsed = qFromLittleEndian<quint64>(data + 40);
+        const quint64 idTable = qFromLittleEndian<quint64>(data + 48);
+        const quint64 inodeTable = qFromLittleEndian<quint64>(data + 64);
+        const quint64 directoryTable = qFromLittleEndian<quint64>(data + 72);
+        const quint64 fragmentTable = qFromLittleEndian<quint64>(data + 80);
+        // The kernel refuses an image with the tables in another order
+        QVERIFY(inodeTable < directoryTable);
+        QVERIFY(directoryTable < fragmentTable);
+        QVERIFY(fragmentTable < idTable);
+        QCOMPARE(idTable + 8, bytesUsed);
+        QVERIFY(bytesUsed <= quint64(image.size()));
+        QVERIFY(image.size() % 4096 == 0);
+    }
+
+    void    fixedTime()
+    {
+        const QDateTime time(QDate(2024, 3, 1), QTime(12, 30, 10));
+        const QByteArray first = writeImage("first.img", 0, time);
+        QVERIFY(!first.isEmpty());
+        QCOMPARE(writeImage("second.img", 0, time), first);
+        QCOMPARE(qFromLittleEndian<quint32>(first.constData() + 8), quint32(time.toSecsSinceEpoch()));
+    }
+
+    void    unsquashfs()
+    {
+        const QString unsquashfs = QStandardPaths::findExecutable("unsquashfs");
+        if (unsquashfs.isEmpty())
+            QSKIP("unsquashfs is not installed");
+        QVERIFY(!writeImage("extract.img", 0).isEmpty());
+        const QString extracted = m_output.filePath("extracted");
+        QProcess process;
+        process.start(unsquashfs, {"-no-xattrs", "-d", extracted, m_output.filePath("extract.img")});
+        QVERIFY(process.waitForFinished(60000));
+        QVERIFY2(process.exitCode() == 0, process.readAllStandardError().constData());
+        for (auto it = m_files.cbegin(); it != m_files.cend(); ++it)
+        {
+            QFile file(extracted + "/" + it.key());
+            QVERIFY2(file.open(QIODevice::ReadOnly), qPrintable(it.key()));
+            QCOMPARE(file.readAll(), it.value());
+        }
+        QVERIFY(QFileInfo(extracted + "/usr/bin/app").isExecutable());
+        QVERIFY(!QFileInfo(extracted + "/usr/lib/libtext.so").isExecutable());
+        QVERIFY(QFileInfo(extracted + "/AppRun").isSymLink());
+        QCOMPARE(QFileInfo(extracted + "/AppRun").symLinkTarget(), QFileInfo(extracted + "/usr/bin/app").absoluteFilePath());
+    }
+
+    void    missingSource()
+    {
+        QFile image(m_output.filePath("missing.img"));
+        QVERIFY(image.open(QIODevice::WriteOnly));
+        QString error;
+        QVERIFY(!writeSquashfsImage(image, m_output.filePath("missing"), &error));
+        QVERIFY(!error.isEmpty());
+    }
+};
+
+QTEST_GUILESS_MAIN(TestSquashfsImage)
+
+#include "tst_squashfsimage.moc"
@@ -0,0 +1,5 @@
+# Included by every test program
+INCLUDEPATH += $$PWD
+
+HEADERS += \
+    $$PWD/testutils.h
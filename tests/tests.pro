@@ -0,0 +1,11 @@
+TEMPLATE = subdirs
+
+SUBDIRS += \
+    benchmarks \
+    elfreader \
+    imageinfo \
+    peimports \
+    sevenziparchive \
+    squashfsimage \
+    variantbuild \
+    ziparchive
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QtTest>
+
+/*
+ * Fixture helpers shared by the test programs, tests/tests.pri puts this directory in their include path
+ */
+
+// Write content in baseDir/relativePath, creating the directories, and return the absolute path of the file
+inline QString  writeTestFile(const QString& baseDir, const QString& relativePath, const QByteArray& content)
+{
+    const QString path = QDir(baseDir).filePath(relativePath);
+    QDir().mkpath(QFileInfo(path).absolutePath());
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly) || file.write(content) != content.size())
+        qFatal("Can't write %s : %s", qPrintable(path), qPrintable(file.errorString()));
+    return QFileInfo(path).absoluteFilePath();
+}
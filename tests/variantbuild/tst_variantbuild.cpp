@@ -0,0 +1,198 @@
+#include <QtTest>
+#include <QTemporaryDir>
+#include <variantbuild.h>
+#include <testutils.h>
+
+// sourcetree.cpp reports its errors with this, the application gets it from basestuff.cpp
+void    error_and_exit(QString error)
+{
+    qFatal("%s", qPrintable(error));
+}
+
+using VariantList = QList<QPair<QString, bool>>;
+
+/*
+ * A trimmed Makefile.Release as qmake writes it for mingw: main.cpp and mainwindow.cpp include mainwindow.h,
+ * moc_mainwindow.cpp is generated from it. The ui header rule writes in the source directory on purpose
+ */
+static const char sampleMakefile[] = R"(#############################################################################
+# Makefile for building: app
+#############################################################################
+
+MAKEFILE      = Makefile.Release
+
+####### Compiler, tools and options
+
+CC            = x86_64-w64-mingw32-gcc
+CXX           = x86_64-w64-mingw32-g++
+DEFINES       = -DUNICODE -D_UNICODE -DWIN32 -DSQPROJECT_WIN32_STANDALONE -DQT_NO_DEBUG -DQT_WIDGETS_LIB
+MOC           = /usr/lib/qt6/libexec/moc
+
+####### Files
+
+SOURCES       = ../src/main.cpp \
+		../src/mainwindow.cpp \
+		../src/about.cpp release/moc_mainwindow.cpp
+OBJECTS       = release/main.o \
+		release/mainwindow.o \
+		release/about.o \
+		release/moc_mainwindow.o
+
+first: all
+
+####### Build rules
+
+release/app.exe:  $(OBJECTS)
+	$(LINKER) $(LFLAGS) -o $(DESTDIR_TARGET) $(OBJECTS) $(LIBS)
+
+all: Makefile.Release release/app.exe
+
+####### Compile
+
+release/moc_predefs.h: ../../Qt/mkspecs/features/data/dummy.cpp
+	$(CXX) $(CXXFLAGS) -dM -E -o release/moc_predefs.h ../../Qt/mkspecs/features/data/dummy.cpp
+
+release/moc_mainwindow.cpp: ../src/mainwindow.h \
+		release/moc_predefs.h \
+		$(MOC)
+	$(MOC) $(DEFINES) --include release/moc_predefs.h ../src/mainwindow.h -o release/moc_mainwindow.cpp
+
+../src/ui_mainwindow.h: ../src/mainwindow.h
+	$(UIC) ../src/mainwindow.ui -o ../src/ui_mainwindow.h
+
+release/main.o: ../src/main.cpp ../src/mainwindow.h
+	$(CXX) -c $(CXXFLAGS) $(INCPATH) -o release/main.o ../src/main.cpp
+
+release/mainwindow.o: ../src/mainwindow.cpp ../src/mainwindow.h \
+		../src/about.h
+	$(CXX) -c $(CXXFLAGS) $(INCPATH) -o release/mainwindow.o ../src/mainwindow.cpp
+
+release/about.o: ../src/about.cpp ../src/about.h
+	$(CXX) -c $(CXXFLAGS) $(INCPATH) -o release/about.o ../src/about.cpp
+
+release/moc_mainwindow.o: release/moc_mainwindow.cpp
+	$(CXX) -c $(CXXFLAGS) $(INCPATH) -o release/moc_mainwindow.o release/moc_mainwindow.cpp
+
+release/app.exe: release/main.o release/mainwindow.o release/about.o release/moc_mainwindow.o
+)";
+
+class TestVariantBuild : public QObject
+{
+    Q_OBJECT
+
+private:
+    QString writeFile(const QString& relativePath, const QByteArray& content)
+    {
+        return writeTestFile(m_dir.path(), relativePath, content);
+    }
+
+    QStringList buildFiles(const QStringList& relativePaths)
+    {
+        QStringList toret;
+        for (const QString& path : relativePaths)
+            toret << QDir::cleanPath(m_dir.filePath("build/" + path));
+        toret.sort();
+        return toret;
+    }
+
+    QTemporaryDir   m_dir;
+
+private slots:
+    void    initTestCase()
+    {
+        QVERIFY(m_dir.isValid());
+        writeFile("src/main.cpp", "#include \"mainwindow.h\"\nint main() { return 0; }\n");
+        writeFile("src/mainwindow.h", "#ifdef SQPROJECT_WIN32_STANDALONE\n#define PORTABLE 1\n#endif\nclass MainWindow;\n");
+        writeFile("src/mainwindow.cpp", "#include \"mainwindow.h\"\n#include \"about.h\"\n");
+        writeFile("src/about.h", "// Mention SQPROJECT_WIN32_STANDALONE_EXTRA, not the define\n");
+        writeFile("src/about.cpp", "#include \"about.h\"\n");
+        writeFile("src/app.rc", "#ifdef SQPROJECT_WIN32_INSTALL\n#endif\n");
+        writeFile("src/README.md", "Build with SQPROJECT_WIN32_STANDALONE\n");
+        writeFile("build/Makefile.Release", sampleMakefile);
+        for (const QString& output : {"release/main.o", "release/mainwindow.o", "release/about.o", "release/moc_predefs.h",
+                                      "release/moc_mainwindow.cpp", "release/moc_mainwindow.o", "release/app.exe"})
+            writeFile("build/" + output, "built");
+    }
+
+    void    planVariantBuilds_data()
+    {
+        QTest::addColumn<VariantList>("variants");
+        QTest::addColumn<bool>("reuse");
+        QTest::addColumn<QList<int>>("reuseFrom");
+
+        const VariantList both = {{"x64", false}, {"x64", true}, {"x86", false}, {"x86", true}};
+        QTest::newRow("reuse") << both << true << QList<int>({-1, 0, -1, 2});
+        QTest::newRow("no reuse") << both << false << QList<int>({-1, -1, -1, -1});
+        QTest::newRow("interleaved") << VariantList({{"x64", true}, {"x86", true}, {"x64", false}})
+                                     << true << QList<int>({-1, -1, 0});
+        QTest::newRow("single") << VariantList({{"x64", false}}) << true << QList<int>({-1});
+    }
+
+    void    planVariantBuilds()
+    {
+        QFETCH(VariantList, variants);
+        QFETCH(bool, reuse);
+        QFETCH(QList<int>, reuseFrom);
+        const QList<VariantBuild> plan = ::planVariantBuilds(variants, reuse);
+        QCOMPARE(plan.size(), variants.size());
+        for (int i = 0; i < plan.size(); i++)
+        {
+            QCOMPARE(plan.at(i).arch, variants.at(i).first);
+            QCOMPARE(plan.at(i).standalone, variants.at(i).second);
+            QCOMPARE(plan.at(i).reuseFrom, reuseFrom.at(i));
+        }
+    }
+
+    void    filesUsingDefines()
+    {
+        QStringList files = ::filesUsingDefines(m_dir.filePath("src"), {"SQPROJECT_WIN32_STANDALONE", "SQPROJECT_WIN32_INSTALL"});
+        files.sort();
+        QStringList expected = {QFileInfo(m_dir.filePath("src/app.rc")).absoluteFilePath(),
+                                QFileInfo(m_dir.filePath("src/mainwindow.h")).absoluteFilePath()};
+        expected.sort();
+        QCOMPARE(files, expected);
+    }
+
+    // The moc chain is followed, about.o does not use the header and the ui header is a source.
+    // all and first are phony targets, they are listed but there is no file to remove
+    void    staleMakeTargets()
+    {
+        QStringList stale = ::staleMakeTargets(m_dir.filePath("build"), {m_dir.filePath("src/mainwindow.h")});
+        stale.sort();
+        QCOMPARE(stale, buildFiles({"release/main.o", "release/mainwindow.o", "release/moc_mainwindow.cpp",
+                                    "release/moc_mainwindow.o", "release/app.exe", "all", "first"}));
+        QVERIFY(::staleMakeTargets(m_dir.filePath("build"), {m_dir.filePath("src/unknown.h")}).isEmpty());
+    }
+
+    void    removeStaleMakeTargets()
+    {
+        QTemporaryDir copy;
+        QVERIFY(::copyBuildDirectory(m_dir.path(), copy.path()));
+        QCOMPARE(::removeStaleMakeTargets(copy.filePath("build"), {copy.filePath("src/about.h")}), 3);
+        QVERIFY(!QFileInfo::exists(copy.filePath("build/release/about.o")));
+        QVERIFY(!QFileInfo::exists(copy.filePath("build/release/mainwindow.o")));
+        QVERIFY(!QFileInfo::exists(copy.filePath("build/release/app.exe")));
+        QVERIFY(QFileInfo::exists(copy.filePath("build/release/main.o")));
+        QVERIFY(QFileInfo::exists(copy.filePath("build/release/moc_mainwindow.o")));
+        QVERIFY(QFileInfo::exists(copy.filePath("src/about.h")));
+    }
+
+    void    copyBuildDirectory()
+    {
+        const QString source = writeFile("old/release/main.o", "object");
+        const QDateTime old = QDateTime::currentDateTime().addDays(-3);
+        QFile file(source);
+        QVERIFY(file.open(QIODevice::ReadWrite));
+        QVERIFY(file.setFileTime(old, QFileDevice::FileModificationTime));
+        file.close();
+        QTemporaryDir copy;
+        QVERIFY(::copyBuildDirectory(m_dir.filePath("old"), copy.path()));
+        const QFileInfo copied(copy.filePath("release/main.o"));
+        QVERIFY(copied.exists());
+        QCOMPARE(copied.lastModified().toSecsSinceEpoch(), old.toSecsSinceEpoch());
+    }
+};
+
+QTEST_GUILESS_MAIN(TestVariantBuild)
+
+#include "tst_variantbuild.moc"
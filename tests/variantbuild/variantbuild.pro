@@ -0,0 +1,22 @@
+QT += testlib
+QT -= gui
+
+CONFIG += c++17 console testcase
+CONFIG -= app_bundle
+
+include(../tests.pri)
+
+TARGET = tst_variantbuild
+
+INCLUDEPATH += ../.. ../../Windows
+
+SOURCES += \
+    tst_variantbuild.cpp \
+    ../../sourcetree.cpp \
+    ../../trace.cpp \
+    ../../Windows/variantbuild.cpp
+
+HEADERS += \
+    ../../sourcetree.h \
+    ../../trace.h \
+    ../../Windows/variantbuild.h
@@ -0,0 +1,121 @@
+#include <QtTest>
+#include <QProcess>
+#include <QTemporaryDir>
+#include <QRandomGenerator>
+#include <QStandardPaths>
+#include <ziparchive.h>
+#include <testutils.h>
+
+/*
+ * The archives are checked with Info-ZIP unzip, the tests needing it are skipped when it is not installed
+ */
+class TestZipArchive : public QObject
+{
+    Q_OBJECT
+
+private:
+    void    writeFile(const QString& relativePath, const QByteArray& content)
+    {
+        writeTestFile(m_source.path(), relativePath, content);
+        m_files[relativePath] = content;
+    }
+
+    QByteArray  unzip(const QStringList& args)
+    {
+        QProcess process;
+        process.start(m_unzip, args);
+        if (!process.waitForFinished(60000) || process.exitStatus() != QProcess::NormalExit || process.exitCode() != 0)
+        {
+            qWarning() << process.readAllStandardOutput() << process.readAllStandardError();
+            return QByteArray();
+        }
+        return process.readAllStandardOutput();
+    }
+
+    QTemporaryDir               m_source;
+    QTemporaryDir               m_output;
+    QMap<QString, QByteArray>   m_files;
+    QString                     m_unzip;
+
+private slots:
+    void    initTestCase()
+    {
+        QVERIFY(m_source.isValid());
+        QVERIFY(m_output.isValid());
+        m_unzip = QStandardPaths::findExecutable("unzip");
+        QByteArray random(300 * 1024, '\0');
+        QRandomGenerator generator(42);
+        generator.fillRange(reinterpret_cast<quint32*>(random.data()), random.size() / 4);
+        writeFile("app.exe", random);
+        writeFile("empty.txt", QByteArray());
+        writeFile("readme.txt", QByteArray("Some text that deflate can compress well. ").repeated(2000));
+        writeFile("platforms/qwindows.dll", random.left(1000) + QByteArray(5000, 'a'));
+        writeFile(".hidden", "hidden files are archived too");
+    }
+
+    void    unzipTest()
+    {
+        if (m_unzip.isEmpty())
+            QSKIP("unzip is not installed");
+        const QString zipPath = m_output.filePath("test.zip");
+        QString error;
+        QVERIFY2(writeZipArchive(zipPath, m_source.path(), "App-1.0", &error), qPrintable(error));
+        const QByteArray result = unzip({"-t", zipPath});
+        QVERIFY(result.contains("No errors detected"));
+    }
+
+    void    readBack()
+    {
+        if (m_unzip.isEmpty())
+            QSKIP("unzip is not installed");
+        const QString zipPath = m_output.filePath("readback.zip");
+        QString error;
+        QVERIFY2(writeZipArchive(zipPath, m_source.path(), "App-1.0", &error), qPrintable(error));
+        // Entries are sorted and all under the root name
+        QStringList expected;
+        for (const QString& name : m_files.keys())
+            expected << "App-1.0/" + name;
+        std::sort(expected.begin(), expected.end(), [](const QString& a, const QString& b) { return a.toUtf8() < b.toUtf8(); });
+        QCOMPARE(QString::fromUtf8(unzip({"-Z1", zipPath})).split('\n', Qt::SkipEmptyParts), expected);
+        for (auto it = m_files.cbegin(); it != m_files.cend(); ++it)
+            QCOMPARE(unzip({"-p", zipPath, "App-1.0/" + it.key()}), it.value());
+    }
+
+    void    fixedTime()
+    {
+        const QDateTime time(QDate(2024, 3, 1), QTime(12, 30, 10));
+        QString error;
+        QVERIFY2(writeZipArchive(m_output.filePath("first.zip"), m_source.path(), "App", &error, time), qPrintable(error));
+        QVERIFY2(writeZipArchive(m_output.filePath("second.zip"), m_source.path(), "App", &error, time), qPrintable(error));
+        QFile first(m_output.filePath("first.zip"));
+        QFile second(m_output.filePath("second.zip"));
+        QVERIFY(first.open(QIODevice::ReadOnly));
+        QVERIFY(second.open(QIODevice::ReadOnly));
+        QCOMPARE(first.readAll(), second.readAll());
+    }
+
+    // The file is sparse, it is refused before being read
+    void    tooBigFile()
+    {
+        QTemporaryDir source;
+        QFile big(source.filePath("big.bin"));
+        QVERIFY(big.open(QIODevice::WriteOnly));
+        if (!big.resize(0x100000000ll + 1))
+            QSKIP("Can't create a file bigger than 4GiB here");
+        big.close();
+        QString error;
+        QVERIFY(!writeZipArchive(m_output.filePath("big.zip"), source.path(), "App", &error));
+        QVERIFY(error.contains("zip64"));
+    }
+
+    void    missingOutputDirectory()
+    {
+        QString error;
+        QVERIFY(!writeZipArchive(m_output.filePath("missing/test.zip"), m_source.path(), "App", &error));
+        QVERIFY(!error.isEmpty());
+    }
+};
+
+QTEST_GUILESS_MAIN(TestZipArchive)
+
+#include "tst_ziparchive.moc"
@@ -0,0 +1,20 @@
+QT += testlib concurrent
+QT -= gui
+
+CONFIG += c++17 console testcase
+CONFIG -= app_bundle
+
+include(../tests.pri)
+
+TARGET = tst_ziparchive
+
+INCLUDEPATH += ../..
+
+SOURCES += \
+    tst_ziparchive.cpp \
+    ../../trace.cpp \
+    ../../ziparchive.cpp
+
+HEADERS += \
+    ../../trace.h \
+    ../../ziparchive.h
@@ -0,0 +1,148 @@
+#include <QFile>
+#include <QHash>
+#include <QMutex>
+#include <QThread>
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QJsonDocument>
+#include <QElapsedTimer>
+#include <QCoreApplication>
+#include <cstdlib>
+#include <trace.h>
+
+struct OpenSpan
+{
+    QString name;
+    QString category;
+    qint64  start;
+    int     tid;
+};
+
+struct TraceState
+{
+    bool            enabled = false;
+    QString         path;
+    QElapsedTimer   timer;
+    QMutex          mutex;
+    QJsonArray      events;
+    QHash<quint64, OpenSpan> openSpans;
+    quint64         nextId = 1;
+    QHash<Qt::HANDLE, int> threadIds;
+};
+
+static TraceState& state()
+{
+    static TraceState toret;
+    return toret;
+}
+
+static qint64  ownPid()
+{
+    return QCoreApplication::applicationPid();
+}
+
+// Small thread ids read better than handles in the viewer, called with the mutex locked
+static int     currentTid()
+{
+    TraceState& trace = state();
+    Qt::HANDLE handle = QThread::currentThreadId();
+    if (!trace.threadIds.contains(handle))
+        trace.threadIds[handle] = trace.threadIds.size() + 1;
+    return trace.threadIds.value(handle);
+}
+
+static void    addComplete(const QString& name, const QString& category, qint64 start, qint64 end, qint64 tid, const QJsonObject& args)
+{
+    QJsonObject event;
+    event["name"] = name;
+    event["cat"] = category;
+    event["ph"] = "X";
+    event["ts"] = start;
+    event["dur"] = end - start;
+    event["pid"] = ownPid();
+    event["tid"] = tid;
+    if (!args.isEmpty())
+        event["args"] = args;
+    state().events.append(event);
+}
+
+static void    writeTrace()
+{
+    TraceState& trace = state();
+    QMutexLocker locker(&trace.mutex);
+    // Spans still open when exit is called (error_and_exit for example)
+    const qint64 now = trace.timer.nsecsElapsed() / 1000;
+    for (const OpenSpan& span : trace.openSpans)
+        addComplete(span.name, span.category, span.start, now, span.tid, QJsonObject{{"unfinished", true}});
+    trace.openSpans.clear();
+    QJsonObject processName{{"name", "process_name"}, {"ph", "M"}, {"pid", ownPid()}, {"args", QJsonObject{{"name", "sqpackager"}}}};
+    trace.events.prepend(processName);
+    QFile file(trace.path);
+    if (!file.open(QIODevice::WriteOnly))
+    {
+        fprintf(stderr, "Could not write the trace file %s\n", qPrintable(trace.path));
+        return ;
+    }
+    file.write(QJsonDocument(QJsonObject{{"traceEvents", trace.events}, {"displayTimeUnit", "ms"}}).toJson(QJsonDocument::Compact));
+}
+
+void    startTrace(const QString& path)
+{
+    TraceState& trace = state();
+    trace.path = path;
+    trace.timer.start();
+    trace.enabled = true;
+    atexit(writeTrace);
+}
+
+bool    traceEnabled()
+{
+    return state().enabled;
+}
+
+qint64  traceTimestamp()
+{
+    return state().enabled ? state().timer.nsecsElapsed() / 1000 : 0;
+}
+
+/*
+ * Each child process get its own track named after the command
+ */
+void    traceProcess(const QString& command, const QStringList& args, qint64 pid, qint64 start, int exitCode)
+{
+    TraceState& trace = state();
+    if (!trace.enabled)
+        return ;
+    QMutexLocker locker(&trace.mutex);
+    const qint64 end = trace.timer.nsecsElapsed() / 1000;
+    const qint64 tid = pid != 0 ? pid : currentTid();
+    trace.events.append(QJsonObject{{"name", "thread_name"}, {"ph", "M"}, {"pid", ownPid()}, {"tid", tid},
+                                    {"args", QJsonObject{{"name", command + " (" + QString::number(pid) + ")"}}}});
+    addComplete(command, "process", start, end, tid, QJsonObject{
+                    {"pid", pid},
+                    {"argv", QJsonArray::fromStringList(QStringList() << command << args)},
+                    {"exit_code", exitCode}});
+}
+
+TraceSpan::TraceSpan(const QString& name, const QString& category)
+{
+    m_id = 0;
+    TraceState& trace = state();
+    if (!trace.enabled)
+        return ;
+    QMutexLocker locker(&trace.mutex);
+    m_id = trace.nextId++;
+    trace.openSpans[m_id] = {name, category, trace.timer.nsecsElapsed() / 1000, currentTid()};
+}
+
+TraceSpan::~TraceSpan()
+{
+    if (m_id == 0)
+        return ;
+    TraceState& trace = state();
+    QMutexLocker locker(&trace.mutex);
+    if (!trace.openSpans.contains(m_id))
+        return ;
+    const OpenSpan span = trace.openSpans.take(m_id);
+    addComplete(span.name, span.category, span.start, trace.timer.nsecsElapsed() / 1000, span.tid, QJsonObject());
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <QString>
+#include <QStringList>
+
+/*
+ * Record spans in the Chrome trace event format, the file is written at exit
+ * It can be loaded in Perfetto or chrome://tracing
+ */
+void    startTrace(const QString& path);
+bool    traceEnabled();
+// Microseconds since the trace started
+qint64  traceTimestamp();
+void    traceProcess(const QString& command, const QStringList& args, qint64 pid, qint64 start, int exitCode);
+
+class TraceSpan
+{
+public:
+    TraceSpan(const QString& name, const QString& category = "phase");
+    ~TraceSpan();
+private:
+    quint64 m_id;
+};
@@ -2,14 +2,83 @@
 #include <QFileInfo>
 #include <QDateTime>
 #include <QDir>
+#include <QDirIterator>
 #include "projectdefinition.h"
 #include "basestuff.h"
 #include "print.h"
 #include "runner.h"
 #include <compile_defines.h>
+#include <sqpackager.h>
+#include <sourcetree.h>
+#include <buildsystem.h>
+#include <desktoprc.h>
+#include <trace.h>
+#include <reproducible.h>
+
+extern PackagerOptions gOptions;
+
+struct InstallManifestEntry
+{
+    QString     mode;
+    QString     source;
+    QString     destination;
+    QString     destinationDir() const
+    {
+        return QFileInfo(destination).path();
+    }
+};
+
+/*
+ * The install manifest is built when the installer is generated : the release directories are walked here
+ * and each file keeps its mode (755 when executable, 644 otherwise)
+ * Format is : mode source destination, tab separated, sorted by mode and destination directory
+ * so the installer can install by batch. It only hashes the sources to skip the files already installed
+ */
+static QString generateInstallManifest(const ProjectDefinition& project)
+{
+    TraceSpan trace("generateInstallManifest");
+    QList<InstallManifestEntry> entries;
+    auto fileMode = [](const QFileInfo& fi) {
+        return QString(fi.isExecutable() ? "755" : "644");
+    };
+    for (const ReleaseFile& releaseInfo : project.releaseFiles)
+    {
+        if (releaseInfo.type != ReleaseFileType::Local)
+            continue;
+        QFileInfo fi(project.basePath + "/" + releaseInfo.source);
+        if (fi.isDir())
+        {
+            QDir sourceDir(fi.absoluteFilePath());
+            QDirIterator it(sourceDir.absolutePath(), QDir::Files | QDir::Hidden | QDir::NoDotAndDotDot, QDirIterator::Subdirectories);
+            while (it.hasNext())
+            {
+                const QString relative = sourceDir.relativeFilePath(it.next());
+                entries.append({fileMode(it.fileInfo()), releaseInfo.source + "/" + relative, releaseInfo.destination + "/" + relative});
+            }
+        } else {
+            entries.append({fileMode(fi), releaseInfo.source, releaseInfo.destination});
+        }
+    }
+    std::sort(entries.begin(), entries.end(), [](const InstallManifestEntry& a, const InstallManifestEntry& b) {
+        if (a.mode != b.mode)
+            return a.mode < b.mode;
+        if (a.destinationDir() != b.destinationDir())
+            return a.destinationDir() < b.destinationDir();
+        return a.destination < b.destination;
+    });
+    QStringList lines;
+    for (const InstallManifestEntry& entry : entries)
+    {
+        if (entry.source.contains('\t') || entry.source.contains('\n') || entry.destination.contains('\t') || entry.destination.contains('\n'))
+            error_and_exit("Release files can't contain tabulation or new line in their name : " + entry.source);
+        lines << entry.mode + "\t" + entry.source + "\t" + entry.destination;
+    }
+    return lines.join("\n");
+}
 
 void    generateUnixInstallFile(const ProjectDefinition& project)
 {
+    TraceSpan trace("generateUnixInstallFile");
     println("Creating Unix Install file");
     QMap<QString, QString> mapping;
 
@@ -21,14 +90,16 @@ void    generateUnixInstallFile(const ProjectDefinition& project)
     mapping["NORMALIZED_DESKTOP_FILE_NAME"] = project.desktopFileNormalizedName;
     mapping["DEBIAN_PACKAGE_NAME"] = project.debianPackageName;
     mapping["NORMALIZED_PROJECT_ICON_PATH"] = project.desktopIconNormalizedName;
-    mapping["PROJECT_ICON_FILE"] = project.icon;
-    mapping["ICON_SIZE"] = QString("%1x%2").arg(project.iconSize.width()).arg(project.iconSize.height());
+    mapping["PROJECT_ICON_FILE"] = project.desktopIcon;
+    setIconMapping(project, mapping);
     mapping["DEFINE_INSTALLED"] = CompileDefines::installed;
     mapping["DEFINE_INSTALL_PREFIX"] = CompileDefines::unix_install_prefix;
     mapping["DEFINE_APP_SHARE"] = CompileDefines::unix_install_share_path;
     mapping["DEFAULT_QMAKE_EXEC"] = "qmake6";
+    mapping["JOBS"] = QString::number(gOptions.jobs);
     if (project.qtMajorVersion == QtMajorVersion::Qt5)
         mapping["DEFAULT_QMAKE_EXEC"] = "qmake";
+    setBuildSystemMapping(project, mapping);
     if (project.readmeFile.isEmpty() == false)
     {
         mapping["HAS_README"] = "";
@@ -48,22 +119,7 @@ void    generateUnixInstallFile(const ProjectDefinition& project)
     if (!project.releaseFiles.isEmpty())
     {
         mapping["HAS_RELEASE_FILES"] = "";
-        for (auto releaseInfo : project.releaseFiles)
-        {
-            if (releaseInfo.type == ReleaseFileType::Local)
-            {
-                QFileInfo fi(project.basePath + "/" + releaseInfo.source);
-                if (fi.isDir())
-                {
-                    mapping["RELEASE_FILES_STRING"] += "install_directory \"" + releaseInfo.source + "\"  \"" + releaseInfo.destination + "\"\n";
-                } else {
-                    QString perm = "644";
-                    if (fi.isExecutable())
-                        perm = "755";
-                    mapping["RELEASE_FILES_STRING"] += "install_file \"" + releaseInfo.source + "\" \"" + releaseInfo.destination + "\" \"" + perm + "\"\n";
-                }
-            }
-        }
+        mapping["INSTALL_MANIFEST"] = generateInstallManifest(project);
     }
 
     QString fileString = useTemplateFile(":/unix_install.tt", mapping);
@@ -77,6 +133,7 @@ void    generateUnixInstallFile(const ProjectDefinition& project)
 
 void    generateManPage(const ProjectDefinition& project)
 {
+    TraceSpan trace("generateManPage");
     println("Creating manpage");
 
     QMap<QString, QString> mapping;
@@ -86,7 +143,7 @@ void    generateManPage(const ProjectDefinition& project)
     mapping["AUTHOR"] = project.author;
     mapping["AUTHOR_MAIL"] = project.authorMail;
     mapping["VERSION"] = project.version.simpleVersion;
-    mapping["DATE"] = QDateTime::currentDateTime().toString("dd MMM yyyy");
+    mapping["DATE"] = buildDateTime().toString("dd MMM yyyy");
 
     QFile manPageFile(project.basePath + "/" + project.targetName + ".manpage.1");
     if (!manPageFile.open(QIODevice::Text | QIODevice::WriteOnly))
@@ -101,6 +158,7 @@ void    generateManPage(const ProjectDefinition& project)
 
 QString    createArchive(const ProjectDefinition& project, QString version)
 {
+    TraceSpan trace("createArchive");
     Runner run(true);
 
     QStringList excludeList;
@@ -116,10 +174,17 @@ QString    createArchive(const ProjectDefinition& project, QString version)
     {
         excludeList << "--exclude" << ".git*";
     }
+    for (const QString& exclude : sourceTreeExcludes)
+    {
+        // It is only written to be in the archive
+        if (exclude != "sq_project_forced_version.pri")
+            excludeList << "--exclude" << exclude;
+    }
 
     QFileInfo fi(project.basePath);
 
-    QString archiveFile = fi.absoluteFilePath() + "/" + fi.baseName().toLower() + "-" + versionString + ".tar.gz";
+    QDir().mkpath(fi.absoluteFilePath() + "/" + sourceDistDir);
+    QString archiveFile = fi.absoluteFilePath() + "/" + sourceDistDir + "/" + fi.baseName().toLower() + "-" + versionString + ".tar.gz";
     QFile newPri(fi.absoluteFilePath() + "/sq_project_forced_version.pri");
     if (newPri.open(QIODevice::WriteOnly) == false)
     {
@@ -127,7 +192,7 @@ QString    createArchive(const ProjectDefinition& project, QString version)
     }
     newPri.write(QByteArray("SQ_PROJECT_FORCED_VERSION = " + project.version.simpleVersion.toLocal8Bit() + "\n"));
     newPri.close();
-    run.runWithOut("tar", QStringList() << "--transform" << "s,^," + fi.baseName().toLower() + "-" + versionString + "/," << excludeList << "--exclude-vcs" << "-zcf" << archiveFile << ".", fi.absoluteFilePath());
+    run.runWithOut("tar", QStringList() << "--transform" << "s,^," + fi.baseName().toLower() + "-" + versionString + "/," << excludeList << "--exclude-vcs" << tarGzCreateArguments(archiveFile) << ".", fi.absoluteFilePath());
     run.run("rm", QStringList() << fi.absoluteFilePath() + "/sq_project_forced_version.pri");
     return archiveFile;
 }
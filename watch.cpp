@@ -0,0 +1,363 @@
+#include <QCoreApplication>
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDateTime>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QFileSystemWatcher>
+#include <QHash>
+#include <QJsonDocument>
+#include <QJsonParseError>
+#include <QSet>
+#include <QTimer>
+
+#include <watch.h>
+#include <sqpackager.h>
+#include <basestuff.h>
+#include <buildsystem.h>
+#include <desktoprc.h>
+#include <print.h>
+#include <trace.h>
+
+/*
+ * A generated file, the project fields it is made from and the files its generator reads
+ * The fingerprint is compared after each change, only the outputs whose fingerprint or input files changed are written
+ */
+struct WatchedOutput
+{
+    QString name;
+    std::function<QStringList(const ProjectDefinition&)>    fields;
+    std::function<QStringList(const ProjectDefinition&)>    inputFiles;
+    std::function<void(ProjectDefinition&)>                 generate;
+};
+
+struct FileStamp
+{
+    QDateTime   modified;
+    qint64      size = -1;
+    bool operator==(const FileStamp& other) const { return modified == other.modified && size == other.size; }
+    bool operator!=(const FileStamp& other) const { return !(*this == other); }
+};
+
+static FileStamp    fileStamp(const QString& path)
+{
+    QFileInfo fi(path);
+    if (!fi.exists())
+        return FileStamp();
+    return FileStamp{fi.lastModified(), fi.size()};
+}
+
+static QByteArray   fingerprint(const QStringList& fields)
+{
+    QByteArray data;
+    QDataStream stream(&data, QIODevice::WriteOnly);
+    stream << fields;
+    return QCryptographicHash::hash(data, QCryptographicHash::Sha256);
+}
+
+static QString  joinSizes(const QList<int>& sizes)
+{
+    QStringList toret;
+    for (int size : sizes)
+        toret.append(QString::number(size));
+    return toret.join(",");
+}
+
+static QStringList  noFiles(const ProjectDefinition&)
+{
+    return QStringList();
+}
+
+static QStringList  releaseFileSources(const ProjectDefinition& project)
+{
+    QStringList toret;
+    for (const ReleaseFile& file : project.releaseFiles)
+    {
+        if (file.type == Local)
+            toret.append(project.basePath + "/" + file.source);
+    }
+    return toret;
+}
+
+// The translations are built by the generated scripts from the .ts files of this directory
+static QStringList  translationDirectory(const ProjectDefinition& project)
+{
+    if (project.translationDir.isEmpty())
+        return QStringList();
+    return QStringList() << project.basePath + "/" + project.translationDir;
+}
+
+static QStringList  unixInstallerSources(const ProjectDefinition& project)
+{
+    return releaseFileSources(project) + translationDirectory(project);
+}
+
+static QList<WatchedOutput>  watchedOutputs(const WatchTargets& targets)
+{
+    QList<WatchedOutput> outputs;
+    const bool desktopRC = targets.unixInstaller || targets.flatpak || targets.debian;
+    // First, the other outputs use the generated sizes
+    if (desktopRC)
+    {
+        outputs.append({"hicolor icons", [](const ProjectDefinition& p) {
+                            return QStringList() << p.desktopIcon << p.desktopIconNormalizedName;
+                        }, [](const ProjectDefinition& p) {
+                            return QStringList() << p.basePath + "/" + p.desktopIcon;
+                        }, [](ProjectDefinition& p) {
+                            setIconSize(p);
+                            generateHicolorIcons(p);
+                        }});
+    }
+    if (targets.desktop || targets.unixInstaller)
+    {
+        outputs.append({".desktop file", [](const ProjectDefinition& p) {
+                            return QStringList() << p.name << p.shortDescription << p.targetName
+                                                 << p.desktopIconNormalizedName << p.categories.join(";");
+                        }, noFiles, [](ProjectDefinition& p) {
+                            generateLinuxDesktopRC(p);
+                        }});
+    }
+    if (targets.unixInstaller || targets.debian)
+    {
+        outputs.append({"manpage", [](const ProjectDefinition& p) {
+                            return QStringList() << p.targetName << p.shortDescription << p.description
+                                                 << p.author << p.authorMail << p.version.simpleVersion;
+                        }, noFiles, [](ProjectDefinition& p) {
+                            // A manpage written by the project is never replaced
+                            if (!QFileInfo::exists(p.basePath + "/" + p.targetName + ".1"))
+                                generateManPage(p);
+                        }});
+        outputs.append({"unix installer", [](const ProjectDefinition& p) {
+                            QStringList toret;
+                            toret << p.proFile << p.cmakeFile << QString::number(static_cast<int>(p.buildSystem))
+                                  << p.targetName << p.unixNormalizedName << p.desktopFile
+                                  << p.desktopFileNormalizedName << p.debianPackageName << p.desktopIconNormalizedName
+                                  << p.desktopIcon << p.generatedIconsDir << joinSizes(p.generatedIconSizes)
+                                  << QString::number(static_cast<int>(p.qtMajorVersion)) << p.readmeFile << p.translationDir;
+                            for (const ReleaseFile& file : p.releaseFiles)
+                                toret << QString::number(file.type) << file.source << file.destination;
+                            return toret;
+                        }, unixInstallerSources, [](ProjectDefinition& p) {
+                            generateUnixInstallFile(p);
+                        }});
+    }
+    if (targets.flatpak)
+    {
+        outputs.append({"flatpak manifest", [](const ProjectDefinition& p) {
+                            return QStringList() << p.org << p.name << p.basePath << p.projectBasePath << p.proFile
+                                                 << p.cmakeFile << QString::number(static_cast<int>(p.buildSystem))
+                                                 << QString::number(static_cast<int>(p.qtMajorVersion)) << p.targetName
+                                                 << p.flatpakFilesystemPermission << p.desktopIcon << p.desktopFile
+                                                 << p.generatedIconsDir << joinSizes(p.generatedIconSizes)
+                                                 << p.desktopIconNormalizedName;
+                        }, noFiles, [](ProjectDefinition& p) {
+                            generateFlatPakFile(p);
+                        }});
+    }
+    if (targets.debian)
+    {
+        outputs.append({"debian/rules", [](const ProjectDefinition& p) {
+                            return QStringList() << QString::number(static_cast<int>(p.qtMajorVersion)) << p.debianPackageName
+                                                 << p.proFile << p.translationDir << QString::number(static_cast<int>(p.buildSystem));
+                        }, translationDirectory, [](ProjectDefinition& p) {
+                            generateDebianRules(p);
+                        }});
+        outputs.append({"debian/control", [](const ProjectDefinition& p) {
+                            return QStringList() << QString::number(static_cast<int>(p.qtMajorVersion)) << p.debianPackageName
+                                                 << p.debianMaintainer << p.debianMaintainerMail << p.shortDescription
+                                                 << p.description << p.qtModules << QString::number(static_cast<int>(p.buildSystem));
+                        }, noFiles, [](ProjectDefinition& p) {
+                            generateDebianControl(p);
+                        }});
+        outputs.append({"debian/copyright", [](const ProjectDefinition& p) {
+                            return QStringList() << p.name << p.author << p.authorMail << p.licenseName
+                                                 << p.debianMaintainer << p.debianMaintainerMail << p.targetName;
+                        }, noFiles, [](ProjectDefinition& p) {
+                            generateDebianCopyright(p);
+                        }});
+    }
+    return outputs;
+}
+
+// The state the --gen options leave the project in, without the probes
+static void prepareProject(ProjectDefinition& project, const WatchTargets& targets)
+{
+    if (targets.unixInstaller || targets.flatpak || targets.debian)
+        setDesktopRC(project);
+    if (targets.flatpak)
+        project.flatpakName = project.org + "." + project.name;
+    if (targets.debian)
+        setDebianDefinition(project);
+}
+
+class ProjectWatcher : public QObject
+{
+public:
+    ProjectWatcher(const QString& projectFile, const ProjectDefinition& project, const WatchTargets& targets,
+                   std::function<ProjectDefinition()> loadProject)
+        : m_projectFile(QFileInfo(projectFile).absoluteFilePath()), m_project(project), m_targets(targets),
+          m_loadProject(loadProject), m_outputs(watchedOutputs(targets))
+    {
+        for (const WatchedOutput& output : m_outputs)
+            m_fingerprints[output.name] = fingerprint(output.fields(m_project));
+        updateWatchedFiles();
+        // Editors save by bursts of events, wait for the last one
+        m_debounce.setSingleShot(true);
+        m_debounce.setInterval(50);
+        QObject::connect(&m_debounce, &QTimer::timeout, this, [this]() { handleChanges(); });
+        QObject::connect(&m_watcher, &QFileSystemWatcher::fileChanged, this, [this]() { m_debounce.start(); });
+        QObject::connect(&m_watcher, &QFileSystemWatcher::directoryChanged, this, [this]() { m_debounce.start(); });
+    }
+
+private:
+    // The targets and Qt modules are read from them, the .pro file with its include() files or the CMakeLists.txt files
+    QStringList projectBuildFiles() const
+    {
+        QStringList files = ::projectBuildFiles(m_project);
+        files << QFileInfo(m_project.buildSystem == BuildSystem::CMake ? m_project.cmakeFile : m_project.proFile).absoluteFilePath();
+        files.removeDuplicates();
+        return files;
+    }
+
+    QStringList inputFiles() const
+    {
+        QStringList files;
+        files << m_projectFile << projectBuildFiles();
+        for (const WatchedOutput& output : m_outputs)
+            files << output.inputFiles(m_project);
+        files.removeDuplicates();
+        return files;
+    }
+
+    // Saving with a rename drop the file from the watcher, the parent directories catch it coming back
+    void    updateWatchedFiles()
+    {
+        QHash<QString, FileStamp> stamps;
+        QStringList directories;
+        for (const QString& file : inputFiles())
+        {
+            const QString path = QFileInfo(file).absoluteFilePath();
+            stamps[path] = m_stamps.contains(path) ? m_stamps.value(path) : fileStamp(path);
+            if (QFileInfo::exists(path) && !m_watcher.files().contains(path) && !m_watcher.directories().contains(path))
+                m_watcher.addPath(path);
+            directories.append(QFileInfo(path).absolutePath());
+        }
+        directories.removeDuplicates();
+        for (const QString& dir : directories)
+        {
+            if (!m_watcher.directories().contains(dir))
+                m_watcher.addPath(dir);
+        }
+        m_stamps = stamps;
+    }
+
+    bool    projectIsValid() const
+    {
+        QFile file(m_projectFile);
+        if (!file.open(QIODevice::ReadOnly))
+            return false;
+        QJsonParseError error;
+        QJsonDocument::fromJson(file.readAll(), &error);
+        if (error.error != QJsonParseError::NoError)
+        {
+            logMessage(LogLevel::Warning, QString("%1 is not valid : %2 at offset %3, waiting for the next change\n")
+                       .arg(m_projectFile, error.errorString()).arg(error.offset));
+            return false;
+        }
+        return true;
+    }
+
+    void    handleChanges()
+    {
+        QElapsedTimer timer;
+        timer.start();
+        QSet<QString> changed;
+        for (auto it = m_stamps.begin(); it != m_stamps.end(); ++it)
+        {
+            const FileStamp stamp = fileStamp(it.key());
+            if (stamp != it.value())
+            {
+                changed.insert(it.key());
+                it.value() = stamp;
+            }
+        }
+        if (changed.isEmpty())
+            return ;
+        TraceSpan trace("watchChanges");
+        bool reload = changed.contains(m_projectFile);
+        for (const QString& file : projectBuildFiles())
+            reload = reload || changed.contains(file);
+        if (reload)
+        {
+            if (!projectIsValid())
+                return ;
+            // A project that can't be loaded is reported, the previous one is kept until the next change
+            try
+            {
+                RecoverableErrors recoverable;
+                ProjectDefinition project = m_loadProject();
+                prepareProject(project, m_targets);
+                m_project = project;
+            } catch (const ProjectError& error) {
+                logMessage(LogLevel::Warning, "The project can't be loaded : " + error.message + ", waiting for the next change\n");
+                updateWatchedFiles();
+                return ;
+            }
+        }
+        QStringList regenerated;
+        QStringList failed;
+        for (const WatchedOutput& output : m_outputs)
+        {
+            const QByteArray current = fingerprint(output.fields(m_project));
+            bool dirty = current != m_fingerprints.value(output.name) || m_failed.contains(output.name);
+            for (const QString& file : output.inputFiles(m_project))
+                dirty = dirty || changed.contains(QFileInfo(file).absoluteFilePath());
+            if (!dirty)
+                continue;
+            // A failed output is generated again on the next change, whatever it is
+            try
+            {
+                RecoverableErrors recoverable;
+                output.generate(m_project);
+            } catch (const ProjectError& error) {
+                logMessage(LogLevel::Warning, "Could not generate the " + output.name + " : " + error.message + "\n");
+                failed.append(output.name);
+                m_failed.insert(output.name);
+                continue;
+            }
+            m_failed.remove(output.name);
+            // The generator can change the project (icon sizes), take the fingerprint after it
+            m_fingerprints[output.name] = fingerprint(output.fields(m_project));
+            regenerated.append(output.name);
+        }
+        updateWatchedFiles();
+        if (!failed.isEmpty())
+            printSummary(QString("Could not regenerate %1 (%2 ms)").arg(failed.join(", ")).arg(timer.elapsed()));
+        if (!regenerated.isEmpty())
+            printSummary(QString("Regenerated %1 in %2 ms").arg(regenerated.join(", ")).arg(timer.elapsed()));
+        else if (failed.isEmpty())
+            printSummary(QString("No generated file depends on the change (%1 ms)").arg(timer.elapsed()));
+    }
+
+    QString                     m_projectFile;
+    ProjectDefinition           m_project;
+    WatchTargets                m_targets;
+    std::function<ProjectDefinition()>  m_loadProject;
+    QList<WatchedOutput>        m_outputs;
+    QHash<QString, QByteArray>  m_fingerprints;
+    QSet<QString>               m_failed;
+    QHash<QString, FileStamp>   m_stamps;
+    QFileSystemWatcher          m_watcher;
+    QTimer                      m_debounce;
+};
+
+void    watchProject(const QString& projectFile, ProjectDefinition project, const WatchTargets& targets,
+                     std::function<ProjectDefinition()> loadProject)
+{
+    ProjectWatcher watcher(projectFile, project, targets, loadProject);
+    printSummary("Watching " + QDir::toNativeSeparators(QFileInfo(projectFile).absoluteFilePath()) + ", press Ctrl+C to stop");
+    flushLog();
+    QCoreApplication::exec();
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <functional>
+#include <QString>
+#include <projectdefinition.h>
+
+struct WatchTargets
+{
+    bool    desktop = false;
+    bool    unixInstaller = false;
+    bool    flatpak = false;
+    bool    debian = false;
+};
+
+/*
+ * Keep the resolved project and regenerate the packaging files when their inputs change
+ * loadProject is called again only when sqproject.json, the .pro file and its include() files or the CMakeLists.txt
+ * files change. Its errors and the generators ones are reported and the watch goes on
+ */
+void    watchProject(const QString& projectFile, ProjectDefinition project, const WatchTargets& targets,
+                     std::function<ProjectDefinition()> loadProject);
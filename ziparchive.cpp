@@ -0,0 +1,237 @@
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QDirIterator>
+#include <QtEndian>
+#include <QtConcurrent>
+#include <array>
+#include <ziparchive.h>
+#include <trace.h>
+
+// Values from the PKWARE APPNOTE
+enum ZipConstants : quint32 {
+    ZipLocalHeaderSignature = 0x04034b50,
+    ZipCentralHeaderSignature = 0x02014b50,
+    ZipEndOfCentralSignature = 0x06054b50,
+    ZipVersion = 20,
+    ZipFlagUtf8 = 0x0800,
+    ZipMethodStored = 0,
+    ZipMethodDeflated = 8,
+    ZipMaxEntries = 0xFFFF
+};
+
+// Files are read and compressed by batch of this size to bound the memory used
+static const qint64 batchSize = 64 * 1024 * 1024;
+
+struct ZipEntry
+{
+    QString     sourcePath;
+    QByteArray  name;
+    QDateTime   time;
+    qint64      sourceSize;
+    // Filled by the compression
+    quint32     crc = 0;
+    quint16     method = ZipMethodStored;
+    QByteArray  data;
+    // Only kept for the entry handler
+    QByteArray  content;
+    bool        keepContent = false;
+    quint32     compressedSize = 0;
+    bool        ok = false;
+    quint32     headerOffset = 0;
+};
+
+static quint32 zipCrc32(const QByteArray& data)
+{
+    static const auto table = [] {
+        std::array<quint32, 256> toret;
+        for (quint32 i = 0; i < 256; i++)
+        {
+            quint32 c = i;
+            for (int k = 0; k < 8; k++)
+                c = (c & 1) ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+            toret[i] = c;
+        }
+        return toret;
+    }();
+    quint32 crc = 0xFFFFFFFF;
+    for (char c : data)
+        crc = table[(crc ^ quint8(c)) & 0xFF] ^ (crc >> 8);
+    return crc ^ 0xFFFFFFFF;
+}
+
+static void compressEntry(ZipEntry& entry)
+{
+    QFile file(entry.sourcePath);
+    if (!file.open(QIODevice::ReadOnly))
+        return ;
+    const QByteArray content = file.readAll();
+    entry.sourceSize = content.size();
+    entry.crc = zipCrc32(content);
+    // qCompress output is a 4 bytes size then a zlib stream, zip want the raw deflate stream without the zlib header and adler32
+    const QByteArray compressed = qCompress(content, 9);
+    if (compressed.size() > 10 && compressed.size() - 10 < content.size())
+    {
+        entry.method = ZipMethodDeflated;
+        entry.data = compressed.mid(6, compressed.size() - 10);
+    } else {
+        entry.method = ZipMethodStored;
+        entry.data = content;
+    }
+    entry.compressedSize = entry.data.size();
+    if (entry.keepContent)
+        entry.content = content;
+    entry.ok = true;
+}
+
+template<typename T>
+static void append(QByteArray& out, T value)
+{
+    value = qToLittleEndian(value);
+    out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+static void appendDosTime(QByteArray& out, const QDateTime& dateTime)
+{
+    // DOS time can't go before 1980
+    const QDateTime local = qMax(dateTime.toLocalTime(), QDateTime(QDate(1980, 1, 1), QTime(0, 0)));
+    const QDate date = local.date();
+    const QTime time = local.time();
+    append<quint16>(out, (time.hour() << 11) | (time.minute() << 5) | (time.second() / 2));
+    append<quint16>(out, ((date.year() - 1980) << 9) | (date.month() << 5) | date.day());
+}
+
+// The part shared by the local and the central headers, after the version needed
+static void appendCommonHeader(QByteArray& out, const ZipEntry& entry)
+{
+    append<quint16>(out, ZipFlagUtf8);
+    append<quint16>(out, entry.method);
+    appendDosTime(out, entry.time);
+    append<quint32>(out, entry.crc);
+    append<quint32>(out, entry.compressedSize);
+    append<quint32>(out, entry.sourceSize);
+    append<quint16>(out, entry.name.size());
+    append<quint16>(out, 0);
+}
+
+bool    writeZipArchive(const QString& zipPath, const QString& sourceDir, const QString& rootName,
+                        QString* error, const QDateTime& modificationTime, const ZipEntryHandler& entryHandler)
+{
+    TraceSpan trace("writeZipArchive");
+    QString dummy;
+    QString& err = error != nullptr ? *error : dummy;
+    QDir source(sourceDir);
+    QList<ZipEntry> entries;
+    QDirIterator it(source.absolutePath(), QDir::Files | QDir::Hidden | QDir::NoDotAndDotDot, QDirIterator::Subdirectories);
+    while (it.hasNext())
+    {
+        it.next();
+        ZipEntry entry;
+        entry.sourcePath = it.filePath();
+        entry.name = (rootName + "/" + source.relativeFilePath(it.filePath())).toUtf8();
+        entry.time = modificationTime.isValid() ? modificationTime : it.fileInfo().lastModified();
+        entry.sourceSize = it.fileInfo().size();
+        entry.keepContent = bool(entryHandler);
+        // The sizes are written on 32 bits, a bigger file needs zip64
+        if (entry.sourceSize > 0xFFFFFFFFll)
+        {
+            err = it.filePath() + " is bigger than 4GiB, zip64 is not supported";
+            return false;
+        }
+        entries.append(entry);
+    }
+    std::sort(entries.begin(), entries.end(), [](const ZipEntry& a, const ZipEntry& b) {
+        return a.name < b.name;
+    });
+    if (entries.size() > ZipMaxEntries)
+    {
+        err = "Too many files for a zip file without zip64";
+        return false;
+    }
+
+    QFile zipFile(zipPath);
+    if (!zipFile.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    {
+        err = zipFile.errorString();
+        return false;
+    }
+    qint64 offset = 0;
+    int batchStart = 0;
+    while (batchStart < entries.size())
+    {
+        int batchEnd = batchStart;
+        qint64 size = 0;
+        while (batchEnd < entries.size() && (batchEnd == batchStart || size + entries.at(batchEnd).sourceSize <= batchSize))
+            size += entries.at(batchEnd++).sourceSize;
+        auto batchBegin = entries.begin() + batchStart;
+        QtConcurrent::blockingMap(batchBegin, entries.begin() + batchEnd, compressEntry);
+        for (int i = batchStart; i < batchEnd; i++)
+        {
+            ZipEntry& entry = entries[i];
+            if (!entry.ok)
+            {
+                err = "Could not read " + entry.sourcePath;
+                return false;
+            }
+            if (offset + 30 + entry.name.size() + entry.data.size() > 0xFFFFFFFFll)
+            {
+                err = "The zip file would be bigger than 4GiB, zip64 is not supported";
+                return false;
+            }
+            entry.headerOffset = offset;
+            QByteArray header;
+            append<quint32>(header, ZipLocalHeaderSignature);
+            append<quint16>(header, ZipVersion);
+            appendCommonHeader(header, entry);
+            header.append(entry.name);
+            if (zipFile.write(header) != header.size() || zipFile.write(entry.data) != entry.data.size())
+            {
+                err = zipFile.errorString();
+                return false;
+            }
+            offset += header.size() + entry.data.size();
+            if (entryHandler)
+                entryHandler(entry.name, entry.content, entry.crc, entry.time);
+            // Only the central directory is left to write for this entry
+            entry.data = QByteArray();
+            entry.content = QByteArray();
+        }
+        batchStart = batchEnd;
+    }
+
+    QByteArray central;
+    for (const ZipEntry& entry : entries)
+    {
+        append<quint32>(central, ZipCentralHeaderSignature);
+        append<quint16>(central, ZipVersion); // made by, MS-DOS attributes
+        append<quint16>(central, ZipVersion);
+        appendCommonHeader(central, entry);
+        append<quint16>(central, 0); // comment length
+        append<quint16>(central, 0); // disk number
+        append<quint16>(central, 0); // internal attributes
+        append<quint32>(central, 0); // external attributes
+        append<quint32>(central, entry.headerOffset);
+        central.append(entry.name);
+    }
+    if (offset + central.size() > 0xFFFFFFFFll)
+    {
+        err = "The zip file would be bigger than 4GiB, zip64 is not supported";
+        return false;
+    }
+    const quint32 centralSize = central.size();
+    append<quint32>(central, ZipEndOfCentralSignature);
+    append<quint16>(central, 0); // disk number
+    append<quint16>(central, 0); // disk with the central directory
+    append<quint16>(central, entries.size());
+    append<quint16>(central, entries.size());
+    append<quint32>(central, centralSize);
+    append<quint32>(central, offset);
+    append<quint16>(central, 0); // comment length
+    if (zipFile.write(central) != central.size())
+    {
+        err = zipFile.errorString();
+        return false;
+    }
+    zipFile.close();
+    return true;
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <QString>
+#include <QByteArray>
+#include <QDateTime>
+#include <functional>
+
+// Receives every file with its entry name, content and CRC-32 in the zip order, while the zip is written
+using ZipEntryHandler = std::function<void(const QByteArray& name, const QByteArray& content, quint32 crc, const QDateTime& time)>;
+
+/*
+ * Write the content of sourceDir in a zip file, every entry is put under rootName/
+ * Entries are deflated in parallel and written in a sorted order
+ * If modificationTime is valid it is used for every entry instead of the files time
+ * entryHandler lets another archive be written from the same read of the files
+ */
+bool    writeZipArchive(const QString& zipPath, const QString& sourceDir, const QString& rootName,
+                        QString* error = nullptr, const QDateTime& modificationTime = QDateTime(),
+                        const ZipEntryHandler& entryHandler = ZipEntryHandler());